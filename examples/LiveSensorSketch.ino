@@ -0,0 +1,40 @@
+#include <Arduino.h>
+#include <nfc_dynamic_tag.h>
+#include <Wire.h>
+
+#define SENSOR_PIN A0
+#define UPDATE_PERIOD_MS 200
+
+NXP_NTAG_I2C ntag(0x55);
+NTAG_LiveRecord live(ntag, UPDATE_PERIOD_MS);
+
+int16_t value_offset;
+char value[6];
+
+void setup()
+{
+  Serial.begin(115200);
+  Wire.begin();
+  ntag.begin();
+
+  // The template lives in the SRAM (64 bytes), only the placeholder changes afterwards
+  NTAG_URIRecord uri(F("https://example.com/s?v=0000"));
+  uri.WriteTo(live);
+  value_offset = live.Find("0000");
+  if (value_offset < 0 || !live.Start())
+  {
+    Serial.println(F("Template does not fit in the SRAM"));
+    while (true)
+    {
+    }
+  }
+  Serial.println(F("Serving the sensor value, tap the tag with a phone"));
+}
+
+void loop()
+{
+  snprintf(value, sizeof(value), "%04d", analogRead(SENSOR_PIN));
+  live.SetValue(value_offset, value);
+  // SRAM writes only, deferred while a phone is reading the record
+  live.Update();
+}
@@ -0,0 +1,39 @@
+#include <Arduino.h>
+#include <nfc_dynamic_tag.h>
+#include <Wire.h>
+
+// FD (field detection) output of the tag, open drain: released when the RF field goes away
+#define FD_PIN 2
+
+NXP_NTAG_I2C ntag(0x55);
+NTAG_BlockWatcher watcher(ntag);
+
+void on_field_detect()
+{
+  watcher.Notify();
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  Wire.begin();
+  ntag.begin();
+
+  pinMode(FD_PIN, INPUT_PULLUP);
+  attachInterrupt(digitalPinToInterrupt(FD_PIN), on_field_detect, RISING);
+
+  watcher.Baseline();
+  Serial.println(F("Watching the NDEF area, write to the tag with a phone"));
+}
+
+void loop()
+{
+  // One NS_REG read per call, the NDEF area is only read again once the phone is done
+  uint8_t nb_changed = watcher.Poll(Serial);
+  if (nb_changed > 0)
+  {
+    Serial.print(nb_changed);
+    Serial.println(F(" block(s) changed"));
+  }
+  delay(50);
+}
@@ -5,6 +5,11 @@
 NXP_NTAG_I2C ntag(0x55);
 char ui_buffer[64];
 
+// Binary command interface: the first frame received (SOF 0xA5) switches
+// the sketch from the menu to the request/response protocol until reset
+NTAG_CommandServer command_server(ntag, Serial);
+bool binary_mode = false;
+
 void setup()
 {
     Serial.begin(115200);
@@ -16,6 +21,15 @@ void loop()
 {
 
     static uint8_t command;
+
+    if (!binary_mode && Serial.peek() == NTAG_FRAME_SOF)
+        binary_mode = true;
+    if (binary_mode)
+    {
+        command_server.Poll();
+        return;
+    }
+
     promptMenu();
 
     Serial.flush();
@@ -23,6 +37,8 @@ void loop()
     if (!Serial.available())
     {
         command = read_int();
+        if (Serial.peek() == NTAG_FRAME_SOF)
+            return;
         Serial.println(command);
         Serial.println();
 
@@ -49,8 +65,11 @@ void loop()
         case 7:
             ntag.GetNTAGFullReport();
             break;
+        case 8:
+            ntag.UserMemoryDumpBinary(Serial);
+            break;
         default:
-            Serial.println("Incorrect Option");
+            Serial.println(F("Incorrect Option"));
             break;
         }
     }
@@ -65,7 +84,8 @@ void promptMenu()
     Serial.print(F("4-Static Lock Status\n"));
     Serial.print(F("5-Configuration Status\n"));
     Serial.print(F("6-Session Status\n"));
-    Serial.print(F("7-Full NTAG Report \n\n"));
+    Serial.print(F("7-Full NTAG Report \n"));
+    Serial.print(F("8-Binary Memory Dump (decode with HostTools dump_decoder)\n\n"));
     Serial.print(F("Enter a command: "));
 }
 
@@ -75,6 +95,12 @@ uint8_t read_data()
     int c;
     while (index < 63)
     {
+        // Leave a binary frame to the command server
+        if (index == 0 && Serial.peek() == NTAG_FRAME_SOF)
+        {
+            ui_buffer[0] = '\0';
+            return 0;
+        }
         c = Serial.read();
         if (((char)c == '\r') || ((char)c == '\n'))
             break;
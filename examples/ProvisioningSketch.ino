@@ -0,0 +1,27 @@
+#include <Arduino.h>
+#include <nfc_dynamic_tag.h>
+#include <Wire.h>
+
+// Headless provisioning: tag images (Snapshot() format) come from the host
+// `provision` tool in binary frames, no prompt is printed on the port.
+// The next image is received while the current one is programmed.
+// Each of the two image buffers holds NTAG_PROVISION_IMAGE_MAX bytes, 256 by
+// default: about 14 used user blocks. Larger images need a board
+// with more RAM, built with -D NTAG_PROVISION_IMAGE_MAX=..., and the same
+// value given to `provision --max-image`; `provision` refuses the images that
+// do not fit before sending anything.
+
+NXP_NTAG_I2C ntag(0x55);
+NTAG_Provisioner provisioner(ntag, Serial);
+
+void setup()
+{
+  Serial.begin(115200);
+  Wire.begin();
+  ntag.begin();
+}
+
+void loop()
+{
+  provisioner.Poll();
+}
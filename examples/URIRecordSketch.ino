@@ -0,0 +1,32 @@
+#include <Arduino.h>
+#include <nfc_dynamic_tag.h>
+#include <Wire.h>
+
+NXP_NTAG_I2C ntag(0x55);
+
+void setup()
+{
+  Serial.begin(115200);
+  Wire.begin();
+  ntag.begin();
+
+  // "https://www." is abbreviated to the prefix code 0x02, the URI stays in flash
+  NTAG_URIRecord uri(F("https://www.nxp.com/products/NT3H1101"));
+
+  Serial.print(F("Prefix code 0x"));
+  Serial.print(uri.PrefixCode(), HEX);
+  Serial.print(F(", "));
+  Serial.print(uri.TLVLength());
+  Serial.print(F(" bytes in "));
+  Serial.print(uri.BlockCount());
+  Serial.println(F(" blocks"));
+
+  NTAG_BlockWriter writer(ntag);
+  uri.WriteTo(writer);
+  writer.Flush();
+  ntag.UserMemoryDump();
+}
+
+void loop()
+{
+}
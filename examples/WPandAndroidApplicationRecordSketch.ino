@@ -4,18 +4,34 @@
 
 NXP_NTAG_I2C ntag(0x55);
 
+// NDEF message in pieces: the records stay in flash, only the short headers are in RAM
+
+const byte TLV_HEADER[] = {0x03, 0x88};
+const byte WINDOWS_RECORD[] PROGMEM = {0x93, 0x15, 0x46, 0x77, 0x69, 0x6e, 0x64, 0x6f, 0x77, 0x73, 0x2e, 0x63, 0x6f, 0x6d, 0x2f, 0x4c, 0x61, 0x75, 0x6e, 0x63, 0x68, 0x41, 0x70, 0x70, 0x00, 0x01, 0x0C, 0x57, 0x69, 0x6e, 0x64, 0x6f, 0x77, 0x73, 0x50, 0x68, 0x6f, 0x6e, 0x65, 0x26, 0x7b, 0x36, 0x33, 0x63, 0x31, 0x39, 0x39, 0x66, 0x35, 0x2d, 0x64, 0x31, 0x30, 0x63, 0x2d, 0x34, 0x64, 0x65, 0x31, 0x2d, 0x38, 0x35, 0x32, 0x63, 0x2d, 0x31, 0x31, 0x63, 0x30, 0x65, 0x39, 0x66, 0x35, 0x37, 0x64, 0x36, 0x36, 0x7d, 0x00, 0x0E, 0x22, 0x75, 0x73, 0x65, 0x72, 0x3d, 0x64, 0x65, 0x66, 0x61, 0x75, 0x6C, 0x74, 0x22};
+const byte ANDROID_HEADER[] = {0x54, 0x0F, 0x18};
+const char ANDROID_TYPE[] PROGMEM = "android.com:pkg";
+const char ANDROID_PACKAGE[] PROGMEM = "com.orange.orangecash.fr";
+const byte TERMINATOR[] = {0xFE};
+
+const NTAG_Segment MESSAGE[] = {
+  {TLV_HEADER, sizeof(TLV_HEADER), NTAG_SEGMENT_RAM},
+  {WINDOWS_RECORD, sizeof(WINDOWS_RECORD), NTAG_SEGMENT_PROGMEM},
+  {ANDROID_HEADER, sizeof(ANDROID_HEADER), NTAG_SEGMENT_RAM},
+  {ANDROID_TYPE, sizeof(ANDROID_TYPE) - 1, NTAG_SEGMENT_PROGMEM},
+  {ANDROID_PACKAGE, sizeof(ANDROID_PACKAGE) - 1, NTAG_SEGMENT_PROGMEM},
+  {TERMINATOR, sizeof(TERMINATOR), NTAG_SEGMENT_RAM}};
+
 void setup()
 {
   Serial.begin(115200);
   Wire.begin();
   ntag.begin();
-  ntag.CleanData();
 }
 
 void loop()
 {
-  byte data[] = {0x03, 0x88, 0x93, 0x15, 0x46, 0x77, 0x69, 0x6e, 0x64, 0x6f, 0x77, 0x73, 0x2e, 0x63, 0x6f, 0x6d, 0x2f, 0x4c, 0x61, 0x75, 0x6e, 0x63, 0x68, 0x41, 0x70, 0x70, 0x00, 0x01, 0x0C, 0x57, 0x69, 0x6e, 0x64, 0x6f, 0x77, 0x73, 0x50, 0x68, 0x6f, 0x6e, 0x65, 0x26, 0x7b, 0x36, 0x33, 0x63, 0x31, 0x39, 0x39, 0x66, 0x35, 0x2d, 0x64, 0x31, 0x30, 0x63, 0x2d, 0x34, 0x64, 0x65, 0x31, 0x2d, 0x38, 0x35, 0x32, 0x63, 0x2d, 0x31, 0x31, 0x63, 0x30, 0x65, 0x39, 0x66, 0x35, 0x37, 0x64, 0x36, 0x36, 0x7d, 0x00, 0x0E, 0x22, 0x75, 0x73, 0x65, 0x72, 0x3d, 0x64, 0x65, 0x66, 0x61, 0x75, 0x6C, 0x74, 0x22, 0x54, 0x0F, 0x18, 0x61, 0x6e, 0x64, 0x72, 0x6f, 0x69, 0x64, 0x2e, 0x63, 0x6f, 0x6d, 0x3a, 0x70, 0x6b, 0x67, 0x63, 0x6f, 0x6d, 0x2e, 0x6f, 0x72, 0x61, 0x6e, 0x67, 0x65, 0x2e, 0x6f, 0x72, 0x61, 0x6e, 0x67, 0x65, 0x63, 0x61, 0x73, 0x68, 0x2e, 0x66, 0x72, 0xFE};
-  ntag.WriteDataEEPROM(data, 139);
+  // Each block written once, straight from the pieces, blocks of a longer previous message cleaned
+  ntag.ReplaceContent(MESSAGE, sizeof(MESSAGE) / sizeof(MESSAGE[0]));
   ntag.UserMemoryDump();
   delay(60000);
 }
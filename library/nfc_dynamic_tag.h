@@ -22,6 +22,47 @@ This is a library for the NXP NTAG_I2C board
 		UserMemoryDump
 
 		Added
+		PrintHex, PrintHexASCII and UserMemoryDump on any Print sink, buffered
+		one write per 16-byte line
+		UserMemoryDumpBinary (CRC protected frames, see nfc_dynamic_tag_frame.h)
+		NTAG_FrameWriter
+		NTAG_FrameReader, NTAG_CommandServer (binary request/response commands)
+		ReadSessionRegister, ReadSessionRegisters, WriteSessionRegister
+		ReadSerialNumber, ReadStaticLock, ReadCapabilityContainer,
+		ReadConfiguration, ReadSession (decoded registers, no printing)
+		Register reports rendered from PROGMEM descriptor tables, NC_REG and
+		NS_REG bit tables in the configuration and session reports
+		NTAG_BlockWriter (Print sink streaming to the user memory blocks)
+		NTAG_WifiCredential (WSC credential record encoder)
+		NTAG_URIRecord (URI record encoder with automatic prefix abbreviation)
+		NTAG_NDEFUpdater, WaitEEPROMReady (tear-safe NDEF update)
+		PlanWrite (static and dynamic lock map, writable blocks and write
+		time); WriteDataEEPROM refuses and CleanData skips locked blocks
+		WriteConfiguration (read-modify-write, only when a field changes)
+		WriteSessionRegisters (batched masked updates), CachedSessionRegister
+		NT3H1201 (2k) support: DetectMemoryMap, MemoryMap, NTAG_I2C_BlockFromRFPage
+		Memory map traits (nfc_dynamic_tag_map.h), NTAG_I2C_Tag<Map> driver
+		with compile-time checked WriteUserBlocks / WriteUserData, and
+		CleanData / PlanWrite / UserMemoryDump bounded by the Map constants
+		Snapshot, Restore (run-length encoded tag image, see
+		nfc_dynamic_tag_image.h)
+		NTAG_BlockWatcher (changed blocks after RF writes, per-block CRC)
+		NTAG_LiveRecord (NDEF record served from the SRAM mirror, double
+		buffered value updates); WriteDataBlock no longer waits after SRAM
+		writes
+		WriteDataSRAM no longer writes one block past the data (0xFC when
+		the 64 bytes are given)
+		SetWatchdogTime, WatchdogTime, SetClockStretching, MeasureLockRelease,
+		WatchdogSweep (I2C_LOCKED release time per watchdog value)
+		SetIdleTask (work run during the EEPROM programming waits),
+		NTAG_Provisioner (double buffered tag images received over a serial
+		port while the previous one is programmed)
+		NTAG_RecordIndex (record offsets of the NDEF message, Patch() rewrites
+		only the blocks a payload change touches)
+		ReplaceContent (CleanData and WriteDataEEPROM writing each block
+		once)
+		WriteSegments, NTAG_Segment (RAM and PROGMEM pieces written straight
+		into the I2C block writes, no staging buffer)
 
 		v0.0  - Defining command codes and functions
 
@@ -38,37 +79,294 @@ This is a library for the NXP NTAG_I2C board
 #include "WProgram.h"
 #endif
 
+#include "nfc_dynamic_tag_frame.h"
+#include "nfc_dynamic_tag_map.h"
+#include "nfc_dynamic_tag_image.h"
+
 // NTAG_I2C standard I2C address
 
-// NTAG_I2C I2C Register addresses
+#define NTAG_I2C_BLOCK_WRITE_MS 7 //WriteDataBlock: 17 bytes at 100 kHz plus the 5 ms programming delay
+
+// NC_REG bits (configuration and session registers, byte 0)
+
+#define NTAG_I2C_NC_I2C_RST_ON_OFF 0x80
+#define NTAG_I2C_NC_PTHRU_ON_OFF 0x40
+#define NTAG_I2C_NC_FD_OFF_MASK 0x30
+#define NTAG_I2C_NC_FD_ON_MASK 0x0C
+#define NTAG_I2C_NC_SRAM_MIRROR_ON_OFF 0x02
+#define NTAG_I2C_NC_PTHRU_DIR 0x01
+
+// NS_REG flags (session register, byte 6)
+
+#define NTAG_I2C_NS_NDEF_DATA_READ 0x80
+#define NTAG_I2C_NS_I2C_LOCKED 0x40
+#define NTAG_I2C_NS_RF_LOCKED 0x20
+#define NTAG_I2C_NS_SRAM_I2C_READY 0x10
+#define NTAG_I2C_NS_SRAM_RF_READY 0x08
+#define NTAG_I2C_NS_EEPROM_WR_ERR 0x04
+#define NTAG_I2C_NS_EEPROM_WR_BUSY 0x02
+#define NTAG_I2C_NS_RF_FIELD_PRESENT 0x01
+
+// REG_LOCK bits (configuration register, byte 6), set once they cannot be cleared
+
+#define NTAG_I2C_REG_LOCK_I2C 0x02
+#define NTAG_I2C_REG_LOCK_NFC 0x01
+
+// WriteConfiguration() results
+
+#define NTAG_CONFIG_UNCHANGED 0x00 //already holding these values, no EEPROM write
+#define NTAG_CONFIG_WRITTEN 0x01
+#define NTAG_CONFIG_LOCKED 0x02 //REG_LOCK_I2C set, nothing written
+
+// NDEF message TLV and record header (NFC Forum Type 2 Tag and NDEF specifications)
+
+#define NTAG_NDEF_TLV 0x03
+#define NTAG_NDEF_TLV_TERMINATOR 0xFE
+#define NTAG_NDEF_MB 0x80 //message begin
+#define NTAG_NDEF_ME 0x40 //message end
+#define NTAG_NDEF_SR 0x10 //short record, 1 byte payload length
+#define NTAG_NDEF_IL 0x08 //ID length present
+#define NTAG_NDEF_TNF_WELL_KNOWN 0x01
+#define NTAG_NDEF_TNF_MEDIA 0x02
+
+#define NTAG_NDEF_URI_TYPE 'U'
+#define NTAG_NDEF_URI_NO_PREFIX 0x00
+#define NTAG_NDEF_URI_LAST_PREFIX 0x23 //urn:nfc:
+
+// Wi-Fi Simple Configuration attributes and values (WSC TS v2.0.5)
+
+#define NTAG_WSC_CREDENTIAL 0x100E
+#define NTAG_WSC_NETWORK_INDEX 0x1026
+#define NTAG_WSC_SSID 0x1045
+#define NTAG_WSC_AUTHENTICATION 0x1003
+#define NTAG_WSC_ENCRYPTION 0x100F
+#define NTAG_WSC_NETWORK_KEY 0x1027
+#define NTAG_WSC_MAC_ADDRESS 0x1020
+#define NTAG_WSC_VENDOR_EXTENSION 0x1049
+
+#define NTAG_WSC_AUTH_OPEN 0x0001
+#define NTAG_WSC_AUTH_WPA_PERSONAL 0x0002
+#define NTAG_WSC_AUTH_SHARED 0x0004
+#define NTAG_WSC_AUTH_WPA_ENTERPRISE 0x0008
+#define NTAG_WSC_AUTH_WPA2_ENTERPRISE 0x0010
+#define NTAG_WSC_AUTH_WPA2_PERSONAL 0x0020
+
+#define NTAG_WSC_ENCR_NONE 0x0001
+#define NTAG_WSC_ENCR_WEP 0x0002
+#define NTAG_WSC_ENCR_TKIP 0x0004
+#define NTAG_WSC_ENCR_AES 0x0008
+#define NTAG_WSC_ENCR_AES_TKIP 0x000C
+
+#define NTAG_WSC_MAX_SSID_LENGTH 32
+#define NTAG_WSC_MAX_KEY_LENGTH 64
+
+// WaitEEPROMReady() and NTAG_NDEFUpdater results
+
+#define NTAG_UPDATE_OK 0x00
+#define NTAG_UPDATE_BUSY 0x01        //memory still locked by RF or EEPROM still busy after the timeout
+#define NTAG_UPDATE_WRITE_ERROR 0x02 //EEPROM_WR_ERR was set (cleared before returning)
+#define NTAG_UPDATE_TOO_LONG 0x03    //message does not fit in the user memory
+
+#define NTAG_I2C_EEPROM_TIMEOUT 50 //ms, one EEPROM block write takes about 4.5 ms
+#define NTAG_I2C_PROGRAMMING_MS 5  //wait after each EEPROM block write
+
+// Watchdog time (WDT_MS << 8 | WDT_LS): I2C_LOCKED is released this long after the last I2C access
 
-#define NTAG_I2C_SERIAL_NB_BLOCK 0x00
-#define NTAG_I2C_USER_MEMORY_BLOCK 0x01  //first user memory block, last one being 0x38
-#define NTAG_I2C_DYNAMIC_LOCK_BLOCK 0x38 //Dynamic Lock Bytes are bytes 8, 9 and 10; previous bytes are last user memory bytes
-#define NTAG_I2C_CONF_REG_BLOCK 0x3A
-#define NTAG_I2C_SRAM_BLOCK 0xF8
-#define NTAG_I2C_SESSION_REG_BLOCK 0xFE
+#define NTAG_I2C_WDT_UNIT_NS 9430 //one step, 9.43 us
+#define NTAG_I2C_WDT_DEFAULT 0x0848 //as delivered, 20 ms
+#define NTAG_I2C_WDT_US(wdt) ((uint32_t)(wdt) * NTAG_I2C_WDT_UNIT_NS / 1000)
+
+// NTAG_LiveRecord::Update() results
+
+#define NTAG_LIVE_IDLE 0x00      //nothing changed since the last update
+#define NTAG_LIVE_PUBLISHED 0x01 //changed blocks written to the SRAM
+#define NTAG_LIVE_WAITING 0x02   //period not elapsed yet, a later Update() publishes
+#define NTAG_LIVE_RF_BUSY 0x03   //a phone is reading the record (RF_LOCKED), a later Update() publishes
+
+#define NTAG_LIVE_WINDOW (NTAG_I2C_SRAM_BLOCKS * 16) //SRAM mirrored at block 1, RF pages 4 to 19
+
+// NTAG_RecordIndex::Patch() results
+
+#define NTAG_PATCH_OK 0x00
+#define NTAG_PATCH_NO_RECORD 0x01 //no such record in the index, Build() first
+#define NTAG_PATCH_BAD_RANGE 0x02 //bytes replaced beyond the end of the payload
+#define NTAG_PATCH_TOO_LONG 0x03  //message beyond the NDEF area, or a length field would change size
+#define NTAG_PATCH_LOCKED 0x04    //a block to change is covered by a lock bit, nothing written
+
+#define NTAG_INDEX_MAX_RECORDS 8
+
+// NTAG_Segment memory, WriteSegments() reads PROGMEM segments with pgm_read_byte
+
+#define NTAG_SEGMENT_RAM 0x00
+#define NTAG_SEGMENT_PROGMEM 0x01
+
+// NTAG_WifiCredential::Validate() results
+
+#define NTAG_WSC_OK 0x00
+#define NTAG_WSC_BAD_SSID 0x01
+#define NTAG_WSC_BAD_SECURITY 0x02 //unknown or inconsistent authentication / encryption pair
+#define NTAG_WSC_BAD_KEY 0x03
+
+// Decoded registers returned by the Read* functions
+
+struct NTAG_I2C_SerialNumber
+{
+    uint8_t uid[7]; //uid[0] is the manufacturer code (NXP = 0x04)
+};
+
+struct NTAG_I2C_StaticLock
+{
+    uint16_t page_locks; //bit 0 locks the CC (page 3), bit n locks page n + 3, up to page 15
+    uint8_t block_locks; //bit 0: CC, bit 1: pages 4-9, bit 2: pages 10-15
+    uint8_t raw[2];      //static lock bytes as read (block 0, bytes 10 and 11)
+};
+
+struct NTAG_I2C_CapabilityContainer
+{
+    uint8_t magic;   //0xE1 for a NDEF formatted tag
+    uint8_t version; //mapping version, major in the high nibble
+    uint16_t size;   //NDEF data area size in bytes
+    uint8_t access;  //read/write access conditions
+};
+
+struct NTAG_I2C_Configuration
+{
+    uint8_t nc_reg; //NTAG_I2C_NC_* bits
+    uint8_t last_ndef_block;
+    uint8_t sram_mirror_block;
+    uint16_t wdt; //watchdog time, WDT_MS << 8 | WDT_LS
+    uint8_t i2c_clock_str;
+    uint8_t reg_lock;
+};
+
+struct NTAG_I2C_Session
+{
+    uint8_t nc_reg; //NTAG_I2C_NC_* bits
+    uint8_t last_ndef_block;
+    uint8_t sram_mirror_block;
+    uint16_t wdt; //watchdog time, WDT_MS << 8 | WDT_LS
+    uint8_t i2c_clock_str;
+    uint8_t ns_reg; //NTAG_I2C_NS_* flags
+};
+
+struct NTAG_I2C_SessionUpdate
+{
+    uint8_t reg;  //REGA, 0 = NC_REG ... 6 = NS_REG
+    uint8_t mask; //bits to modify
+    uint8_t value;
+};
+
+struct NTAG_Segment
+{
+    const void *data; //not copied, must stay valid during the write
+    uint16_t length;
+    uint8_t memory; //NTAG_SEGMENT_RAM or NTAG_SEGMENT_PROGMEM
+};
+
+struct NTAG_I2C_WritePlan
+{
+    uint8_t writable[NTAG_I2C_MAP_MAX_BLOCKS / 8]; //bit (block & 7) of writable[block >> 3] set when no lock bit covers the block
+    uint8_t first_block; //planned range
+    uint8_t nb_blocks;
+    uint8_t nb_locked; //blocks of the range covered by a static or dynamic lock bit
+    uint16_t write_ms; //estimated time to write the other blocks of the range
+
+    bool IsWritable(const uint8_t block) const { return block >= NTAG_I2C_MAP_MAX_BLOCKS || (writable[block >> 3] >> (block & 7)) & 0x01; }
+};
+
+struct NTAG_I2C_ReportTable;
+
+class NTAG_FrameWriter
+{
+  public:
+    NTAG_FrameWriter(Print &out);
+
+    void Begin(const uint8_t type, const uint8_t length);
+    void Write(const uint8_t value);
+    void Write(const uint8_t *data, const uint8_t length);
+    void End();
+
+  private:
+    Print &_out;
+    uint16_t _crc;
+};
+
+class NTAG_FrameReader
+{
+  public:
+    NTAG_FrameReader();
+
+    bool Feed(const uint8_t value);
+    uint8_t Type() const { return _type; }
+    uint8_t Length() const { return _length; }
+    const uint8_t *Payload() const { return _payload; }
+
+  private:
+    uint8_t _state;
+    uint8_t _type;
+    uint8_t _length;
+    uint8_t _index;
+    uint16_t _crc;
+    uint8_t _payload[NTAG_FRAME_MAX_PAYLOAD + NTAG_FRAME_CRC_LENGTH];
+};
 
 class NXP_NTAG_I2C
 {
   public:
     NXP_NTAG_I2C(const byte device_address);
-    void begin(void);
+    void begin(void) { begin(true); }
+    void begin(const bool detect_map);
+    NTAG_I2C_MemoryMap DetectMemoryMap();
+    const NTAG_I2C_MemoryMap &MemoryMap() const { return _map; }
+
+    template <class Map>
+    void UseMemoryMap()
+    {
+	_map.dynamic_lock_block = Map::dynamic_lock_block;
+	_map.conf_reg_block = Map::conf_reg_block;
+	_map.lock_bit_blocks = Map::lock_bit_blocks;
+    }
 
     //general purpose functions
 
     void PrintHex(const byte *data, const uint32_t nbBytes, bool prefix);
+    void PrintHex(Print &out, const byte *data, const uint32_t nbBytes, bool prefix);
     void PrintHexASCII(const byte *data, const uint32_t nbBytes);
+    void PrintHexASCII(Print &out, const byte *data, const uint32_t nbBytes);
 
     int ReadDataBlock(const byte block_address, uint8_t *out_buffer, int out_buffer_length);
     void WriteDataBlock(const byte block_address, uint8_t *input_buffer, int input_buffer_length);
-    void WriteDataEEPROM(uint8_t *input_buffer, int input_buffer_length);
+    bool WriteDataEEPROM(uint8_t *input_buffer, int input_buffer_length);
+    bool WriteSegments(const NTAG_Segment *segments, const uint8_t nb_segments);
+    bool ReplaceContent(const uint8_t *content, const int length);
+    bool ReplaceContent(const NTAG_Segment *segments, const uint8_t nb_segments);
     void WriteDataSRAM(uint8_t *input_buffer, int input_buffer_length);
     void StartSRAMMirror();
+    uint8_t ReadSessionRegister(const uint8_t reg);
+    void ReadSessionRegisters(uint8_t *out_buffer);
+    void WriteSessionRegister(const uint8_t reg, const uint8_t mask, const uint8_t value);
+    void WriteSessionRegisters(const NTAG_I2C_SessionUpdate *updates, const uint8_t nb_updates);
+    uint8_t CachedSessionRegister(const uint8_t reg);
+    uint8_t WaitEEPROMReady(const uint16_t timeout_ms = NTAG_I2C_EEPROM_TIMEOUT);
+    uint8_t SetWatchdogTime(const uint16_t wdt, const bool persistent = false);
+    uint16_t WatchdogTime();
+    uint8_t SetClockStretching(const bool on);
+    uint32_t MeasureLockRelease(const uint16_t timeout_ms);
+    void WatchdogSweep(Print &out, const uint16_t *wdt_values, const uint8_t nb_values);
+    void SetIdleTask(void (*task)(void *), void *context);
     void CleanDataBlock(const byte block_address);
     void CleanData();
+    NTAG_I2C_WritePlan PlanWrite(const uint8_t first_block, const uint8_t nb_blocks);
+
+    //special register read functions
+    NTAG_I2C_SerialNumber ReadSerialNumber();
+    NTAG_I2C_StaticLock ReadStaticLock();
+    NTAG_I2C_CapabilityContainer ReadCapabilityContainer();
+    NTAG_I2C_Configuration ReadConfiguration();
+    uint8_t WriteConfiguration(const NTAG_I2C_Configuration &conf);
+    NTAG_I2C_Session ReadSession();
 
-    //special register read and print functions
+    //special register print functions
     void GetCapabilityContainer();
     void GetStaticLockStatus();
     void GetConfigurationStatus();
@@ -78,9 +376,314 @@ class NXP_NTAG_I2C
 
     //Memory dump
     void UserMemoryDump();
+    void UserMemoryDump(Print &out);
+    void UserMemoryDumpBinary(Print &out);
+
+    //Tag image
+    uint16_t Snapshot(Print &out);
+    uint8_t Restore(const uint8_t *image, const uint16_t length, const bool apply_locks = false);
+
+  protected:
+    // Range-bound block loops, over the detected map or a variant trait
+    template <class Map>
+    void CleanUserBlocks(const Map &map);
+    template <class Map>
+    NTAG_I2C_WritePlan PlanUserBlocks(const Map &map, const uint8_t first_block, const uint8_t nb_blocks);
+    template <class Map>
+    void DumpUserBlocks(Print &out, const Map &map);
 
   private:
+    void RenderReport(Print &out, const NTAG_I2C_ReportTable *tables, uint8_t nb_tables, const uint16_t *values);
+    void WaitProgramming();
+    void WriteSegmentBlocks(const NTAG_Segment *segments, const uint8_t nb_segments, const uint8_t last_block);
+
     const byte _device_address;
+    NTAG_I2C_MemoryMap _map;
+    uint8_t _session[8];     //last value read or written of each session register but NS_REG
+    uint8_t _session_cached; //bit n set when _session[n] is known
+    void (*_idle_task)(void *);
+    void *_idle_context;
+};
+
+template <class Map>
+class NTAG_I2C_Tag : public NXP_NTAG_I2C
+{
+  public:
+    NTAG_I2C_Tag(const byte device_address) : NXP_NTAG_I2C(device_address) { UseMemoryMap<Map>(); }
+
+    void begin(void) { NXP_NTAG_I2C::begin(false); }
+
+    // Block loops bounded by the Map constants instead of the runtime map
+    void CleanData() { CleanUserBlocks(Map()); }
+    NTAG_I2C_WritePlan PlanWrite(const uint8_t first_block, const uint8_t nb_blocks) { return PlanUserBlocks(Map(), first_block, nb_blocks); }
+    void UserMemoryDump() { DumpUserBlocks(Serial, Map()); }
+    void UserMemoryDump(Print &out) { DumpUserBlocks(out, Map()); }
+
+    template <uint8_t first_block, uint8_t nb_blocks>
+    void WriteUserBlocks(const uint8_t *data)
+    {
+	static_assert(NTAG_I2C_UserBlocks<Map>(first_block, nb_blocks), "blocks outside the user memory");
+	for (uint8_t i = 0; i < nb_blocks; i++)
+	{
+	    WriteDataBlock(first_block + i, (uint8_t *)&data[i * 16], 16);
+	}
+    }
+
+    template <size_t length>
+    bool WriteUserData(const uint8_t (&data)[length])
+    {
+	static_assert(length <= Map::user_bytes, "data larger than the user memory");
+	return WriteDataEEPROM((uint8_t *)data, length);
+    }
+};
+
+class NTAG_CommandServer
+{
+  public:
+    NTAG_CommandServer(NXP_NTAG_I2C &ntag, Stream &port);
+
+    void Poll();
+
+  private:
+    void Execute(const uint8_t type, const uint8_t *payload, const uint8_t length);
+    void ExecuteBatch(const uint8_t *payload, const uint8_t length);
+    void Respond(const uint8_t seq, const uint8_t status, const uint8_t *data, const uint8_t length);
+
+    NXP_NTAG_I2C &_ntag;
+    Stream &_port;
+    NTAG_FrameReader _reader;
+};
+
+class NTAG_BlockWriter : public Print
+{
+  public:
+    NTAG_BlockWriter(NXP_NTAG_I2C &ntag, const uint8_t first_block = NTAG_I2C_USER_MEMORY_BLOCK);
+
+    size_t write(uint8_t value);
+    size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+    uint8_t Flush();
+    uint8_t BlocksWritten() const { return _blocks_written; }
+
+  private:
+    NXP_NTAG_I2C &_ntag;
+    uint8_t _block;
+    uint8_t _index;
+    uint8_t _blocks_written;
+    uint8_t _buffer[16];
+};
+
+class NTAG_NDEFUpdater : public Print
+{
+  public:
+    NTAG_NDEFUpdater(NXP_NTAG_I2C &ntag);
+
+    size_t write(uint8_t value);
+    size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+    uint8_t Commit();
+    uint8_t Status() const { return _status; }
+
+  private:
+    NXP_NTAG_I2C &_ntag;
+    NTAG_BlockWriter _body; //blocks 2 and up
+    uint8_t _first[16];      //block 1, holding the TLV header, published last
+    uint8_t _index;
+    uint8_t _status;
+    bool _started;
+};
+
+class NTAG_BlockWatcher
+{
+  public:
+    NTAG_BlockWatcher(NXP_NTAG_I2C &ntag);
+
+    void Baseline();
+    void Notify() { _notified = true; }
+    uint8_t Poll();
+    uint8_t Poll(Print &out);
+    bool IsChanged(const uint8_t block) const { return block < NTAG_I2C_MAP_MAX_BLOCKS && (_changed[block >> 3] >> (block & 7)) & 0x01; }
+    uint8_t LastNDEFBlock() const { return _last_ndef_block; }
+
+  private:
+    uint8_t Scan(Print *out);
+
+    NXP_NTAG_I2C &_ntag;
+    uint16_t _crc[NTAG_I2C_MAP_MAX_BLOCKS];       //CRC of each user block at the last scan
+    uint8_t _changed[NTAG_I2C_MAP_MAX_BLOCKS / 8]; //blocks changed by the last scan
+    uint8_t _last_ndef_block;                      //last block of the NDEF TLV at the last scan
+    bool _armed;                                   //RF field or EEPROM write seen since the last scan
+    volatile bool _notified;                       //set by Notify(), e.g. from the FD pin interrupt
+};
+
+class NTAG_LiveRecord : public Print
+{
+  public:
+    NTAG_LiveRecord(NXP_NTAG_I2C &ntag, const uint16_t period_ms = 0);
+
+    size_t write(uint8_t value);
+    size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+    int16_t Find(const char *text) const;
+    bool Start();
+    bool SetValue(const uint8_t offset, const uint8_t *data, const uint8_t length);
+    bool SetValue(const uint8_t offset, const char *text);
+    void SetPeriod(const uint16_t period_ms) { _period_ms = period_ms; }
+    uint8_t Update();
+
+  private:
+    NXP_NTAG_I2C &_ntag;
+    uint8_t _front[NTAG_LIVE_WINDOW]; //as in the SRAM
+    uint8_t _back[NTAG_LIVE_WINDOW];  //next content, changed by SetValue()
+    uint8_t _length;                  //template length, terminator excluded
+    uint16_t _period_ms;
+    unsigned long _published_ms;
+};
+
+struct NTAG_NDEFRecordInfo
+{
+    uint16_t header;         //offset of the header byte in the NDEF area (block 1, byte 0 is offset 0)
+    uint16_t length_field;   //payload length, 1 byte for a short record (SR), 4 bytes otherwise
+    uint16_t type;           //type, then ID when IL is set
+    uint16_t payload;
+    uint16_t payload_length;
+    uint8_t type_length;
+    uint8_t flags; //header byte: MB, ME, CF, SR, IL and TNF
+};
+
+class NTAG_RecordIndex
+{
+  public:
+    NTAG_RecordIndex(NXP_NTAG_I2C &ntag);
+
+    uint8_t Build();
+    uint8_t RecordCount() const { return _nb_records; }
+    const NTAG_NDEFRecordInfo &Record(const uint8_t record) const { return _records[record]; }
+    uint16_t MessageLength() const { return _end - _message; }
+    uint8_t Patch(const uint8_t record, const uint16_t offset, const uint8_t *data, const uint16_t length);
+    uint8_t Patch(const uint8_t record, const uint16_t offset, const uint16_t removed, const uint8_t *data, const uint16_t length);
+    uint8_t BlocksWritten() const { return _blocks_written; }
+
+  private:
+    uint8_t Byte(const uint16_t offset);
+    const uint8_t *CachedBlock(const uint8_t block);
+    uint8_t NewByte(const uint16_t offset);
+    bool MayChange(const uint16_t offset) const;
+
+    NXP_NTAG_I2C &_ntag;
+    NTAG_NDEFRecordInfo _records[NTAG_INDEX_MAX_RECORDS];
+    uint8_t _nb_records;
+    uint16_t _area_size;      //NDEF area size of the CC
+    uint16_t _tlv;            //NDEF TLV
+    uint8_t _tlv_length_size; //1, or 3 from 0xFF bytes on
+    uint16_t _message;        //first record
+    uint16_t _end;            //end of the NDEF message
+    bool _terminator;         //terminator TLV at _end
+    uint8_t _cache_block[2];  //blocks in _cache, 0 for none
+    uint8_t _cache[2][16];
+    uint8_t _cache_next;
+    uint8_t _blocks_written; //by the last Patch()
+
+    // Patch() in progress
+    const NTAG_NDEFRecordInfo *_patched;
+    uint16_t _start; //first payload byte replaced
+    const uint8_t *_data;
+    uint16_t _length;
+    int16_t _delta; //message length change
+    uint16_t _old_stop;
+    uint16_t _new_stop;
+};
+
+struct NTAG_ProvisionImage
+{
+    uint8_t data[NTAG_PROVISION_IMAGE_MAX];
+    uint16_t length;
+    uint8_t state;  //NTAG_Provisioner buffer state
+    uint8_t seq;    //sequence number of the IMAGE_END frame
+    uint8_t order;  //READY images are programmed in this order
+    uint8_t error;  //NTAG_PROVISION_TOO_LONG once data did not fit
+    unsigned long start_ms; //first IMAGE_DATA frame
+    uint16_t receive_ms;
+};
+
+class NTAG_Provisioner
+{
+  public:
+    NTAG_Provisioner(NXP_NTAG_I2C &ntag, Stream &port);
+
+    void Poll();
+    uint16_t Programmed() const { return _programmed; }
+
+  private:
+    static void ReceiveTask(void *context);
+    void Receive();
+    void Execute(const uint8_t type, const uint8_t *payload, const uint8_t length);
+    NTAG_ProvisionImage *Receiving(const bool start);
+    void Program(NTAG_ProvisionImage &image);
+    bool Verify(const NTAG_ProvisionImage &image);
+    void Respond(const uint8_t seq, const uint8_t status);
+    void SendStatus(const uint8_t seq, const uint8_t status, const uint16_t receive_ms, const uint16_t program_ms, const uint16_t verify_ms);
+
+    NXP_NTAG_I2C &_ntag;
+    Stream &_port;
+    NTAG_FrameReader _reader;
+    NTAG_ProvisionImage _images[2];
+    uint8_t _order;      //order of the next READY image
+    bool _dropped;       //IMAGE_DATA refused since the last IMAGE_END
+    uint16_t _programmed; //images programmed and verified
+};
+
+class NTAG_WifiCredential
+{
+  public:
+    NTAG_WifiCredential();
+
+    bool SetSSID(const char *ssid);
+    bool SetNetworkKey(const char *key);
+    void SetAuthentication(const uint16_t authentication) { _authentication = authentication; }
+    void SetEncryption(const uint16_t encryption) { _encryption = encryption; }
+    void SetMACAddress(const uint8_t *mac);
+    void SetVendorExtension(const uint8_t *data, const uint8_t length);
+    uint8_t Validate() const;
+
+    uint16_t CredentialLength() const;
+    uint16_t PayloadLength() const;
+    uint16_t TLVLength() const;
+    uint8_t BlockCount() const { return (TLVLength() + 15) / 16; }
+    size_t WriteTo(Print &out) const;
+
+  private:
+    const char *_ssid; //not copied, must outlive the encoder
+    const char *_key;
+    const uint8_t *_vendor; //NULL for the WFA Version2 default
+    uint8_t _ssid_length;
+    uint8_t _key_length;
+    uint8_t _vendor_length;
+    uint16_t _authentication;
+    uint16_t _encryption;
+    uint8_t _mac[6];
+};
+
+class NTAG_URIRecord
+{
+  public:
+    NTAG_URIRecord(const char *uri);
+    NTAG_URIRecord(const __FlashStringHelper *uri);
+
+    uint8_t PrefixCode() const { return _prefix_code; }
+    uint16_t PayloadLength() const { return 1 + _length; }
+    uint16_t TLVLength() const;
+    uint8_t BlockCount() const { return (TLVLength() + 15) / 16; }
+    size_t WriteTo(Print &out) const;
+
+  private:
+    void Abbreviate(const char *uri);
+    char UriChar(const uint16_t index) const;
+
+    const char *_uri; //remaining characters after the abbreviated prefix, not copied
+    uint16_t _length;
+    uint8_t _prefix_code;
+    bool _progmem;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,150 @@
+/**************************************************************************/
+/*!
+    @file     nfc_dynamic_tag_image.h
+    @author   AtoM
+	@license  BSD (see license.txt)
+
+Tag image format written by Snapshot() and programmed back by Restore().
+This header does not depend on Arduino so that it can be compiled on the
+host as well.
+
+	An image is (multi-byte values MSB first):
+
+		'N' 'T' 'I' 'M' | version | dynamic lock block | conf reg block |
+		image length (2) | static lock bytes (2) | CC (4) |
+		dynamic lock bytes (3) | configuration register (8) |
+		runs... | 0x00 | CRC16 (2)
+
+	A run is first block, number of blocks (1 to 255), then 16 bytes per
+	block. Runs are sorted and do not overlap; the user blocks no run covers
+	are all 0x00, which is how the usually empty tail of the user memory is
+	encoded. Bytes 8 to 15 of the dynamic lock block are always 0x00 in the
+	runs, the dynamic lock bytes have their own header field. The first
+	block of a run is never 0, so 0x00 ends the list.
+
+	The length covers the whole image, CRC included. The CRC is the
+	CRC-16/CCITT-FALSE of the frames (NTAG_FrameCRC16) computed over every
+	byte before it.
+*/
+/**************************************************************************/
+
+#ifndef NFC_DYNAMIC_TAG_IMAGE_H
+#define NFC_DYNAMIC_TAG_IMAGE_H
+
+#include <stdint.h>
+
+#include "nfc_dynamic_tag_frame.h"
+
+#define NTAG_IMAGE_VERSION 0x01
+#define NTAG_IMAGE_HEADER_LENGTH 26
+#define NTAG_IMAGE_RUN_HEADER_LENGTH 2
+#define NTAG_IMAGE_END 0x00
+#define NTAG_IMAGE_CRC_LENGTH 2
+#define NTAG_IMAGE_MIN_LENGTH (NTAG_IMAGE_HEADER_LENGTH + 1 + NTAG_IMAGE_CRC_LENGTH) //blank tag
+
+// Largest image of a memory map, one run every other block
+#define NTAG_IMAGE_MAX_LENGTH(dynamic_lock_block) \
+    (NTAG_IMAGE_MIN_LENGTH + (dynamic_lock_block) * 16 + ((dynamic_lock_block) + 1) / 2 * NTAG_IMAGE_RUN_HEADER_LENGTH)
+
+// Header offsets
+
+#define NTAG_IMAGE_OFFSET_VERSION 4
+#define NTAG_IMAGE_OFFSET_LOCK_BLOCK 5
+#define NTAG_IMAGE_OFFSET_CONF_BLOCK 6
+#define NTAG_IMAGE_OFFSET_LENGTH 7
+#define NTAG_IMAGE_OFFSET_STATIC_LOCK 9
+#define NTAG_IMAGE_OFFSET_CC 11
+#define NTAG_IMAGE_OFFSET_DYNAMIC_LOCK 15
+#define NTAG_IMAGE_OFFSET_CONF_REG 18
+
+// Snapshot / Restore status
+
+#define NTAG_IMAGE_OK 0
+#define NTAG_IMAGE_BAD_FORMAT 1 //magic, version, length or runs
+#define NTAG_IMAGE_BAD_CRC 2
+#define NTAG_IMAGE_WRONG_MAP 3  //image of the other chip variant
+#define NTAG_IMAGE_LOCKED 4     //a block to change is covered by a lock bit, nothing written
+
+static const uint8_t ntag_image_magic[4] = {'N', 'T', 'I', 'M'};
+
+struct NTAG_ImageRun
+{
+    uint8_t first_block;
+    uint8_t nb_blocks;
+    const uint8_t *data; //nb_blocks * 16 bytes
+};
+
+/**************************************************************************/
+/*! NTAG_ImageNextRun(const uint8_t *image, uint16_t &offset, NTAG_ImageRun &run)
+    @brief  Walk the runs of a checked image. offset starts at
+			NTAG_IMAGE_HEADER_LENGTH; return false at the end of the list
+    @param  image
+    @param  offset		Position of the next run, updated
+    @param  run			Next run
+*/
+/**************************************************************************/
+
+static inline bool NTAG_ImageNextRun(const uint8_t *image, uint16_t &offset, NTAG_ImageRun &run)
+{
+    if (image[offset] == NTAG_IMAGE_END)
+	return false;
+    run.first_block = image[offset];
+    run.nb_blocks = image[offset + 1];
+    run.data = &image[offset + NTAG_IMAGE_RUN_HEADER_LENGTH];
+    offset += NTAG_IMAGE_RUN_HEADER_LENGTH + (uint16_t)run.nb_blocks * 16;
+    return true;
+}
+
+/**************************************************************************/
+/*! NTAG_ImageCheck(const uint8_t *image, uint32_t length)
+    @brief  Check the header, the CRC and the runs of an image (sorted, in
+			the user memory, within the image) before it is used. Return
+			NTAG_IMAGE_OK, NTAG_IMAGE_BAD_FORMAT or NTAG_IMAGE_BAD_CRC
+    @param  image
+    @param  length		Bytes available at image
+*/
+/**************************************************************************/
+
+static inline uint8_t NTAG_ImageCheck(const uint8_t *image, uint32_t length)
+{
+    if (length < NTAG_IMAGE_MIN_LENGTH)
+	return NTAG_IMAGE_BAD_FORMAT;
+    for (uint8_t i = 0; i < 4; i++)
+    {
+	if (image[i] != ntag_image_magic[i])
+	    return NTAG_IMAGE_BAD_FORMAT;
+    }
+    uint16_t image_length = (uint16_t)image[NTAG_IMAGE_OFFSET_LENGTH] << 8 | image[NTAG_IMAGE_OFFSET_LENGTH + 1];
+    if (image[NTAG_IMAGE_OFFSET_VERSION] != NTAG_IMAGE_VERSION || image_length < NTAG_IMAGE_MIN_LENGTH || image_length > length)
+	return NTAG_IMAGE_BAD_FORMAT;
+
+    uint16_t crc = NTAG_FRAME_CRC_INIT;
+    uint16_t crc_offset = image_length - NTAG_IMAGE_CRC_LENGTH;
+    for (uint16_t i = 0; i < crc_offset; i++)
+    {
+	crc = NTAG_FrameCRC16(crc, image[i]);
+    }
+    if (crc != ((uint16_t)image[crc_offset] << 8 | image[crc_offset + 1]))
+	return NTAG_IMAGE_BAD_CRC;
+
+    uint8_t lock_block = image[NTAG_IMAGE_OFFSET_LOCK_BLOCK];
+    uint16_t next_block = 1;
+    uint16_t offset = NTAG_IMAGE_HEADER_LENGTH;
+    while (offset < crc_offset && image[offset] != NTAG_IMAGE_END)
+    {
+	if (offset + NTAG_IMAGE_RUN_HEADER_LENGTH > crc_offset)
+	    return NTAG_IMAGE_BAD_FORMAT;
+	uint8_t first_block = image[offset];
+	uint8_t nb_blocks = image[offset + 1];
+	if (first_block < next_block || nb_blocks == 0 || first_block + nb_blocks - 1 > lock_block ||
+	    offset + NTAG_IMAGE_RUN_HEADER_LENGTH + (uint32_t)nb_blocks * 16 > crc_offset)
+	    return NTAG_IMAGE_BAD_FORMAT;
+	next_block = first_block + nb_blocks;
+	offset += NTAG_IMAGE_RUN_HEADER_LENGTH + (uint16_t)nb_blocks * 16;
+    }
+    if (offset + 1 != crc_offset || image[offset] != NTAG_IMAGE_END)
+	return NTAG_IMAGE_BAD_FORMAT;
+    return NTAG_IMAGE_OK;
+}
+
+#endif
@@ -0,0 +1,136 @@
+/**************************************************************************/
+/*!
+    @file     nfc_dynamic_tag_map.h
+    @author   AtoM
+	@license  BSD (see license.txt)
+
+Memory maps of the NT3H1101 (1k) and NT3H1201 (2k) in I2C block addresses.
+This header does not depend on Arduino so that it can be compiled on the
+host as well.
+
+	Each chip variant is a trait of constexpr block addresses (NTAG_I2C_1K,
+	NTAG_I2C_2K). NTAG_I2C_Tag<Map> (nfc_dynamic_tag.h) is the driver bound
+	to one of them at compile time, its user memory loops take their bounds
+	from the trait; NXP_NTAG_I2C keeps a runtime copy (NTAG_I2C_MemoryMap)
+	detected from the capability container.
+
+	The I2C addressing is linear over the two RF sectors of the 2k part:
+	sector 1 follows sector 0 at block 0x40, there is no sector switch on
+	I2C.
+*/
+/**************************************************************************/
+
+#ifndef NFC_DYNAMIC_TAG_MAP_H
+#define NFC_DYNAMIC_TAG_MAP_H
+
+#include <stdint.h>
+
+// NTAG_I2C I2C Register addresses, NT3H1101 (1k) for the variant dependent ones
+
+#define NTAG_I2C_SERIAL_NB_BLOCK 0x00
+#define NTAG_I2C_USER_MEMORY_BLOCK 0x01  //first user memory block, last one being 0x38 (0x78 on 2k)
+#define NTAG_I2C_DYNAMIC_LOCK_BLOCK 0x38 //Dynamic Lock Bytes are bytes 8, 9 and 10; previous bytes are last user memory bytes
+#define NTAG_I2C_CONF_REG_BLOCK 0x3A
+#define NTAG_I2C_SRAM_BLOCK 0xF8
+#define NTAG_I2C_SRAM_BLOCKS 4
+#define NTAG_I2C_SESSION_REG_BLOCK 0xFE
+
+// NT3H1201 (2k)
+
+#define NTAG_I2C_2K_DYNAMIC_LOCK_BLOCK 0x78 //bytes 0-7 last user memory bytes, bytes 8-10 dynamic lock bytes
+#define NTAG_I2C_2K_CONF_REG_BLOCK 0x7A
+#define NTAG_I2C_1K_CC_SIZE 0x6D //CC byte 2 (NDEF area size / 8) written by NXP on the NT3H1101
+#define NTAG_I2C_2K_CC_SIZE 0xEA //and on the NT3H1201
+
+#define NTAG_I2C_MAP_MAX_BLOCKS 128 //EEPROM blocks of the largest variant, size of the write plan bitmap
+
+// Chip variants
+
+struct NTAG_I2C_1K
+{
+    static constexpr uint8_t user_memory_block = NTAG_I2C_USER_MEMORY_BLOCK;
+    static constexpr uint8_t dynamic_lock_block = NTAG_I2C_DYNAMIC_LOCK_BLOCK;
+    static constexpr uint8_t conf_reg_block = NTAG_I2C_CONF_REG_BLOCK;
+    static constexpr uint8_t sram_block = NTAG_I2C_SRAM_BLOCK;
+    static constexpr uint8_t session_reg_block = NTAG_I2C_SESSION_REG_BLOCK;
+    static constexpr uint8_t lock_bit_blocks = 4; //16 pages per dynamic lock bit
+    static constexpr uint8_t cc_size = NTAG_I2C_1K_CC_SIZE;
+    static constexpr uint16_t user_bytes = (dynamic_lock_block - user_memory_block) * 16 + 8;
+};
+
+struct NTAG_I2C_2K
+{
+    static constexpr uint8_t user_memory_block = NTAG_I2C_USER_MEMORY_BLOCK;
+    static constexpr uint8_t dynamic_lock_block = NTAG_I2C_2K_DYNAMIC_LOCK_BLOCK;
+    static constexpr uint8_t conf_reg_block = NTAG_I2C_2K_CONF_REG_BLOCK;
+    static constexpr uint8_t sram_block = NTAG_I2C_SRAM_BLOCK;
+    static constexpr uint8_t session_reg_block = NTAG_I2C_SESSION_REG_BLOCK;
+    static constexpr uint8_t lock_bit_blocks = 8; //32 pages per dynamic lock bit
+    static constexpr uint8_t cc_size = NTAG_I2C_2K_CC_SIZE;
+    static constexpr uint16_t user_bytes = (dynamic_lock_block - user_memory_block) * 16 + 8;
+};
+
+/**************************************************************************/
+/*! NTAG_I2C_MapValid<Map>()
+    @brief  Layout checks every variant must pass: the NDEF area announced
+			by the CC fits the user memory, the dynamic lock bits fit bytes 8
+			and 9 of their block, the configuration register follows the
+			user memory and the EEPROM fits the write plan bitmap
+*/
+/**************************************************************************/
+
+template <class Map>
+constexpr bool NTAG_I2C_MapValid()
+{
+    return Map::cc_size * 8 <= Map::user_bytes &&
+	   (Map::dynamic_lock_block - 4) / Map::lock_bit_blocks < 16 &&
+	   Map::dynamic_lock_block < Map::conf_reg_block &&
+	   Map::conf_reg_block < NTAG_I2C_MAP_MAX_BLOCKS &&
+	   Map::conf_reg_block < Map::sram_block;
+}
+
+static_assert(NTAG_I2C_MapValid<NTAG_I2C_1K>(), "NT3H1101 memory map");
+static_assert(NTAG_I2C_MapValid<NTAG_I2C_2K>(), "NT3H1201 memory map");
+
+/**************************************************************************/
+/*! NTAG_I2C_UserBlocks<Map>(uint8_t first_block, uint8_t nb_blocks)
+    @brief  True when the blocks are entirely user memory, i.e. can be
+			written as whole blocks without reaching the dynamic lock bytes
+    @param  first_block
+    @param  nb_blocks
+*/
+/**************************************************************************/
+
+template <class Map>
+constexpr bool NTAG_I2C_UserBlocks(const uint8_t first_block, const uint8_t nb_blocks)
+{
+    return nb_blocks > 0 && first_block >= Map::user_memory_block && first_block + nb_blocks <= Map::dynamic_lock_block;
+}
+
+// Runtime memory map, copied from one of the variants
+
+struct NTAG_I2C_MemoryMap
+{
+    uint8_t dynamic_lock_block; //last user memory block (bytes 0-7), dynamic lock bytes 8-10
+    uint8_t conf_reg_block;
+    uint8_t lock_bit_blocks; //blocks locked by one dynamic lock bit: 16 pages on 1k, 32 on 2k
+
+    uint16_t UserBytes() const { return (dynamic_lock_block - NTAG_I2C_USER_MEMORY_BLOCK) * 16 + 8; }
+};
+
+/**************************************************************************/
+/*! NTAG_I2C_BlockFromRFPage(const uint8_t sector, const uint8_t page)
+    @brief  I2C block holding a RF page (4 bytes); the 2k part has a second
+			RF sector mapped after the first one, e.g. sector 1 page 0xE8 is
+			the configuration register, block 0x7A
+    @param  sector		RF sector (0 or 1)
+    @param  page		RF page in the sector
+*/
+/**************************************************************************/
+
+static inline uint8_t NTAG_I2C_BlockFromRFPage(const uint8_t sector, const uint8_t page)
+{
+    return sector * 0x40 + page / 4;
+}
+
+#endif
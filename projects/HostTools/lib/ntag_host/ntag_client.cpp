@@ -0,0 +1,305 @@
+/**************************************************************************/
+/*!
+    @file     ntag_client.cpp
+    @author   AtoM
+	@license  BSD (see license.txt)
+
+*/
+/**************************************************************************/
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "ntag_client.h"
+
+// Largest frame that still fits in the Arduino receive buffer
+#define NTAG_CLIENT_BATCH_MAX (NTAG_FRAME_RX_WINDOW - NTAG_FRAME_HEADER_LENGTH - NTAG_FRAME_CRC_LENGTH)
+
+static long NowMs()
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec * 1000L + now.tv_usec / 1000;
+}
+
+/**************************************************************************/
+/*! NTAG_Client(int fd)
+    @brief  Instantiates a client on an open port (see NTAG_OpenPort)
+    @param  fd			Port file descriptor
+*/
+/**************************************************************************/
+
+NTAG_Client::NTAG_Client(int fd) : _fd(fd), _batching(true), _next_seq(0), _first_pending(0), _frames_sent(0), _bytes_sent(0)
+{
+    for (int i = 0; i < 256; i++)
+    {
+	_by_seq[i] = -1;
+    }
+}
+
+/**************************************************************************/
+/*! Queue...(...)
+    @brief  Queue one command, return a ticket for Status(). Output buffers
+			must stay valid until Flush() returns: 16 bytes per block for
+			reads, 8 bytes for the register reads, NTAG_FRAME_STATS_LENGTH
+			for the statistics of ntag_daemon.
+*/
+/**************************************************************************/
+
+int NTAG_Client::QueueRead(uint8_t first_block, uint8_t nb_blocks, uint8_t *out)
+{
+    uint8_t arguments[2] = {first_block, nb_blocks};
+    return Queue(NTAG_FRAME_CMD_READ, arguments, 2, out, nb_blocks * 16);
+}
+
+int NTAG_Client::QueueWrite(uint8_t first_block, const uint8_t *data, uint8_t nb_blocks)
+{
+    std::vector<uint8_t> arguments(1, first_block);
+    arguments.insert(arguments.end(), data, data + nb_blocks * 16);
+    return Queue(NTAG_FRAME_CMD_WRITE, &arguments[0], arguments.size(), NULL, 0);
+}
+
+int NTAG_Client::QueueErase(uint8_t first_block, uint8_t nb_blocks)
+{
+    uint8_t arguments[2] = {first_block, nb_blocks};
+    return Queue(NTAG_FRAME_CMD_ERASE, arguments, 2, NULL, 0);
+}
+
+int NTAG_Client::QueueReadSession(uint8_t *out)
+{
+    return Queue(NTAG_FRAME_CMD_READ_SESSION, NULL, 0, out, 8);
+}
+
+int NTAG_Client::QueueReadConfig(uint8_t *out)
+{
+    return Queue(NTAG_FRAME_CMD_READ_CONFIG, NULL, 0, out, 8);
+}
+
+int NTAG_Client::QueueWriteSession(uint8_t reg, uint8_t mask, uint8_t value)
+{
+    uint8_t arguments[3] = {reg, mask, value};
+    return Queue(NTAG_FRAME_CMD_WRITE_SESSION, arguments, 3, NULL, 0);
+}
+
+int NTAG_Client::QueueReadStats(uint8_t *out)
+{
+    return Queue(NTAG_FRAME_CMD_STATS, NULL, 0, out, NTAG_FRAME_STATS_LENGTH);
+}
+
+int NTAG_Client::Queue(uint8_t type, const uint8_t *arguments, size_t length, uint8_t *out, size_t out_length)
+{
+    Request request;
+
+    request.type = type;
+    if (length > 0)
+	request.arguments.assign(arguments, arguments + length);
+    request.out = out;
+    request.out_length = out_length;
+    request.status = NTAG_CLIENT_STATUS_PENDING;
+    _requests.push_back(request);
+    return (int)_requests.size() - 1;
+}
+
+/**************************************************************************/
+/*! Status(int ticket)
+    @brief  Status of a queued command: NTAG_STATUS_* once answered,
+			NTAG_CLIENT_STATUS_PENDING or NTAG_CLIENT_STATUS_TIMEOUT
+    @param  ticket		Value returned by Queue...()
+*/
+/**************************************************************************/
+
+uint8_t NTAG_Client::Status(int ticket) const
+{
+    if (ticket < 0 || ticket >= (int)_requests.size())
+	return NTAG_CLIENT_STATUS_TIMEOUT;
+    return _requests[ticket].status;
+}
+
+/**************************************************************************/
+/*! Clear()
+    @brief  Forget the commands answered by the last Flush(), so that a
+			long running client does not grow. Tickets start again from 0.
+*/
+/**************************************************************************/
+
+void NTAG_Client::Clear()
+{
+    _requests.erase(_requests.begin(), _requests.begin() + _first_pending);
+    _first_pending = 0;
+}
+
+void NTAG_Client::BuildFrame(std::vector<uint8_t> &frame, uint8_t type, const std::vector<uint8_t> &payload)
+{
+    uint16_t crc = NTAG_FrameCRC16(NTAG_FrameCRC16(NTAG_FRAME_CRC_INIT, type), (uint8_t)payload.size());
+
+    frame.clear();
+    frame.push_back(NTAG_FRAME_SOF);
+    frame.push_back(type);
+    frame.push_back((uint8_t)payload.size());
+    for (size_t i = 0; i < payload.size(); i++)
+    {
+	crc = NTAG_FrameCRC16(crc, payload[i]);
+	frame.push_back(payload[i]);
+    }
+    frame.push_back(crc >> 8);
+    frame.push_back(crc & 0xFF);
+}
+
+bool NTAG_Client::Send(const std::vector<uint8_t> &frame)
+{
+    size_t sent = 0;
+
+    while (sent < frame.size())
+    {
+	ssize_t count = write(_fd, &frame[sent], frame.size() - sent);
+	if (count < 0 && errno != EINTR)
+	    return false;
+	if (count > 0)
+	    sent += count;
+    }
+    _frames_sent++;
+    _bytes_sent += frame.size();
+    return true;
+}
+
+void NTAG_Client::HandleResponse(const NTAG_Frame &frame)
+{
+    if (frame.type != NTAG_FRAME_RESPONSE || frame.length < 2)
+	return;
+
+    uint8_t seq = frame.payload[0];
+    int index = _by_seq[seq];
+    if (index >= 0)
+    {
+	Request &request = _requests[index];
+	size_t length = frame.length - 2;
+	if (length > request.out_length)
+	    length = request.out_length;
+	if (request.out != NULL)
+	    memcpy(request.out, &frame.payload[2], length);
+	request.status = frame.payload[1];
+	_by_seq[seq] = -1;
+    }
+    if (!_in_flight.empty() && _in_flight.front().last_seq == seq)
+	_in_flight.pop_front();
+}
+
+/**************************************************************************/
+/*! Flush(int timeout_ms)
+    @brief  Send every queued command and wait for all the responses.
+			Return true when all of them answered NTAG_STATUS_OK.
+    @param  timeout_ms	Time allowed without any progress
+*/
+/**************************************************************************/
+
+bool NTAG_Client::Flush(int timeout_ms)
+{
+    std::vector<uint8_t> payload;
+    std::vector<uint8_t> frame;
+    size_t next = _first_pending;
+    long deadline = NowMs() + timeout_ms;
+
+    while (next < _requests.size() || !_in_flight.empty())
+    {
+	// Build the next frame: a single command or a batch of small ones
+	if (next < _requests.size() && frame.empty())
+	{
+	    size_t end = next;
+	    size_t batch_length = 1;
+	    while (_batching && end < _requests.size() &&
+		   batch_length + 3 + _requests[end].arguments.size() <= NTAG_CLIENT_BATCH_MAX)
+	    {
+		batch_length += 3 + _requests[end].arguments.size();
+		end++;
+	    }
+
+	    payload.clear();
+	    if (end - next > 1)
+	    {
+		uint8_t batch_seq = _next_seq++;
+		payload.push_back(batch_seq);
+		for (; next < end; next++)
+		{
+		    Request &request = _requests[next];
+		    uint8_t seq = _next_seq++;
+		    _by_seq[seq] = (int)next;
+		    payload.push_back(request.type);
+		    payload.push_back((uint8_t)(1 + request.arguments.size()));
+		    payload.push_back(seq);
+		    payload.insert(payload.end(), request.arguments.begin(), request.arguments.end());
+		}
+		BuildFrame(frame, NTAG_FRAME_CMD_BATCH, payload);
+		_in_flight.push_back(InFlight());
+		_in_flight.back().last_seq = batch_seq;
+	    }
+	    else
+	    {
+		Request &request = _requests[next];
+		uint8_t seq = _next_seq++;
+		_by_seq[seq] = (int)next;
+		payload.push_back(seq);
+		payload.insert(payload.end(), request.arguments.begin(), request.arguments.end());
+		BuildFrame(frame, request.type, payload);
+		_in_flight.push_back(InFlight());
+		_in_flight.back().last_seq = seq;
+		next++;
+	    }
+	    _in_flight.back().size = frame.size();
+	}
+
+	// Send it when the frames waiting behind the executing one fit
+	if (!frame.empty())
+	{
+	    size_t queued = 0;
+	    for (size_t i = 1; i + 1 < _in_flight.size(); i++)
+	    {
+		queued += _in_flight[i].size;
+	    }
+	    if (_in_flight.size() == 1 || queued + frame.size() <= NTAG_FRAME_RX_WINDOW)
+	    {
+		if (!Send(frame))
+		    break;
+		frame.clear();
+		continue;
+	    }
+	}
+
+	// Collect responses
+	struct pollfd fds;
+	fds.fd = _fd;
+	fds.events = POLLIN;
+	long remaining = deadline - NowMs();
+	if (remaining <= 0 || poll(&fds, 1, (int)remaining) <= 0)
+	    break;
+
+	uint8_t buffer[256];
+	ssize_t count = read(_fd, buffer, sizeof(buffer));
+	if (count <= 0)
+	    break;
+	_parser.Feed(buffer, count);
+	NTAG_Frame response;
+	while (_parser.Next(response))
+	{
+	    HandleResponse(response);
+	}
+	deadline = NowMs() + timeout_ms;
+    }
+
+    bool ok = true;
+    for (size_t i = _first_pending; i < _requests.size(); i++)
+    {
+	if (_requests[i].status == NTAG_CLIENT_STATUS_PENDING)
+	    _requests[i].status = NTAG_CLIENT_STATUS_TIMEOUT;
+	ok = ok && _requests[i].status == NTAG_STATUS_OK;
+    }
+    for (int i = 0; i < 256; i++)
+    {
+	_by_seq[i] = -1;
+    }
+    _in_flight.clear();
+    _first_pending = _requests.size();
+    return ok;
+}
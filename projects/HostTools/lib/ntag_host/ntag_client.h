@@ -0,0 +1,89 @@
+/**************************************************************************/
+/*!
+    @file     ntag_client.h
+    @author   AtoM
+	@license  BSD (see license.txt)
+
+Host side driver for NTAG_CommandServer. Requests are queued, then Flush()
+packs consecutive small requests into CMD_BATCH frames and pipelines the
+frames: a new frame is sent as soon as the frames queued behind the one
+being executed by the Arduino fit in its receive buffer, without waiting
+for the previous responses.
+
+	NTAG_Client client(fd);
+	client.QueueRead(0x01, 4, blocks);
+	client.QueueReadSession(session);
+	client.Flush();
+
+*/
+/**************************************************************************/
+
+#ifndef NTAG_CLIENT_H
+#define NTAG_CLIENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <vector>
+
+#include "ntag_frame_parser.h"
+
+#define NTAG_CLIENT_TIMEOUT_MS 2000
+#define NTAG_CLIENT_STATUS_PENDING 0xFE
+#define NTAG_CLIENT_STATUS_TIMEOUT 0xFF
+
+class NTAG_Client
+{
+  public:
+    NTAG_Client(int fd);
+
+    int QueueRead(uint8_t first_block, uint8_t nb_blocks, uint8_t *out);
+    int QueueWrite(uint8_t first_block, const uint8_t *data, uint8_t nb_blocks);
+    int QueueErase(uint8_t first_block, uint8_t nb_blocks);
+    int QueueReadSession(uint8_t *out);
+    int QueueReadConfig(uint8_t *out);
+    int QueueWriteSession(uint8_t reg, uint8_t mask, uint8_t value);
+    int QueueReadStats(uint8_t *out);
+
+    bool Flush(int timeout_ms = NTAG_CLIENT_TIMEOUT_MS);
+    uint8_t Status(int ticket) const;
+    void Clear();
+    void SetBatching(bool enabled) { _batching = enabled; }
+
+    unsigned long FramesSent() const { return _frames_sent; }
+    unsigned long BytesSent() const { return _bytes_sent; }
+
+  private:
+    struct Request
+    {
+	uint8_t type;
+	std::vector<uint8_t> arguments;
+	uint8_t *out;
+	size_t out_length;
+	uint8_t status;
+    };
+
+    struct InFlight
+    {
+	size_t size;
+	uint8_t last_seq;
+    };
+
+    int Queue(uint8_t type, const uint8_t *arguments, size_t length, uint8_t *out, size_t out_length);
+    void BuildFrame(std::vector<uint8_t> &frame, uint8_t type, const std::vector<uint8_t> &payload);
+    bool Send(const std::vector<uint8_t> &frame);
+    void HandleResponse(const NTAG_Frame &frame);
+
+    int _fd;
+    bool _batching;
+    uint8_t _next_seq;
+    std::vector<Request> _requests;
+    size_t _first_pending;
+    int _by_seq[256];
+    std::deque<InFlight> _in_flight;
+    NTAG_FrameParser _parser;
+    unsigned long _frames_sent;
+    unsigned long _bytes_sent;
+};
+
+#endif
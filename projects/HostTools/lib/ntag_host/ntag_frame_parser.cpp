@@ -0,0 +1,94 @@
+/**************************************************************************/
+/*!
+    @file     ntag_frame_parser.cpp
+    @author   AtoM
+	@license  BSD (see license.txt)
+
+*/
+/**************************************************************************/
+
+#include <string.h>
+
+#include "ntag_frame_parser.h"
+
+/**************************************************************************/
+/*! NTAG_FrameParser()
+    @brief  Instantiates an empty frame receiver
+*/
+/**************************************************************************/
+
+NTAG_FrameParser::NTAG_FrameParser() : _start(0), _crc_errors(0), _skipped_bytes(0)
+{
+}
+
+/**************************************************************************/
+/*! Feed(const uint8_t *data, size_t length)
+    @brief  Append received bytes, call Next() until it returns false to get
+			the frames they complete
+    @param  data
+    @param  length
+*/
+/**************************************************************************/
+
+void NTAG_FrameParser::Feed(const uint8_t *data, size_t length)
+{
+    _pending.insert(_pending.end(), data, data + length);
+}
+
+/**************************************************************************/
+/*! Next(NTAG_Frame &frame)
+    @brief  Extract the next complete frame. A SOF followed by a bad CRC is
+			counted as an error and the search restarts on the byte after it,
+			so a frame hidden behind a false start is not lost.
+    @param  frame		Output frame
+*/
+/**************************************************************************/
+
+bool NTAG_FrameParser::Next(NTAG_Frame &frame)
+{
+    while (_start < _pending.size())
+    {
+	if (_pending[_start] != NTAG_FRAME_SOF)
+	{
+	    _start++;
+	    _skipped_bytes++;
+	    continue;
+	}
+	if (_pending.size() - _start < NTAG_FRAME_HEADER_LENGTH)
+	    break;
+
+	const uint8_t *header = &_pending[_start];
+	size_t payload_end = NTAG_FRAME_HEADER_LENGTH + header[2];
+	size_t frame_length = payload_end + NTAG_FRAME_CRC_LENGTH;
+	if (_pending.size() - _start < frame_length)
+	    break;
+
+	uint16_t crc = NTAG_FRAME_CRC_INIT;
+	for (size_t i = 1; i < payload_end; i++)
+	{
+	    crc = NTAG_FrameCRC16(crc, header[i]);
+	}
+	const uint8_t *crc_bytes = &header[payload_end];
+	if (crc_bytes[0] != (crc >> 8) || crc_bytes[1] != (crc & 0xFF))
+	{
+	    _crc_errors++;
+	    _skipped_bytes++;
+	    _start++;
+	    continue;
+	}
+
+	frame.type = header[1];
+	frame.length = header[2];
+	memcpy(frame.payload, &header[NTAG_FRAME_HEADER_LENGTH], frame.length);
+	_start += frame_length;
+	return true;
+    }
+
+    // Keep the unconsumed tail only
+    if (_start > 0)
+    {
+	_pending.erase(_pending.begin(), _pending.begin() + _start);
+	_start = 0;
+    }
+    return false;
+}
@@ -0,0 +1,49 @@
+/**************************************************************************/
+/*!
+    @file     ntag_frame_parser.h
+    @author   AtoM
+	@license  BSD (see license.txt)
+
+Host side receiver for the frames described in nfc_dynamic_tag_frame.h.
+Bytes are fed as they come from the serial port, complete frames with a
+valid CRC are returned by Next(). Anything between frames (menu text,
+line noise) is skipped.
+
+*/
+/**************************************************************************/
+
+#ifndef NTAG_FRAME_PARSER_H
+#define NTAG_FRAME_PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "nfc_dynamic_tag_frame.h"
+
+struct NTAG_Frame
+{
+    uint8_t type;
+    uint8_t length;
+    uint8_t payload[NTAG_FRAME_MAX_PAYLOAD];
+};
+
+class NTAG_FrameParser
+{
+  public:
+    NTAG_FrameParser();
+
+    void Feed(const uint8_t *data, size_t length);
+    bool Next(NTAG_Frame &frame);
+
+    unsigned long CrcErrors() const { return _crc_errors; }
+    unsigned long SkippedBytes() const { return _skipped_bytes; }
+
+  private:
+    std::vector<uint8_t> _pending;
+    size_t _start;
+    unsigned long _crc_errors;
+    unsigned long _skipped_bytes;
+};
+
+#endif
@@ -0,0 +1,77 @@
+/**************************************************************************/
+/*!
+    @file     ntag_host_port.cpp
+    @author   AtoM
+	@license  BSD (see license.txt)
+
+*/
+/**************************************************************************/
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "ntag_host_port.h"
+
+/**************************************************************************/
+/*! NTAG_OpenPort(const char *path)
+    @brief  Open a serial device, a file, stdin ("-") or a Unix socket
+			(ntag_daemon) for reading and writing. Serial devices are
+			switched to raw 8N1 at NTAG_HOST_BAUDRATE. Return the file
+			descriptor or -1.
+    @param  path
+*/
+/**************************************************************************/
+
+int NTAG_OpenPort(const char *path)
+{
+    if (strcmp(path, "-") == 0)
+	return STDIN_FILENO;
+
+    struct stat info;
+    if (stat(path, &info) == 0 && S_ISSOCK(info.st_mode))
+    {
+	struct sockaddr_un address;
+	if (strlen(path) >= sizeof(address.sun_path))
+	    return -1;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd >= 0 && connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+	{
+	    close(fd);
+	    fd = -1;
+	}
+	return fd;
+    }
+
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0)
+	fd = open(path, O_RDONLY);
+    if (fd < 0 || !isatty(fd))
+	return fd;
+
+    struct termios tty;
+    if (tcgetattr(fd, &tty) != 0)
+    {
+	close(fd);
+	return -1;
+    }
+    cfmakeraw(&tty);
+    cfsetispeed(&tty, B115200);
+    cfsetospeed(&tty, B115200);
+    tty.c_cflag |= CLOCAL | CREAD;
+    tty.c_cc[VMIN] = 1;
+    tty.c_cc[VTIME] = 0;
+    if (tcsetattr(fd, TCSANOW, &tty) != 0)
+    {
+	close(fd);
+	return -1;
+    }
+    return fd;
+}
@@ -0,0 +1,21 @@
+/**************************************************************************/
+/*!
+    @file     ntag_host_port.h
+    @author   AtoM
+	@license  BSD (see license.txt)
+
+Opens the byte stream coming from the Arduino: a serial device (configured
+raw at 115200 bauds like the sketches), a capture file, stdin for "-", or
+the Unix socket of ntag_daemon.
+
+*/
+/**************************************************************************/
+
+#ifndef NTAG_HOST_PORT_H
+#define NTAG_HOST_PORT_H
+
+#define NTAG_HOST_BAUDRATE 115200
+
+int NTAG_OpenPort(const char *path);
+
+#endif
@@ -0,0 +1,122 @@
+/**************************************************************************/
+/*!
+    @file     Arduino.h
+    @author   AtoM
+	@license  BSD (see license.txt)
+
+Host replacement of the Arduino core, just what the library uses, so that
+NXP_NTAG_I2C runs unchanged against the simulated tag (ntag_sim_tag.h).
+Time is simulated: millis() and micros() read the simulation clock and
+delay() advances it, as do the I2C transfers (Wire.h).
+
+*/
+/**************************************************************************/
+
+#ifndef NTAG_SIM_ARDUINO_H
+#define NTAG_SIM_ARDUINO_H
+
+#include <ctype.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARDUINO 100
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+// Flash is ordinary memory on the host
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define pgm_read_ptr(p) (*(void *const *)(p))
+#define memcpy_P memcpy
+#define strlen_P strlen
+
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+
+#define DEC 10
+#define HEX 16
+
+// Simulation clock, in microseconds
+
+uint64_t NTAG_SimMicros();
+void NTAG_SimAdvance(const uint64_t us);
+void NTAG_SimRewind(const uint64_t us);
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+class Print
+{
+  public:
+    Print() : _write_error(0) {}
+    virtual ~Print() {}
+
+    virtual size_t write(uint8_t value) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    size_t write(const char *text) { return text == NULL ? 0 : write((const uint8_t *)text, strlen(text)); }
+
+    size_t print(const __FlashStringHelper *text) { return write((const char *)text); }
+    size_t print(const char *text) { return write(text); }
+    size_t print(char value) { return write((uint8_t)value); }
+    size_t print(unsigned char value, int base = DEC) { return print((unsigned long)value, base); }
+    size_t print(int value, int base = DEC) { return print((long)value, base); }
+    size_t print(unsigned int value, int base = DEC) { return print((unsigned long)value, base); }
+    size_t print(long value, int base = DEC);
+    size_t print(unsigned long value, int base = DEC);
+
+    size_t println() { return write("\r\n"); }
+    template <class T>
+    size_t println(const T &value) { return print(value) + println(); }
+    template <class T>
+    size_t println(const T &value, int base) { return print(value, base) + println(); }
+
+    int getWriteError() { return _write_error; }
+    void clearWriteError() { _write_error = 0; }
+
+  protected:
+    void setWriteError(int error = 1) { _write_error = error; }
+
+  private:
+    int _write_error;
+};
+
+class Stream : public Print
+{
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+
+// Serial goes to stdout, or to the file given to SetOutput() (NULL discards), nothing is ever received
+
+class HardwareSerial : public Stream
+{
+  public:
+    HardwareSerial() : _output(stdout) {}
+
+    void begin(unsigned long baudrate) { (void)baudrate; }
+    void SetOutput(FILE *output) { _output = output; }
+    size_t write(uint8_t value);
+    size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+    int available() { return 0; }
+    int read() { return -1; }
+    int peek() { return -1; }
+
+  private:
+    FILE *_output;
+};
+
+extern HardwareSerial Serial;
+
+#endif
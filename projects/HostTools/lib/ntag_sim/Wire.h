@@ -0,0 +1,64 @@
+/**************************************************************************/
+/*!
+    @file     Wire.h
+    @author   AtoM
+	@license  BSD (see license.txt)
+
+Host replacement of the Arduino Wire library: the transfers go to the
+simulated tag attached with Attach(), and each one advances the
+simulation clock by its duration on the bus (9 clock periods per byte,
+address byte included, plus start and stop).
+
+*/
+/**************************************************************************/
+
+#ifndef NTAG_SIM_WIRE_H
+#define NTAG_SIM_WIRE_H
+
+#include "Arduino.h"
+
+#define NTAG_SIM_I2C_BUFFER 32 //same as the AVR Wire library
+#define NTAG_SIM_I2C_CLOCK 100000
+
+class NTAG_SimTag;
+
+class TwoWire : public Stream
+{
+  public:
+    TwoWire();
+
+    void Attach(NTAG_SimTag *tag) { _tag = tag; }
+
+    void begin() {}
+    void setClock(uint32_t clock) { _clock = clock; }
+    uint32_t Clock() const { return _clock; }
+
+    void beginTransmission(uint8_t address);
+    void beginTransmission(int address) { beginTransmission((uint8_t)address); }
+    uint8_t endTransmission(uint8_t stop = true);
+    uint8_t requestFrom(uint32_t address, uint32_t quantity, uint32_t stop = true);
+
+    size_t write(uint8_t value);
+    size_t write(const uint8_t *buffer, size_t size);
+    size_t write(int value) { return write((uint8_t)value); }
+    using Print::write;
+    int available() { return _rx_length - _rx_index; }
+    int read() { return _rx_index < _rx_length ? _rx_buffer[_rx_index++] : -1; }
+    int peek() { return _rx_index < _rx_length ? _rx_buffer[_rx_index] : -1; }
+
+  private:
+    void BusTime(const uint8_t nb_bytes);
+
+    NTAG_SimTag *_tag;
+    uint32_t _clock;
+    uint8_t _address;
+    uint8_t _tx_buffer[NTAG_SIM_I2C_BUFFER];
+    uint8_t _tx_length;
+    uint8_t _rx_buffer[NTAG_SIM_I2C_BUFFER];
+    uint8_t _rx_length;
+    uint8_t _rx_index;
+};
+
+extern TwoWire Wire;
+
+#endif
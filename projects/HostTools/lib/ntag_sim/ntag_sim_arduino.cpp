@@ -0,0 +1,227 @@
+/**************************************************************************/
+/*!
+    @file     ntag_sim_arduino.cpp
+    @author   AtoM
+	@license  BSD (see license.txt)
+
+Simulation clock, Print, Serial and Wire of the host Arduino shim.
+
+*/
+/**************************************************************************/
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "ntag_sim_tag.h"
+#include "ntag_sim_trace.h"
+
+static uint64_t sim_us = 0;
+
+uint64_t NTAG_SimMicros()
+{
+    return sim_us;
+}
+
+void NTAG_SimAdvance(const uint64_t us)
+{
+    sim_us += us;
+}
+
+void NTAG_SimRewind(const uint64_t us)
+{
+    if (us < sim_us)
+	sim_us = us;
+}
+
+unsigned long millis()
+{
+    return (unsigned long)(sim_us / 1000);
+}
+
+unsigned long micros()
+{
+    return (unsigned long)sim_us;
+}
+
+static void Wait(const uint32_t us)
+{
+    sim_us += us;
+    if (NTAG_SimTracing() != NULL)
+    {
+	NTAG_SimEvent event = {NTAG_SIM_EVENT_WAIT, 0, 0, 0, 0, us};
+	NTAG_SimTracing()->Add(event);
+    }
+}
+
+void delay(unsigned long ms)
+{
+    Wait(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    Wait(us);
+}
+
+/**************************************************************************/
+/*      Print, Serial                                                     */
+/**************************************************************************/
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+    size_t written = 0;
+    while (size--)
+    {
+	written += write(*buffer++);
+    }
+    return written;
+}
+
+size_t Print::print(unsigned long value, int base)
+{
+    char text[8 * sizeof(long) + 1];
+    char *digit = &text[sizeof(text) - 1];
+
+    *digit = '\0';
+    if (base < 2)
+	base = 10;
+    do
+    {
+	uint8_t remainder = value % base;
+	*--digit = remainder < 10 ? '0' + remainder : 'A' + remainder - 10;
+	value /= base;
+    } while (value);
+    return write(digit);
+}
+
+size_t Print::print(long value, int base)
+{
+    if (base == DEC && value < 0)
+	return print('-') + print((unsigned long)-value, base);
+    return print((unsigned long)value, base);
+}
+
+HardwareSerial Serial;
+
+size_t HardwareSerial::write(uint8_t value)
+{
+    if (_output == NULL)
+	return 1;
+    return fputc(value, _output) == EOF ? 0 : 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+    if (_output == NULL)
+	return size;
+    return fwrite(buffer, 1, size, _output);
+}
+
+/**************************************************************************/
+/*      Wire                                                              */
+/**************************************************************************/
+
+TwoWire Wire;
+
+TwoWire::TwoWire() : _tag(NULL), _clock(NTAG_SIM_I2C_CLOCK), _address(0), _tx_length(0), _rx_length(0), _rx_index(0)
+{
+}
+
+/**************************************************************************/
+/*! BusTime(const uint8_t nb_bytes)
+    @brief  Advance the clock by one transfer: start, address byte, data
+			bytes (8 bits and ACK each), stop
+    @param  nb_bytes	Data bytes
+*/
+/**************************************************************************/
+
+void TwoWire::BusTime(const uint8_t nb_bytes)
+{
+    uint64_t clocks = (uint64_t)(nb_bytes + 1) * 9 + 2;
+    sim_us += (clocks * 1000000 + _clock - 1) / _clock;
+}
+
+void TwoWire::beginTransmission(uint8_t address)
+{
+    _address = address;
+    _tx_length = 0;
+}
+
+size_t TwoWire::write(uint8_t value)
+{
+    if (_tx_length >= NTAG_SIM_I2C_BUFFER)
+    {
+	setWriteError();
+	return 0;
+    }
+    _tx_buffer[_tx_length++] = value;
+    return 1;
+}
+
+size_t TwoWire::write(const uint8_t *buffer, size_t size)
+{
+    size_t written = 0;
+    while (written < size && write(buffer[written]))
+    {
+	written++;
+    }
+    return written;
+}
+
+/**************************************************************************/
+/*! endTransmission(uint8_t stop)
+    @brief  Send the buffered bytes. Return 0 on success, 2 when the
+			address is not acknowledged, 3 when data is not
+    @param  stop
+*/
+/**************************************************************************/
+
+uint8_t TwoWire::endTransmission(uint8_t stop)
+{
+    (void)stop;
+    uint8_t length = _tx_length;
+    uint64_t start = sim_us;
+    uint8_t status = 2;
+
+    _tx_length = 0;
+    if (_tag == NULL || _address != _tag->Address())
+    {
+	BusTime(0);
+    }
+    else
+    {
+	BusTime(length);
+	status = _tag->I2CWrite(_tx_buffer, length) ? 0 : 3;
+    }
+    if (NTAG_SimTracing() != NULL)
+    {
+	NTAG_SimEvent event = {NTAG_SIM_EVENT_WRITE, _address, length > 0 ? _tx_buffer[0] : (uint8_t)0, length, status, (uint32_t)(sim_us - start)};
+	NTAG_SimTracing()->Add(event);
+    }
+    return status;
+}
+
+uint8_t TwoWire::requestFrom(uint32_t address, uint32_t quantity, uint32_t stop)
+{
+    (void)stop;
+    uint64_t start = sim_us;
+
+    if (quantity > NTAG_SIM_I2C_BUFFER)
+	quantity = NTAG_SIM_I2C_BUFFER;
+    _rx_index = 0;
+    _rx_length = 0;
+    if (_tag == NULL || address != _tag->Address())
+    {
+	BusTime(0);
+    }
+    else
+    {
+	BusTime(quantity); //the tag takes the access at the end of the transfer
+	_rx_length = _tag->I2CRead(_rx_buffer, (uint8_t)quantity);
+    }
+    if (NTAG_SimTracing() != NULL)
+    {
+	NTAG_SimEvent event = {NTAG_SIM_EVENT_READ, (uint8_t)address, 0, (uint8_t)quantity, _rx_length, (uint32_t)(sim_us - start)};
+	NTAG_SimTracing()->Add(event);
+    }
+    return _rx_length;
+}
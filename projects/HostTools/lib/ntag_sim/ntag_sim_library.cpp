@@ -0,0 +1,13 @@
+/**************************************************************************/
+/*!
+    @file     ntag_sim_library.cpp
+    @author   AtoM
+	@license  BSD (see license.txt)
+
+The Arduino library (library/nfc_dynamic_tag.cpp) built unchanged against
+the Arduino.h and Wire.h shims of this directory.
+
+*/
+/**************************************************************************/
+
+#include "nfc_dynamic_tag.cpp"
@@ -0,0 +1,310 @@
+/**************************************************************************/
+/*!
+    @file     ntag_sim_reader.cpp
+    @author   AtoM
+	@license  BSD (see license.txt)
+
+*/
+/**************************************************************************/
+
+#include <string.h>
+
+#include "Arduino.h"
+#include "nfc_dynamic_tag.h"
+#include "ntag_sim_reader.h"
+
+#define FRAME_BITS(nb_bytes) ((uint32_t)(nb_bytes) * 9 + 2) //start and end of frame, parity bit per byte
+#define ACK_BITS 6					    //4-bit ACK/NAK, start and end of frame
+#define CRC_BYTES 2
+#define NDEF_AREA_BYTES (NTAG_I2C_MAP_MAX_BLOCKS * 16)
+
+/**************************************************************************/
+/*! Reader()
+    @brief  Dedicated reader (PN5180/CLRC663 class): short turnaround, large
+			FAST_READ frames
+*/
+/**************************************************************************/
+
+NTAG_SimTiming NTAG_SimTiming::Reader()
+{
+    NTAG_SimTiming timing = {"reader", 128.0 / 13.56, 86.0, 5100, 150, 1000, 20, 64};
+    return timing;
+}
+
+/**************************************************************************/
+/*! Phone()
+    @brief  Phone NFC stack: each command is a round trip through the NFC
+			service (about 1.5 ms), READ only, few retries
+*/
+/**************************************************************************/
+
+NTAG_SimTiming NTAG_SimTiming::Phone()
+{
+    NTAG_SimTiming timing = {"phone", 128.0 / 13.56, 86.0, 5100, 1500, 5000, 5, 0};
+    return timing;
+}
+
+NTAG_SimReader::NTAG_SimReader(NTAG_SimTag &tag, const NTAG_SimTiming &timing)
+    : _tag(tag), _timing(timing), _task(NULL), _context(NULL), _period_us(0), _next_task(0)
+{
+    ResetStats();
+}
+
+void NTAG_SimReader::ResetStats()
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+/**************************************************************************/
+/*! SetBackground(void (*task)(void *), void *context, const uint32_t period_us)
+    @brief  Task run every period_us of reader waits, NULL for none
+    @param  task
+    @param  context		Passed to task
+    @param  period_us
+*/
+/**************************************************************************/
+
+void NTAG_SimReader::SetBackground(void (*task)(void *), void *context, const uint32_t period_us)
+{
+    _task = task;
+    _context = context;
+    _period_us = period_us > 0 ? period_us : 1;
+    _next_task = NTAG_SimMicros();
+}
+
+/**************************************************************************/
+/*! Wait(const uint64_t us)
+    @brief  Advance the clock, running the background task when it is due.
+			The task takes effect at once but its duration is not added to
+			the wait, the next run is due when it would have finished
+    @param  us
+*/
+/**************************************************************************/
+
+void NTAG_SimReader::Wait(const uint64_t us)
+{
+    uint64_t end = NTAG_SimMicros() + us;
+
+    while (_task != NULL && _next_task <= end)
+    {
+	if (_next_task > NTAG_SimMicros())
+	    NTAG_SimAdvance(_next_task - NTAG_SimMicros());
+	uint64_t start = NTAG_SimMicros();
+	_task(_context);
+	uint64_t finish = NTAG_SimMicros();
+	NTAG_SimRewind(start); //the MCU runs beside the reader, which is not delayed
+	_next_task += _period_us;
+	if (_next_task < finish)
+	    _next_task = finish;
+    }
+    if (end > NTAG_SimMicros())
+	NTAG_SimAdvance(end - NTAG_SimMicros());
+}
+
+void NTAG_SimReader::OnAir(const uint32_t nb_bits)
+{
+    NTAG_SimAdvance((uint64_t)(nb_bits * _timing.bit_us + 0.5));
+}
+
+/**************************************************************************/
+/*! Activate()
+    @brief  Field on, REQA and the two cascade levels of the 7-byte UID
+			(ANTICOLLISION and SELECT each)
+*/
+/**************************************************************************/
+
+bool NTAG_SimReader::Activate()
+{
+    _tag.SetField(true);
+    Wait(_timing.guard_us);
+    OnAir(7 + 2); //REQA, short frame
+    NTAG_SimAdvance((uint64_t)_timing.fdt_us);
+    OnAir(FRAME_BITS(2)); //ATQA
+    for (uint8_t level = 0; level < 2; level++)
+    {
+	Wait(_timing.command_overhead_us);
+	OnAir(FRAME_BITS(2)); //ANTICOLLISION
+	NTAG_SimAdvance((uint64_t)_timing.fdt_us);
+	OnAir(FRAME_BITS(5)); //UID CLn and BCC
+	Wait(_timing.command_overhead_us);
+	OnAir(FRAME_BITS(7 + CRC_BYTES)); //SELECT
+	NTAG_SimAdvance((uint64_t)_timing.fdt_us);
+	OnAir(FRAME_BITS(1 + CRC_BYTES)); //SAK
+    }
+    return _tag.Field();
+}
+
+void NTAG_SimReader::Release()
+{
+    _tag.SetField(false);
+}
+
+/**************************************************************************/
+/*! Command(const uint8_t command, const uint8_t page, uint8_t *data, const uint8_t nb_pages)
+    @brief  One READ, FAST_READ or WRITE exchange, repeated while NAKed
+			because of the I2C lock
+    @param  command		NTAG_SIM_CMD_*
+    @param  page		First page
+    @param  data		Pages read (nb_pages * 4 bytes) or page to write
+    @param  nb_pages
+*/
+/**************************************************************************/
+
+uint8_t NTAG_SimReader::Command(const uint8_t command, const uint8_t page, uint8_t *data, const uint8_t nb_pages)
+{
+    uint8_t tx_bytes = command == NTAG_SIM_CMD_WRITE ? 6 : (command == NTAG_SIM_CMD_FAST_READ ? 3 : 2);
+
+    for (uint8_t attempt = 0;; attempt++)
+    {
+	uint32_t program_us = 0;
+	uint8_t answer;
+
+	Wait(_timing.command_overhead_us);
+	OnAir(FRAME_BITS(tx_bytes + CRC_BYTES));
+	if (command == NTAG_SIM_CMD_WRITE)
+	    answer = _tag.RFWrite(page, data, program_us);
+	else
+	    answer = _tag.RFRead(page, data, nb_pages);
+	_stats.commands++;
+	NTAG_SimAdvance((uint64_t)_timing.fdt_us);
+
+	if (answer == NTAG_SIM_ACK)
+	{
+	    if (command == NTAG_SIM_CMD_WRITE)
+	    {
+		Wait(program_us);
+		OnAir(ACK_BITS);
+	    }
+	    else
+	    {
+		OnAir(FRAME_BITS(nb_pages * 4 + CRC_BYTES));
+	    }
+	    return answer;
+	}
+	if (answer == NTAG_SIM_NO_ANSWER)
+	{
+	    _stats.failures++;
+	    return answer;
+	}
+	OnAir(ACK_BITS);
+	_stats.naks++;
+	if (answer != NTAG_SIM_NAK_LOCKED || attempt >= _timing.max_retries)
+	{
+	    _stats.failures++;
+	    return answer;
+	}
+	_stats.retries++;
+	Wait(_timing.retry_us);
+    }
+}
+
+uint8_t NTAG_SimReader::Read(const uint8_t page, uint8_t *data)
+{
+    return Command(NTAG_SIM_CMD_READ, page, data, 4);
+}
+
+uint8_t NTAG_SimReader::FastRead(const uint8_t start_page, const uint8_t end_page, uint8_t *data)
+{
+    return Command(NTAG_SIM_CMD_FAST_READ, start_page, data, end_page - start_page + 1);
+}
+
+uint8_t NTAG_SimReader::Write(const uint8_t page, const uint8_t *data)
+{
+    return Command(NTAG_SIM_CMD_WRITE, page, (uint8_t *)data, 1);
+}
+
+/**************************************************************************/
+/*! Fetch(uint8_t *area, int &available, const int needed, const bool fast_read)
+    @brief  Read the NDEF area (from page 4) until needed bytes are
+			available
+    @param  area		NDEF area copy
+    @param  available	Bytes already in area, updated
+    @param  needed
+    @param  fast_read	FAST_READ as many pages as needed and allowed,
+						otherwise READ 4 pages at a time
+*/
+/**************************************************************************/
+
+bool NTAG_SimReader::Fetch(uint8_t *area, int &available, const int needed, const bool fast_read)
+{
+    while (available < needed)
+    {
+	uint8_t page = 4 + available / 4;
+	if (fast_read && _timing.max_fast_read_pages > 0)
+	{
+	    int nb_pages = (needed - available + 3) / 4;
+	    if (nb_pages > _timing.max_fast_read_pages)
+		nb_pages = _timing.max_fast_read_pages;
+	    if (FastRead(page, page + nb_pages - 1, &area[available]) != NTAG_SIM_ACK)
+		return false;
+	    available += nb_pages * 4;
+	}
+	else
+	{
+	    if (Read(page, &area[available]) != NTAG_SIM_ACK)
+		return false;
+	    available += 16;
+	}
+    }
+    return true;
+}
+
+/**************************************************************************/
+/*! ReadNDEF(uint8_t *message, const int size, const bool fast_read)
+    @brief  NFC Forum Type 2 read procedure: READ of page 3 (CC and start of
+			the NDEF area), TLV parsing, then the rest of the NDEF message.
+			Return its length, -1 on a failed command, a missing NDEF TLV or
+			a message larger than size
+    @param  message		NDEF message, returned
+    @param  size		Size of message
+    @param  fast_read	Read the rest with FAST_READ
+*/
+/**************************************************************************/
+
+int NTAG_SimReader::ReadNDEF(uint8_t *message, const int size, const bool fast_read)
+{
+    static uint8_t area[NDEF_AREA_BYTES + 4 * 64];
+    uint8_t page3[16];
+
+    if (Read(3, page3) != NTAG_SIM_ACK || page3[0] != 0xE1)
+	return -1;
+    int area_size = page3[2] * 8;
+    if (area_size > NDEF_AREA_BYTES)
+	area_size = NDEF_AREA_BYTES;
+    memcpy(area, &page3[4], 12);
+    int available = 12;
+
+    int i = 0;
+    while (i < area_size)
+    {
+	if (!Fetch(area, available, i + 4, fast_read))
+	    return -1;
+	uint8_t type = area[i];
+	if (type == 0x00) //NULL TLV
+	{
+	    i++;
+	    continue;
+	}
+	if (type == NTAG_NDEF_TLV_TERMINATOR)
+	    return -1;
+	int length = area[i + 1];
+	int header = 2;
+	if (length == 0xFF)
+	{
+	    length = (area[i + 2] << 8) | area[i + 3];
+	    header = 4;
+	}
+	if (type != NTAG_NDEF_TLV)
+	{
+	    i += header + length;
+	    continue;
+	}
+	if (length > size || i + header + length > area_size)
+	    return -1;
+	if (!Fetch(area, available, i + header + length, fast_read))
+	    return -1;
+	memcpy(message, &area[i + header], length);
+	return length;
+    }
+    return -1;
+}
@@ -0,0 +1,92 @@
+/**************************************************************************/
+/*!
+    @file     ntag_sim_reader.h
+    @author   AtoM
+	@license  BSD (see license.txt)
+
+ISO/IEC 14443-A reader (PCD) emulator driving the RF side of NTAG_SimTag.
+Each command advances the simulation clock by its time on air at 106
+kbit/s: reader frame, frame delay time, tag answer, plus the reader
+overhead between two commands of the profile (NTAG_SimTiming).
+
+A background task can be given: it is called whenever the reader waits
+(command overhead, EEPROM programming, retry delay) and is due, so that
+the MCU side (NXP_NTAG_I2C over the Wire shim) runs beside the RF
+exchanges. Each call is atomic: its I2C transfers all take effect when it
+starts, and the clock is set back afterwards since the reader does not
+wait for the MCU.
+
+A command answered with a NAK because the memory is locked to the I2C is
+repeated after retry_us, up to max_retries times.
+
+*/
+/**************************************************************************/
+
+#ifndef NTAG_SIM_READER_H
+#define NTAG_SIM_READER_H
+
+#include <stdint.h>
+
+#include "ntag_sim_tag.h"
+
+#define NTAG_SIM_CMD_READ 0x30
+#define NTAG_SIM_CMD_FAST_READ 0x3A
+#define NTAG_SIM_CMD_WRITE 0xA2
+
+struct NTAG_SimTiming
+{
+    const char *name;
+    double bit_us;		    //one bit at 106 kbit/s
+    double fdt_us;		    //frame delay time, end of command to start of answer
+    uint32_t guard_us;		    //unmodulated field before the first command
+    uint32_t command_overhead_us;   //reader processing between two commands
+    uint32_t retry_us;		    //delay before repeating a NAKed command
+    uint8_t max_retries;
+    uint8_t max_fast_read_pages;    //0: FAST_READ not used
+
+    static NTAG_SimTiming Reader();
+    static NTAG_SimTiming Phone();
+};
+
+struct NTAG_SimReaderStats
+{
+    unsigned long commands;
+    unsigned long naks;
+    unsigned long retries;
+    unsigned long failures;
+};
+
+class NTAG_SimReader
+{
+  public:
+    NTAG_SimReader(NTAG_SimTag &tag, const NTAG_SimTiming &timing = NTAG_SimTiming::Reader());
+
+    void SetTiming(const NTAG_SimTiming &timing) { _timing = timing; }
+    void SetBackground(void (*task)(void *), void *context, const uint32_t period_us);
+
+    bool Activate();
+    void Release();
+    uint8_t Read(const uint8_t page, uint8_t *data);
+    uint8_t FastRead(const uint8_t start_page, const uint8_t end_page, uint8_t *data);
+    uint8_t Write(const uint8_t page, const uint8_t *data);
+    int ReadNDEF(uint8_t *message, const int size, const bool fast_read);
+
+    void Wait(const uint64_t us);
+    const NTAG_SimReaderStats &Stats() const { return _stats; }
+    void ResetStats();
+
+  private:
+    void OnAir(const uint32_t nb_bits);
+    uint8_t Command(const uint8_t command, const uint8_t page, uint8_t *data, const uint8_t nb_pages);
+    bool Fetch(uint8_t *area, int &available, const int needed, const bool fast_read);
+
+    NTAG_SimTag &_tag;
+    NTAG_SimTiming _timing;
+    void (*_task)(void *);
+    void *_context;
+    uint32_t _period_us;
+    uint64_t _next_task;
+    NTAG_SimReaderStats _stats;
+};
+
+#endif
@@ -0,0 +1,501 @@
+/**************************************************************************/
+/*!
+    @file     ntag_sim_tag.cpp
+    @author   AtoM
+	@license  BSD (see license.txt)
+
+*/
+/**************************************************************************/
+
+#include <string.h>
+
+#include "Arduino.h"
+#include "nfc_dynamic_tag.h"
+#include "ntag_sim_tag.h"
+
+#define PTHRU_PAGE 0xF0 //first RF page of the SRAM in pass-through mode
+#define LAST_PAGE 0xFF
+
+/**************************************************************************/
+/*! NTAG_SimTag(const uint8_t dynamic_lock_block)
+    @brief  Instantiates a tag as delivered: empty NDEF message in block 1,
+			default configuration register, then powers it on
+    @param  dynamic_lock_block	0x38 (NT3H1101) or 0x78 (NT3H1201)
+*/
+/**************************************************************************/
+
+NTAG_SimTag::NTAG_SimTag(const uint8_t dynamic_lock_block) : _dynamic_lock_block(dynamic_lock_block)
+{
+    static const uint8_t block0[16] = {0x04, 0x51, 0x7A, 0x2C, 0x12, 0x34, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0xE1, 0x10, 0x00, 0x00};
+    static const uint8_t configuration[8] = {0x01, 0x00, 0xF8, 0x48, 0x08, 0x01, 0x00, 0x00};
+    static const uint8_t empty_ndef[3] = {NTAG_NDEF_TLV, 0x00, NTAG_NDEF_TLV_TERMINATOR};
+
+    memset(_eeprom, 0, sizeof(_eeprom));
+    memset(_sram, 0, sizeof(_sram));
+    memcpy(_eeprom[0], block0, 16);
+    _eeprom[0][14] = dynamic_lock_block == NTAG_I2C_2K_DYNAMIC_LOCK_BLOCK ? NTAG_I2C_2K_CC_SIZE : NTAG_I2C_1K_CC_SIZE;
+    memcpy(_eeprom[1], empty_ndef, 3);
+    memcpy(_eeprom[dynamic_lock_block + 2], configuration, 8);
+    _field = false;
+    _busy_until = 0;
+    _i2c_access = 0;
+    ResetStats();
+    PowerOn();
+}
+
+/**************************************************************************/
+/*! PowerOn()
+    @brief  Load the session registers from the configuration register and
+			clear the arbitration state, the SRAM keeps its content
+*/
+/**************************************************************************/
+
+void NTAG_SimTag::PowerOn()
+{
+    memcpy(_session, _eeprom[_dynamic_lock_block + 2], 6);
+    _session[6] = 0;
+    _session[7] = 0;
+    _pointer = 0;
+    _register = 0;
+    _register_read = false;
+    _i2c_locked = false;
+    _rf_locked = false;
+    _sram_i2c_ready = false;
+    _sram_rf_ready = false;
+    _ndef_data_read = false;
+}
+
+void NTAG_SimTag::ResetStats()
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+bool NTAG_SimTag::Busy() const
+{
+    return NTAG_SimMicros() < _busy_until;
+}
+
+/**************************************************************************/
+/*! ExpireI2CLock()
+    @brief  Release I2C_LOCKED once the watchdog time has elapsed since the
+			last I2C memory access
+*/
+/**************************************************************************/
+
+void NTAG_SimTag::ExpireI2CLock()
+{
+    uint64_t wdt_us = ((uint64_t)_session[3] | (uint64_t)_session[4] << 8) * NTAG_SIM_WDT_UNIT_NS / 1000;
+    if (_i2c_locked && NTAG_SimMicros() - _i2c_access >= wdt_us)
+	_i2c_locked = false;
+}
+
+/**************************************************************************/
+/*! NSReg()
+    @brief  NS_REG as read by the host, NDEF_DATA_READ is cleared by the
+			read
+*/
+/**************************************************************************/
+
+uint8_t NTAG_SimTag::NSReg()
+{
+    ExpireI2CLock();
+    uint8_t ns_reg = (_ndef_data_read ? NTAG_I2C_NS_NDEF_DATA_READ : 0) | (_i2c_locked ? NTAG_I2C_NS_I2C_LOCKED : 0) |
+		     (_rf_locked ? NTAG_I2C_NS_RF_LOCKED : 0) | (_sram_i2c_ready ? NTAG_I2C_NS_SRAM_I2C_READY : 0) |
+		     (_sram_rf_ready ? NTAG_I2C_NS_SRAM_RF_READY : 0) | (Busy() ? NTAG_I2C_NS_EEPROM_WR_BUSY : 0) |
+		     (_field ? NTAG_I2C_NS_RF_FIELD_PRESENT : 0);
+    _ndef_data_read = false;
+    return ns_reg;
+}
+
+/**************************************************************************/
+/*! MemoryAccess()
+    @brief  Arbitration of an I2C access to the EEPROM or the SRAM: NAK
+			while the RF holds the memory or the EEPROM is programming,
+			otherwise take I2C_LOCKED and restart the watchdog
+*/
+/**************************************************************************/
+
+bool NTAG_SimTag::MemoryAccess()
+{
+    ExpireI2CLock();
+    if (_rf_locked || Busy())
+    {
+	_stats.i2c_naks++;
+	return false;
+    }
+    _i2c_locked = true;
+    _i2c_access = NTAG_SimMicros();
+    return true;
+}
+
+/**************************************************************************/
+/*! I2CWrite(const uint8_t *data, const uint8_t length)
+    @brief  One I2C write transfer after the device address: MEMA alone
+			(read pointer), session register address or masked write, or
+			MEMA and a 16-byte block. Return false for a NAK
+    @param  data
+    @param  length
+*/
+/**************************************************************************/
+
+bool NTAG_SimTag::I2CWrite(const uint8_t *data, const uint8_t length)
+{
+    if (length == 0)
+	return true;
+    uint8_t block = data[0];
+    if (length == 1)
+    {
+	_pointer = block;
+	_register_read = false;
+	return true;
+    }
+    if (block == NTAG_I2C_SESSION_REG_BLOCK)
+    {
+	if (length == 2 && data[1] < 8)
+	{
+	    _register = data[1];
+	    _register_read = true;
+	    return true;
+	}
+	if (length != 4 || data[1] > 7)
+	    return false;
+	uint8_t reg = data[1];
+	uint8_t mask = data[2];
+	uint8_t value = data[3];
+	if (reg == 6) //only I2C_LOCKED can be changed by the host, and only taken while the RF does not hold the memory
+	{
+	    if (mask & NTAG_I2C_NS_I2C_LOCKED)
+	    {
+		_i2c_locked = (value & NTAG_I2C_NS_I2C_LOCKED) && !_rf_locked;
+		_i2c_access = NTAG_SimMicros();
+	    }
+	}
+	else if (reg != 5 && reg != 7)
+	{
+	    _session[reg] = (_session[reg] & ~mask) | (value & mask);
+	}
+	return true;
+    }
+    if (length != 17)
+	return false;
+
+    const uint8_t *input = &data[1];
+    uint8_t conf_reg_block = _dynamic_lock_block + 2;
+    bool pass_through = _session[0] & NTAG_I2C_NC_PTHRU_ON_OFF;
+
+    if (block >= NTAG_I2C_SRAM_BLOCK && block < NTAG_I2C_SRAM_BLOCK + NTAG_I2C_SRAM_BLOCKS)
+    {
+	bool i2c_to_rf = pass_through && !(_session[0] & NTAG_I2C_NC_PTHRU_DIR);
+	if ((i2c_to_rf && _sram_rf_ready) || !MemoryAccess())
+	{
+	    if (i2c_to_rf && _sram_rf_ready)
+		_stats.i2c_naks++;
+	    return false;
+	}
+	memcpy(_sram[block - NTAG_I2C_SRAM_BLOCK], input, 16);
+	_stats.sram_writes++;
+	if (i2c_to_rf && block == NTAG_I2C_SRAM_BLOCK + NTAG_I2C_SRAM_BLOCKS - 1)
+	{
+	    _sram_rf_ready = true;
+	    _i2c_locked = false;
+	}
+	return true;
+    }
+    if (block > conf_reg_block || (block == conf_reg_block && (_eeprom[conf_reg_block][6] & NTAG_I2C_REG_LOCK_I2C)))
+	return false;
+    if (!MemoryAccess())
+	return false;
+
+    if (block == NTAG_I2C_SERIAL_NB_BLOCK) //byte 0 would set the I2C address, not modelled
+    {
+	_eeprom[0][10] |= input[10];
+	_eeprom[0][11] |= input[11];
+	memcpy(&_eeprom[0][12], &input[12], 4);
+    }
+    else if (block == _dynamic_lock_block)
+    {
+	memcpy(_eeprom[block], input, 8);
+	for (uint8_t i = 8; i < 11; i++)
+	{
+	    _eeprom[block][i] |= input[i];
+	}
+    }
+    else if (block == conf_reg_block)
+    {
+	memcpy(_eeprom[block], input, 8);
+    }
+    else if (block > _dynamic_lock_block)
+    {
+	return false;
+    }
+    else
+    {
+	memcpy(_eeprom[block], input, 16);
+    }
+    _busy_until = NTAG_SimMicros() + NTAG_SIM_EEPROM_WRITE_US;
+    _stats.eeprom_writes++;
+    return true;
+}
+
+/**************************************************************************/
+/*! I2CRead(uint8_t *data, const uint8_t length)
+    @brief  One I2C read transfer: the session register addressed last, or
+			the block addressed last. Return the number of bytes sent, 0
+			for a NAK
+    @param  data
+    @param  length
+*/
+/**************************************************************************/
+
+uint8_t NTAG_SimTag::I2CRead(uint8_t *data, const uint8_t length)
+{
+    uint8_t count = length > 16 ? 16 : length;
+
+    if (_register_read)
+    {
+	data[0] = _register == 6 ? NSReg() : _session[_register];
+	memset(&data[1], 0, count - 1);
+	return count;
+    }
+
+    uint8_t block = _pointer;
+    const uint8_t *source;
+    if (block >= NTAG_I2C_SRAM_BLOCK && block < NTAG_I2C_SRAM_BLOCK + NTAG_I2C_SRAM_BLOCKS)
+	source = _sram[block - NTAG_I2C_SRAM_BLOCK];
+    else if (block <= _dynamic_lock_block + 2)
+	source = _eeprom[block];
+    else
+	return 0;
+    if (!MemoryAccess())
+	return 0;
+    memcpy(data, source, count);
+
+    bool rf_to_i2c = (_session[0] & NTAG_I2C_NC_PTHRU_ON_OFF) && (_session[0] & NTAG_I2C_NC_PTHRU_DIR);
+    if (rf_to_i2c && block == NTAG_I2C_SRAM_BLOCK + NTAG_I2C_SRAM_BLOCKS - 1)
+    {
+	_sram_i2c_ready = false;
+	_i2c_locked = false;
+    }
+    return count;
+}
+
+/**************************************************************************/
+/*! SetField(const bool on)
+    @brief  RF field on or off; off releases RF_LOCKED and ends the
+			pass-through mode
+    @param  on
+*/
+/**************************************************************************/
+
+void NTAG_SimTag::SetField(const bool on)
+{
+    _field = on;
+    if (on)
+	return;
+    _rf_locked = false;
+    _session[0] &= ~NTAG_I2C_NC_PTHRU_ON_OFF;
+    _sram_i2c_ready = false;
+    _sram_rf_ready = false;
+}
+
+/**************************************************************************/
+/*! Page(const uint8_t page, Area &area)
+    @brief  Memory behind a RF page (4 bytes), NULL when out of range.
+			Pages 0 to 2 are read only (AREA_NONE)
+    @param  page
+    @param  area		Kind of memory, returned
+*/
+/**************************************************************************/
+
+uint8_t *NTAG_SimTag::Page(const uint8_t page, Area &area)
+{
+    unsigned int mirror_page = (unsigned int)_session[2] * 4;
+    unsigned int lock_page = (unsigned int)_dynamic_lock_block * 4 + 2;
+    unsigned int conf_page = ((unsigned int)_dynamic_lock_block + 2) * 4;
+
+    if ((_session[0] & NTAG_I2C_NC_PTHRU_ON_OFF) && page >= PTHRU_PAGE)
+    {
+	area = AREA_SRAM;
+	return &_sram[0][0] + (page - PTHRU_PAGE) * 4;
+    }
+    if ((_session[0] & NTAG_I2C_NC_SRAM_MIRROR_ON_OFF) && page >= mirror_page && page < mirror_page + NTAG_I2C_SRAM_BLOCKS * 4)
+    {
+	area = AREA_SRAM;
+	return &_sram[0][0] + (page - mirror_page) * 4;
+    }
+    if (page < 3)
+    {
+	area = AREA_NONE;
+	return &_rf_header[page * 4];
+    }
+    if (page == 3)
+    {
+	area = AREA_LOCK;
+	return &_eeprom[0][12];
+    }
+    if (page < lock_page)
+    {
+	area = AREA_EEPROM;
+	return &_eeprom[page / 4][(page % 4) * 4];
+    }
+    if (page == lock_page)
+    {
+	area = AREA_LOCK;
+	return &_eeprom[_dynamic_lock_block][8];
+    }
+    if (page == conf_page || page == conf_page + 1)
+    {
+	area = AREA_EEPROM;
+	return &_eeprom[page / 4][(page % 4) * 4];
+    }
+    return NULL;
+}
+
+/**************************************************************************/
+/*! RFWritable(const uint8_t page)
+    @brief  Static lock bits (pages 3 to 15), dynamic lock bits (groups of
+			16 or 32 pages from page 16) and REG_LOCK_NFC
+    @param  page
+*/
+/**************************************************************************/
+
+bool NTAG_SimTag::RFWritable(const uint8_t page)
+{
+    uint8_t block = page / 4;
+
+    if (block == _dynamic_lock_block + 2)
+	return !(_eeprom[block][6] & NTAG_I2C_REG_LOCK_NFC);
+    if (page < 16)
+    {
+	uint16_t page_locks = (uint16_t)(_eeprom[0][10] >> 3) | ((uint16_t)_eeprom[0][11] << 5);
+	return !((page_locks >> (page - 3)) & 0x01);
+    }
+    if (block > _dynamic_lock_block)
+	return true;
+    uint8_t group = (block - 4) / (_dynamic_lock_block == NTAG_I2C_2K_DYNAMIC_LOCK_BLOCK ? 8 : 4);
+    return !((_eeprom[_dynamic_lock_block][8 + group / 8] >> (group % 8)) & 0x01);
+}
+
+/**************************************************************************/
+/*! RFRead(const uint8_t page, uint8_t *data, const uint8_t nb_pages)
+    @brief  READ (4 pages) or FAST_READ: copy nb_pages pages to data and
+			return NTAG_SIM_ACK, or a NAK
+    @param  page		First page
+    @param  data		nb_pages * 4 bytes
+    @param  nb_pages
+*/
+/**************************************************************************/
+
+uint8_t NTAG_SimTag::RFRead(const uint8_t page, uint8_t *data, const uint8_t nb_pages)
+{
+    if (!_field)
+	return NTAG_SIM_NO_ANSWER;
+    ExpireI2CLock();
+    if (_i2c_locked)
+    {
+	_stats.rf_naks++;
+	return NTAG_SIM_NAK_LOCKED;
+    }
+
+    // Pages 0 to 2: UID with its check bytes, internal byte and static lock bytes
+    const uint8_t *uid = _eeprom[0];
+    uint8_t rf_header[12] = {uid[0], uid[1], uid[2], (uint8_t)(0x88 ^ uid[0] ^ uid[1] ^ uid[2]),
+			     uid[3], uid[4], uid[5], uid[6],
+			     (uint8_t)(uid[3] ^ uid[4] ^ uid[5] ^ uid[6]), uid[9], uid[10], uid[11]};
+    memcpy(_rf_header, rf_header, sizeof(_rf_header));
+
+    bool pass_through = _session[0] & NTAG_I2C_NC_PTHRU_ON_OFF;
+    bool last_sram_page = false;
+    bool last_ndef_block = false;
+    for (unsigned int i = 0; i < nb_pages; i++)
+    {
+	Area area;
+	uint8_t current = page + i;
+	uint8_t *source = Page(current, area);
+	if (source == NULL || page + i > LAST_PAGE)
+	{
+	    _stats.rf_naks++;
+	    return NTAG_SIM_NAK_INVALID;
+	}
+	if (pass_through && current >= PTHRU_PAGE && ((_session[0] & NTAG_I2C_NC_PTHRU_DIR) || !_sram_rf_ready))
+	{
+	    _stats.rf_naks++;
+	    return NTAG_SIM_NAK_LOCKED;
+	}
+	memcpy(&data[i * 4], source, 4);
+	last_sram_page |= pass_through && current == LAST_PAGE;
+	last_ndef_block |= _session[1] != 0 && current / 4 == _session[1];
+    }
+
+    _rf_locked = true;
+    if (last_sram_page)
+    {
+	_sram_rf_ready = false;
+	_rf_locked = false;
+    }
+    else if (last_ndef_block)
+    {
+	_ndef_data_read = true;
+	_rf_locked = false;
+    }
+    return NTAG_SIM_ACK;
+}
+
+/**************************************************************************/
+/*! RFWrite(const uint8_t page, const uint8_t *data, uint32_t &program_us)
+    @brief  WRITE of one page (4 bytes). Return NTAG_SIM_ACK or a NAK and
+			the programming time the answer is delayed by (0 for the SRAM)
+    @param  page
+    @param  data
+    @param  program_us	EEPROM programming time, returned
+*/
+/**************************************************************************/
+
+uint8_t NTAG_SimTag::RFWrite(const uint8_t page, const uint8_t *data, uint32_t &program_us)
+{
+    program_us = 0;
+    if (!_field)
+	return NTAG_SIM_NO_ANSWER;
+    ExpireI2CLock();
+    if (_i2c_locked)
+    {
+	_stats.rf_naks++;
+	return NTAG_SIM_NAK_LOCKED;
+    }
+
+    Area area;
+    uint8_t *target = Page(page, area);
+    if (target == NULL || area == AREA_NONE || (area != AREA_SRAM && !RFWritable(page)))
+    {
+	_stats.rf_naks++;
+	return NTAG_SIM_NAK_INVALID;
+    }
+
+    bool pass_through = (_session[0] & NTAG_I2C_NC_PTHRU_ON_OFF) && page >= PTHRU_PAGE;
+    if (pass_through && (!(_session[0] & NTAG_I2C_NC_PTHRU_DIR) || _sram_i2c_ready))
+    {
+	_stats.rf_naks++;
+	return NTAG_SIM_NAK_LOCKED;
+    }
+
+    _rf_locked = true;
+    if (area == AREA_SRAM)
+    {
+	memcpy(target, data, 4);
+	_stats.sram_writes++;
+	if (pass_through && page == LAST_PAGE)
+	{
+	    _sram_i2c_ready = true;
+	    _rf_locked = false;
+	}
+	return NTAG_SIM_ACK;
+    }
+    for (uint8_t i = 0; i < 4; i++)
+    {
+	target[i] = area == AREA_LOCK ? target[i] | data[i] : data[i];
+    }
+    program_us = NTAG_SIM_RF_WRITE_US;
+    _busy_until = NTAG_SimMicros() + program_us;
+    _stats.eeprom_writes++;
+    return NTAG_SIM_ACK;
+}
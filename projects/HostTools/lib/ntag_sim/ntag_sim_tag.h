@@ -0,0 +1,128 @@
+/**************************************************************************/
+/*!
+    @file     ntag_sim_tag.h
+    @author   AtoM
+	@license  BSD (see license.txt)
+
+Host model of the NT3H1101 (NT3H1201 with a 0x78 dynamic lock block) as
+seen from its two interfaces: the I2C slave driven by NXP_NTAG_I2C through
+the Wire shim, and the RF side driven by NTAG_SimReader.
+
+	Memory: EEPROM blocks 0 to the configuration register, SRAM (blocks
+	0xF8 to 0xFB), session registers (block 0xFE). RF pages are those of
+	sector 0: page p is byte 4 * (p % 4) of block p / 4, pages 0 to 2 are
+	the UID, internal and static lock bytes, 0xF0 to 0xFF the SRAM in
+	pass-through mode. Pages of the SRAM mirror window map to the SRAM.
+
+	Timing: an EEPROM write keeps EEPROM_WR_BUSY set for
+	NTAG_SIM_EEPROM_WRITE_US, during which I2C memory accesses are NAKed.
+
+	Arbitration (datasheet Rev3.2, memory arbitration), simplified:
+	- an I2C memory access sets I2C_LOCKED, released by the host (NS_REG
+	  masked write) or when the watchdog time (WDT_LS/MS, 9.43 us units)
+	  has elapsed since the last I2C access; RF commands get a NAK while
+	  it is set,
+	- a RF memory access sets RF_LOCKED, released when the field goes
+	  off, when the RF reads LAST_NDEF_BLOCK (if not 0), or in
+	  pass-through at the end of each 64-byte transfer; I2C memory
+	  accesses get a NAK while it is set,
+	- pass-through RF to I2C: the RF writes the SRAM pages, writing page
+	  0xFF sets SRAM_I2C_READY, the I2C reading block 0xFB clears it,
+	- pass-through I2C to RF: the I2C writes the SRAM, writing block 0xFB
+	  sets SRAM_RF_READY, the RF reading page 0xFF clears it,
+	- the field going off clears PTHRU_ON_OFF and the SRAM flags.
+
+	Lock bits are only enforced on the RF side. Sector select, passwords
+	and the 2k second sector on RF are not modelled.
+*/
+/**************************************************************************/
+
+#ifndef NTAG_SIM_TAG_H
+#define NTAG_SIM_TAG_H
+
+#include <stdint.h>
+
+#include "nfc_dynamic_tag_map.h"
+
+#define NTAG_SIM_I2C_ADDRESS 0x55
+#define NTAG_SIM_EEPROM_WRITE_US 4500 //I2C block write (16 bytes)
+#define NTAG_SIM_RF_WRITE_US 4100     //RF page write (4 bytes)
+#define NTAG_SIM_WDT_UNIT_NS 9430
+
+// RF answers (4-bit ACK / NAK)
+
+#define NTAG_SIM_ACK 0x0A
+#define NTAG_SIM_NAK_INVALID 0x00 //page out of range or write protected
+#define NTAG_SIM_NAK_LOCKED 0x04  //memory locked to I2C, or SRAM not ready in pass-through
+#define NTAG_SIM_NO_ANSWER 0xFF   //no field
+
+struct NTAG_SimTagStats
+{
+    unsigned long i2c_naks;
+    unsigned long rf_naks;
+    unsigned long eeprom_writes;
+    unsigned long sram_writes;
+};
+
+class NTAG_SimTag
+{
+  public:
+    NTAG_SimTag(const uint8_t dynamic_lock_block = NTAG_I2C_DYNAMIC_LOCK_BLOCK);
+
+    void PowerOn();
+    uint8_t Address() const { return NTAG_SIM_I2C_ADDRESS; }
+
+    // I2C slave, called by the Wire shim
+    bool I2CWrite(const uint8_t *data, const uint8_t length);
+    uint8_t I2CRead(uint8_t *data, const uint8_t length);
+
+    // RF interface, called by NTAG_SimReader
+    void SetField(const bool on);
+    bool Field() const { return _field; }
+    uint8_t RFRead(const uint8_t page, uint8_t *data, const uint8_t nb_pages);
+    uint8_t RFWrite(const uint8_t page, const uint8_t *data, uint32_t &program_us);
+
+    uint8_t NSReg();
+    uint8_t *Block(const uint8_t block) { return _eeprom[block]; }
+    uint8_t *SRAM() { return _sram[0]; }
+    const NTAG_SimTagStats &Stats() const { return _stats; }
+    void ResetStats();
+
+  private:
+    enum Area
+    {
+	AREA_NONE,
+	AREA_EEPROM,
+	AREA_SRAM,
+	AREA_LOCK, //OR written (lock bytes, CC)
+    };
+
+    uint8_t *Page(const uint8_t page, Area &area);
+    bool RFWritable(const uint8_t page);
+    bool MemoryAccess();
+    void ExpireI2CLock();
+    bool Busy() const;
+
+    uint8_t _dynamic_lock_block;
+    uint8_t _eeprom[NTAG_I2C_MAP_MAX_BLOCKS][16];
+    uint8_t _sram[NTAG_I2C_SRAM_BLOCKS][16];
+    uint8_t _session[8];
+    uint8_t _rf_header[12]; //pages 0 to 2 as read over RF
+
+    uint8_t _pointer;  //block of the next I2C read
+    uint8_t _register; //REGA of the next session register read
+    bool _register_read;
+
+    bool _field;
+    bool _i2c_locked;
+    bool _rf_locked;
+    bool _sram_i2c_ready;
+    bool _sram_rf_ready;
+    bool _ndef_data_read;
+    uint64_t _busy_until;
+    uint64_t _i2c_access;
+
+    NTAG_SimTagStats _stats;
+};
+
+#endif
@@ -0,0 +1,97 @@
+/**************************************************************************/
+/*!
+    @file     ntag_sim_trace.cpp
+    @author   AtoM
+	@license  BSD (see license.txt)
+
+*/
+/**************************************************************************/
+
+#include <stdlib.h>
+
+#include "ntag_sim_trace.h"
+
+static NTAG_SimTrace *tracing = NULL;
+
+void NTAG_SimTraceTo(NTAG_SimTrace *trace)
+{
+    tracing = trace;
+}
+
+NTAG_SimTrace *NTAG_SimTracing()
+{
+    return tracing;
+}
+
+void NTAG_SimTrace::Clear()
+{
+    _events.clear();
+    _transactions = 0;
+    _bytes = 0;
+    _wait_us = 0;
+    _bus_us = 0;
+}
+
+void NTAG_SimTrace::Add(const NTAG_SimEvent &event)
+{
+    _events.push_back(event);
+    if (event.kind == NTAG_SIM_EVENT_WAIT)
+    {
+	_wait_us += event.us;
+	return;
+    }
+    _transactions++;
+    _bus_us += event.us;
+    _bytes += event.kind == NTAG_SIM_EVENT_WRITE ? event.length : event.result;
+}
+
+/**************************************************************************/
+/*! Print(FILE *out, const NTAG_SimEvent &event)
+    @brief  One line per event, the bus time is left out so that a change
+			of I2C clock alone does not change the sequence:
+				W <address> <first byte> <length> <status>
+				R <address> <requested> <received>
+				D <us>
+*/
+/**************************************************************************/
+
+void NTAG_SimTrace::Print(FILE *out, const NTAG_SimEvent &event)
+{
+    if (event.kind == NTAG_SIM_EVENT_WRITE)
+	fprintf(out, "W %02X %02X %u %u\n", event.address, event.first, event.length, event.result);
+    else if (event.kind == NTAG_SIM_EVENT_READ)
+	fprintf(out, "R %02X %u %u\n", event.address, event.length, event.result);
+    else
+	fprintf(out, "D %lu\n", (unsigned long)event.us);
+}
+
+bool NTAG_SimTrace::Parse(const char *line, NTAG_SimEvent &event)
+{
+    unsigned int address, first, length, result;
+    unsigned long us;
+
+    event.kind = line[0];
+    event.address = event.first = event.length = event.result = 0;
+    event.us = 0;
+    if (line[0] == NTAG_SIM_EVENT_WRITE && sscanf(line + 1, "%x %x %u %u", &address, &first, &length, &result) == 4)
+    {
+	event.address = address;
+	event.first = first;
+	event.length = length;
+	event.result = result;
+	return true;
+    }
+    if (line[0] == NTAG_SIM_EVENT_READ && sscanf(line + 1, "%x %u %u", &address, &length, &result) == 3)
+    {
+	event.address = address;
+	event.length = length;
+	event.result = result;
+	return true;
+    }
+    if (line[0] == NTAG_SIM_EVENT_WAIT && sscanf(line + 1, "%lu", &us) == 1)
+    {
+	event.us = us;
+	return true;
+    }
+    return false;
+}
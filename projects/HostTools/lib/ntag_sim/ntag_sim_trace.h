@@ -0,0 +1,68 @@
+/**************************************************************************/
+/*!
+    @file     ntag_sim_trace.h
+    @author   AtoM
+	@license  BSD (see license.txt)
+
+Record of the bus transactions and waits of the host shims: while a trace
+is attached with NTAG_SimTraceTo(), the Wire shim adds one event per
+transaction and delay() / delayMicroseconds() one per wait, with the
+simulation time they took.
+
+	NTAG_SimTrace trace;
+	NTAG_SimTraceTo(&trace);
+	ntag.ReadSession();
+	NTAG_SimTraceTo(NULL);
+
+*/
+/**************************************************************************/
+
+#ifndef NTAG_SIM_TRACE_H
+#define NTAG_SIM_TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#define NTAG_SIM_EVENT_WRITE 'W' //beginTransmission() ... endTransmission()
+#define NTAG_SIM_EVENT_READ 'R'  //requestFrom()
+#define NTAG_SIM_EVENT_WAIT 'D'  //delay(), delayMicroseconds()
+
+struct NTAG_SimEvent
+{
+    char kind;       //NTAG_SIM_EVENT_*
+    uint8_t address; //7-bit I2C address
+    uint8_t first;   //first byte written (MEMA or register address)
+    uint8_t length;  //bytes written, or requested
+    uint8_t result;  //endTransmission() status, or bytes received
+    uint32_t us;     //bus time, or wait
+};
+
+class NTAG_SimTrace
+{
+  public:
+    NTAG_SimTrace() { Clear(); }
+
+    void Clear();
+    void Add(const NTAG_SimEvent &event);
+    const std::vector<NTAG_SimEvent> &Events() const { return _events; }
+    unsigned long Transactions() const { return _transactions; }
+    unsigned long Bytes() const { return _bytes; }
+    uint64_t WaitUs() const { return _wait_us; }
+    uint64_t BusUs() const { return _bus_us; }
+
+    static void Print(FILE *out, const NTAG_SimEvent &event);
+    static bool Parse(const char *line, NTAG_SimEvent &event);
+
+  private:
+    std::vector<NTAG_SimEvent> _events;
+    unsigned long _transactions;
+    unsigned long _bytes; //data bytes written and received, address bytes excluded
+    uint64_t _wait_us;
+    uint64_t _bus_us;
+};
+
+void NTAG_SimTraceTo(NTAG_SimTrace *trace);
+NTAG_SimTrace *NTAG_SimTracing();
+
+#endif
@@ -0,0 +1,232 @@
+/**************************************************************************/
+/*!
+    @file     main.cpp
+    @author   AtoM
+	@license  BSD (see license.txt)
+
+Decoder for the binary memory dump sent by UserMemoryDumpBinary().
+
+	dump_decoder [--json] <serial device | capture file | ->
+
+Reads frames until DUMP_END (or end of file) and renders the dump as the
+text report of the sketches, or as one JSON object with --json.
+
+*/
+/**************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ntag_frame_parser.h"
+#include "ntag_host_port.h"
+
+#define DUMP_MAX_BLOCKS 256
+
+struct Dump
+{
+    uint8_t version;
+    unsigned int nb_blocks;
+    uint8_t blocks[DUMP_MAX_BLOCKS][16];
+    bool block_received[DUMP_MAX_BLOCKS];
+    uint8_t conf_reg[8];
+    bool conf_received;
+    uint8_t session_reg[8];
+    bool session_received;
+    unsigned int frames;
+    bool complete;
+    bool frames_lost;
+};
+
+static void PrintHex(const uint8_t *data, unsigned int length, const char *separator)
+{
+    for (unsigned int i = 0; i < length; i++)
+    {
+	printf("%s%02X", i == 0 ? "" : separator, data[i]);
+    }
+}
+
+/**************************************************************************/
+/*! ApplyFrame(Dump &dump, const NTAG_Frame &frame)
+    @brief  Store one received frame into the dump
+*/
+/**************************************************************************/
+
+static void ApplyFrame(Dump &dump, const NTAG_Frame &frame)
+{
+    switch (frame.type)
+    {
+    case NTAG_FRAME_DUMP_BEGIN:
+	memset(&dump, 0, sizeof(dump));
+	if (frame.length >= 2)
+	{
+	    dump.version = frame.payload[0];
+	    dump.nb_blocks = frame.payload[1];
+	}
+	break;
+    case NTAG_FRAME_BLOCKS:
+	if (frame.length >= 1)
+	{
+	    unsigned int block = frame.payload[0];
+	    for (unsigned int offset = 1; offset + 16 <= frame.length && block < DUMP_MAX_BLOCKS; offset += 16, block++)
+	    {
+		memcpy(dump.blocks[block], &frame.payload[offset], 16);
+		dump.block_received[block] = true;
+	    }
+	}
+	break;
+    case NTAG_FRAME_CONF_REG:
+	memcpy(dump.conf_reg, frame.payload, frame.length < 8 ? frame.length : 8);
+	dump.conf_received = true;
+	break;
+    case NTAG_FRAME_SESSION_REG:
+	memcpy(dump.session_reg, frame.payload, frame.length < 8 ? frame.length : 8);
+	dump.session_received = true;
+	break;
+    case NTAG_FRAME_DUMP_END:
+	dump.complete = true;
+	dump.frames_lost = frame.length < 1 || frame.payload[0] != dump.frames;
+	return;
+    }
+    dump.frames++;
+}
+
+/**************************************************************************/
+/*! PrintReport(const Dump &dump)
+    @brief  Render the dump like UserMemoryDump() and GetNTAGFullReport()
+*/
+/**************************************************************************/
+
+static void PrintReport(const Dump &dump)
+{
+    const uint8_t *header = dump.blocks[0];
+    unsigned int last_block = dump.nb_blocks - 1;
+
+    printf("NTAG I2C binary dump v%u, %u blocks%s\n\n", dump.version, dump.nb_blocks,
+	   dump.frames_lost ? " (FRAMES LOST)" : "");
+    printf("Serial Number          : ");
+    PrintHex(header, 7, " ");
+    printf("\nStatic Lock Bytes      : ");
+    PrintHex(&header[10], 2, " ");
+    printf("\nCapability Container   : ");
+    PrintHex(&header[12], 4, " ");
+    printf("\n\n");
+
+    for (unsigned int block = 1; block <= last_block; block++)
+    {
+	// The last block only holds 8 user bytes, the dynamic lock bytes follow
+	unsigned int length = block == last_block ? 8 : 16;
+	printf("%02X  ", block);
+	if (!dump.block_received[block])
+	{
+	    printf("(missing)\n");
+	    continue;
+	}
+	PrintHex(dump.blocks[block], length, " ");
+	printf("%*s  [", (16 - length) * 3, "");
+	for (unsigned int i = 0; i < length; i++)
+	{
+	    uint8_t c = dump.blocks[block][i];
+	    putchar(c < 128 && c > 19 ? c : '.');
+	}
+	printf("]\n");
+    }
+
+    printf("\nDynamic Lock Bytes     : ");
+    PrintHex(&dump.blocks[last_block][8], 3, " ");
+    printf("\nConfiguration Register : ");
+    if (dump.conf_received)
+	PrintHex(dump.conf_reg, 8, " ");
+    printf("\nSession Register       : ");
+    if (dump.session_received)
+	PrintHex(dump.session_reg, 8, " ");
+    printf("\n");
+}
+
+/**************************************************************************/
+/*! PrintJSON(const Dump &dump)
+    @brief  Render the dump as a single JSON object of hex strings
+*/
+/**************************************************************************/
+
+static void PrintJSON(const Dump &dump)
+{
+    printf("{\"version\":%u,\"complete\":%s,\"frames_lost\":%s,\"blocks\":[", dump.version,
+	   dump.complete ? "true" : "false", dump.frames_lost ? "true" : "false");
+    for (unsigned int block = 0; block < dump.nb_blocks; block++)
+    {
+	printf("%s", block == 0 ? "" : ",");
+	if (dump.block_received[block])
+	{
+	    printf("\"");
+	    PrintHex(dump.blocks[block], 16, "");
+	    printf("\"");
+	}
+	else
+	{
+	    printf("null");
+	}
+    }
+    printf("],\"conf_reg\":\"");
+    PrintHex(dump.conf_reg, dump.conf_received ? 8 : 0, "");
+    printf("\",\"session_reg\":\"");
+    PrintHex(dump.session_reg, dump.session_received ? 8 : 0, "");
+    printf("\"}\n");
+}
+
+int main(int argc, char **argv)
+{
+    bool json = false;
+    const char *path = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+	if (strcmp(argv[i], "--json") == 0)
+	    json = true;
+	else
+	    path = argv[i];
+    }
+    if (path == NULL)
+    {
+	fprintf(stderr, "usage: %s [--json] <serial device | capture file | ->\n", argv[0]);
+	return 2;
+    }
+
+    int fd = NTAG_OpenPort(path);
+    if (fd < 0)
+    {
+	perror(path);
+	return 1;
+    }
+
+    static Dump dump;
+    NTAG_FrameParser parser;
+    NTAG_Frame frame;
+    uint8_t buffer[512];
+    bool started = false;
+    ssize_t count;
+
+    while (!dump.complete && (count = read(fd, buffer, sizeof(buffer))) > 0)
+    {
+	parser.Feed(buffer, count);
+	while (!dump.complete && parser.Next(frame))
+	{
+	    started |= frame.type == NTAG_FRAME_DUMP_BEGIN;
+	    if (started)
+		ApplyFrame(dump, frame);
+	}
+    }
+
+    if (!started || dump.nb_blocks < 2)
+    {
+	fprintf(stderr, "%s: no dump found (%lu CRC errors)\n", path, parser.CrcErrors());
+	return 1;
+    }
+    if (json)
+	PrintJSON(dump);
+    else
+	PrintReport(dump);
+    if (parser.CrcErrors() > 0)
+	fprintf(stderr, "%lu frame(s) rejected on CRC\n", parser.CrcErrors());
+    return dump.complete && !dump.frames_lost ? 0 : 1;
+}
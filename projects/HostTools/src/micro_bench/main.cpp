@@ -0,0 +1,347 @@
+/**************************************************************************/
+/*!
+    @file     main.cpp
+    @author   AtoM
+	@license  BSD (see license.txt)
+
+Microbenchmarks of the CPU side of the library on the host: NDEF and WSC
+encoders, hex renderers, lock bit decoding, memory dumps and frame or
+image parsers. The library is built against the host shims of
+lib/ntag_sim; the kernels reading the tag go through the Wire shim to the
+simulated tag, which holds the 139-byte launcher record of the
+WPandAndroidApplicationRecordSketch.
+
+	micro_bench [minimum time per kernel in ms] [name filter]
+
+Each kernel runs until the minimum time is reached (wall clock). Reported
+per call: time, time per payload byte, and allocations (calls to operator
+new, the library itself allocates nothing). Compare runs built with the
+same compiler and flags.
+
+*/
+/**************************************************************************/
+
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "nfc_dynamic_tag.h"
+#include "ntag_sim_tag.h"
+
+#define MIN_TIME_MS 200
+
+static unsigned long allocations = 0;
+
+void *operator new(size_t size)
+{
+    allocations++;
+    void *p = malloc(size ? size : 1);
+    if (p == NULL)
+	throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+class CountingPrint : public Print
+{
+  public:
+    CountingPrint() : _count(0) {}
+
+    size_t write(uint8_t value)
+    {
+	(void)value;
+	_count++;
+	return 1;
+    }
+    size_t write(const uint8_t *buffer, size_t size)
+    {
+	(void)buffer;
+	_count += size;
+	return size;
+    }
+    using Print::write;
+    unsigned long Count() const { return _count; }
+
+  private:
+    unsigned long _count;
+};
+
+class BufferPrint : public Print
+{
+  public:
+    BufferPrint(uint8_t *buffer, size_t size) : _buffer(buffer), _size(size), _length(0) {}
+
+    size_t write(uint8_t value)
+    {
+	if (_length >= _size)
+	    return 0;
+	_buffer[_length++] = value;
+	return 1;
+    }
+    using Print::write;
+    size_t Length() const { return _length; }
+
+  private:
+    uint8_t *_buffer;
+    size_t _size;
+    size_t _length;
+};
+
+// Payloads
+
+static const uint8_t launcher[139] = {
+    0x03, 0x88, 0x93, 0x15, 0x46, 0x77, 0x69, 0x6e, 0x64, 0x6f, 0x77, 0x73, 0x2e, 0x63, 0x6f, 0x6d, 0x2f, 0x4c, 0x61, 0x75,
+    0x6e, 0x63, 0x68, 0x41, 0x70, 0x70, 0x00, 0x01, 0x0C, 0x57, 0x69, 0x6e, 0x64, 0x6f, 0x77, 0x73, 0x50, 0x68, 0x6f, 0x6e,
+    0x65, 0x26, 0x7b, 0x36, 0x33, 0x63, 0x31, 0x39, 0x39, 0x66, 0x35, 0x2d, 0x64, 0x31, 0x30, 0x63, 0x2d, 0x34, 0x64, 0x65,
+    0x31, 0x2d, 0x38, 0x35, 0x32, 0x63, 0x2d, 0x31, 0x31, 0x63, 0x30, 0x65, 0x39, 0x66, 0x35, 0x37, 0x64, 0x36, 0x36, 0x7d,
+    0x00, 0x0E, 0x22, 0x75, 0x73, 0x65, 0x72, 0x3d, 0x64, 0x65, 0x66, 0x61, 0x75, 0x6C, 0x74, 0x22, 0x54, 0x0F, 0x18, 0x61,
+    0x6e, 0x64, 0x72, 0x6f, 0x69, 0x64, 0x2e, 0x63, 0x6f, 0x6d, 0x3a, 0x70, 0x6b, 0x67, 0x63, 0x6f, 0x6d, 0x2e, 0x6f, 0x72,
+    0x61, 0x6e, 0x67, 0x65, 0x2e, 0x6f, 0x72, 0x61, 0x6e, 0x67, 0x65, 0x63, 0x61, 0x73, 0x68, 0x2e, 0x66, 0x72, 0xFE};
+
+static const char uri[] = "https://www.example.com/products/nfc-dynamic-tag?id=0042";
+static const char ssid_long[] = "ProductionFloor-Building7-Wing-B";                                    //32
+static const char key_long[] = "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"; //64 (hex PSK)
+static const uint8_t mac[6] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55};
+
+static NTAG_SimTag tag;
+static NXP_NTAG_I2C ntag(NTAG_SIM_I2C_ADDRESS);
+static CountingPrint sink;
+static uint8_t dump[2048]; //binary dump of the 1k tag
+static size_t dump_length;
+static uint8_t image[1024]; //tag image of the 1k tag
+static size_t image_length;
+static volatile uint32_t result; //keeps the results alive
+
+// Kernels
+
+static void HexKernel()
+{
+    ntag.PrintHex(sink, launcher, sizeof(launcher), true);
+}
+
+static void HexASCIIKernel()
+{
+    ntag.PrintHexASCII(sink, launcher, sizeof(launcher));
+}
+
+static void URIKernel()
+{
+    NTAG_URIRecord record(uri);
+    result += record.WriteTo(sink);
+}
+
+static void WifiKernel(uint8_t ssid_length, uint8_t key_length)
+{
+    char ssid[NTAG_WSC_MAX_SSID_LENGTH + 1];
+    char key[NTAG_WSC_MAX_KEY_LENGTH + 1];
+    NTAG_WifiCredential credential;
+
+    memcpy(ssid, ssid_long, ssid_length);
+    ssid[ssid_length] = '\0';
+    memcpy(key, key_long, key_length);
+    key[key_length] = '\0';
+    credential.SetSSID(ssid);
+    credential.SetNetworkKey(key);
+    credential.SetAuthentication(NTAG_WSC_AUTH_WPA2_PERSONAL);
+    credential.SetEncryption(NTAG_WSC_ENCR_AES);
+    credential.SetMACAddress(mac);
+    if (credential.Validate() == NTAG_WSC_OK)
+	result += credential.WriteTo(sink);
+}
+
+static void WifiShortKernel()
+{
+    WifiKernel(4, 8);
+}
+
+static void WifiMediumKernel()
+{
+    WifiKernel(12, 24);
+}
+
+static void WifiLongKernel()
+{
+    WifiKernel(32, 64);
+}
+
+static void StaticLockKernel()
+{
+    result += ntag.ReadStaticLock().page_locks;
+}
+
+static void StaticLockReportKernel()
+{
+    ntag.GetStaticLockStatus();
+}
+
+static void PlanWriteKernel()
+{
+    result += ntag.PlanWrite(NTAG_I2C_USER_MEMORY_BLOCK, NTAG_I2C_DYNAMIC_LOCK_BLOCK).nb_locked;
+}
+
+static void DumpKernel()
+{
+    ntag.UserMemoryDump(sink);
+}
+
+static void DumpBinaryKernel()
+{
+    ntag.UserMemoryDumpBinary(sink);
+}
+
+static void FrameReaderKernel()
+{
+    NTAG_FrameReader reader;
+
+    for (size_t i = 0; i < dump_length; i++)
+    {
+	if (reader.Feed(dump[i]))
+	    result += reader.Length();
+    }
+}
+
+static void SnapshotKernel()
+{
+    result += ntag.Snapshot(sink);
+}
+
+static void ImageCheckKernel()
+{
+    result += NTAG_ImageCheck(image, image_length);
+}
+
+struct Kernel
+{
+    const char *name;
+    const char *payload;
+    uint32_t bytes; //payload bytes per call, 0 when not meaningful
+    void (*run)();
+};
+
+static double Now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+/**************************************************************************/
+/*! Measure(const Kernel &kernel, unsigned int min_ms)
+    @brief  Run the kernel by doubling batches until min_ms is reached,
+			print ns per call, ns per byte and allocations per call
+*/
+/**************************************************************************/
+
+static void Measure(const Kernel &kernel, unsigned int min_ms)
+{
+    unsigned long iterations = 1;
+    double elapsed;
+    unsigned long allocated;
+
+    kernel.run(); //warm up
+    for (;;)
+    {
+	allocated = allocations;
+	double start = Now();
+	for (unsigned long i = 0; i < iterations; i++)
+	{
+	    kernel.run();
+	}
+	elapsed = Now() - start;
+	allocated = allocations - allocated;
+	if (elapsed >= min_ms * 1e6)
+	    break;
+	iterations *= 2;
+    }
+
+    double ns_per_call = elapsed / iterations;
+    printf("  %-22s %-24s %6lu %12.1f", kernel.name, kernel.payload, (unsigned long)kernel.bytes, ns_per_call);
+    if (kernel.bytes > 0)
+	printf(" %10.2f", ns_per_call / kernel.bytes);
+    else
+	printf(" %10s", "-");
+    printf(" %10.2f\n", (double)allocated / iterations);
+}
+
+int main(int argc, char **argv)
+{
+    int min_ms = argc > 1 ? atoi(argv[1]) : MIN_TIME_MS;
+    const char *filter = argc > 2 ? argv[2] : NULL;
+
+    if (min_ms <= 0)
+    {
+	fprintf(stderr, "usage: micro_bench [minimum time per kernel in ms] [name filter]\n");
+	return 1;
+    }
+    Wire.Attach(&tag);
+    ntag.begin();
+    ntag.WriteDataEEPROM((uint8_t *)launcher, sizeof(launcher));
+    Serial.SetOutput(NULL); //GetStaticLockStatus() prints to Serial
+
+    BufferPrint dump_buffer(dump, sizeof(dump));
+    ntag.UserMemoryDumpBinary(dump_buffer);
+    dump_length = dump_buffer.Length();
+    BufferPrint image_buffer(image, sizeof(image));
+    ntag.Snapshot(image_buffer);
+    image_length = image_buffer.Length();
+
+    NTAG_URIRecord uri_record(uri);
+    NTAG_WifiCredential credentials[3];
+    static const uint8_t lengths[3][2] = {{4, 8}, {12, 24}, {32, 64}};
+    char ssids[3][NTAG_WSC_MAX_SSID_LENGTH + 1];
+    char keys[3][NTAG_WSC_MAX_KEY_LENGTH + 1];
+    for (uint8_t i = 0; i < 3; i++)
+    {
+	memcpy(ssids[i], ssid_long, lengths[i][0]);
+	ssids[i][lengths[i][0]] = '\0';
+	memcpy(keys[i], key_long, lengths[i][1]);
+	keys[i][lengths[i][1]] = '\0';
+	credentials[i].SetSSID(ssids[i]);
+	credentials[i].SetNetworkKey(keys[i]);
+	credentials[i].SetMACAddress(mac);
+    }
+    uint32_t user_bytes = (NTAG_I2C_DYNAMIC_LOCK_BLOCK - NTAG_I2C_USER_MEMORY_BLOCK) * 16 + 8;
+
+    const Kernel kernels[] = {
+	{"PrintHex", "launcher 139 B", sizeof(launcher), HexKernel},
+	{"PrintHexASCII", "launcher 139 B", sizeof(launcher), HexASCIIKernel},
+	{"NTAG_URIRecord", "56-char URI", uri_record.TLVLength(), URIKernel},
+	{"NTAG_WifiCredential", "SSID 4, key 8", credentials[0].TLVLength(), WifiShortKernel},
+	{"NTAG_WifiCredential", "SSID 12, key 24", credentials[1].TLVLength(), WifiMediumKernel},
+	{"NTAG_WifiCredential", "SSID 32, key 64", credentials[2].TLVLength(), WifiLongKernel},
+	{"ReadStaticLock", "block 0 (Wire shim)", 16, StaticLockKernel},
+	{"GetStaticLockStatus", "block 0 (Wire shim)", 16, StaticLockReportKernel},
+	{"PlanWrite", "1k lock bits (Wire shim)", 0, PlanWriteKernel},
+	{"UserMemoryDump", "1k user (Wire shim)", user_bytes, DumpKernel},
+	{"UserMemoryDumpBinary", "1k tag (Wire shim)", user_bytes, DumpBinaryKernel},
+	{"NTAG_FrameReader", "1k binary dump", (uint32_t)dump_length, FrameReaderKernel},
+	{"Snapshot", "launcher (Wire shim)", user_bytes, SnapshotKernel},
+	{"NTAG_ImageCheck", "launcher image", (uint32_t)image_length, ImageCheckKernel},
+    };
+
+    printf("  %-22s %-24s %6s %12s %10s %10s\n", "kernel", "payload", "bytes", "ns/call", "ns/byte", "allocs");
+    for (unsigned int i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++)
+    {
+	if (filter == NULL || strstr(kernels[i].name, filter) != NULL)
+	    Measure(kernels[i], min_ms);
+    }
+    return 0;
+}
@@ -0,0 +1,195 @@
+/**************************************************************************/
+/*!
+    @file     main.cpp
+    @author   AtoM
+	@license  BSD (see license.txt)
+
+Scriptable access to a tag through the binary command interface of the
+NTAGMemoryDumpSketch, or through ntag_daemon when the path is its socket.
+All the commands given on the command line are pipelined in a single
+Flush().
+
+	ntag_command <serial device | daemon socket> [--no-batch] command...
+
+	read <block> <count>			read 1 to 15 blocks
+	write <block> <hex bytes>		write 1 to 15 whole blocks (multiple of 16 bytes)
+	erase <block> <count>			clean user memory blocks
+	session							read the 8 session registers
+	config							read the 8 configuration registers
+	session-write <reg> <mask> <value>
+	stats							queue depth and latency of ntag_daemon
+
+*/
+/**************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#include "ntag_client.h"
+#include "ntag_host_port.h"
+
+#define BOOTLOADER_DELAY_MS 2000 //opening the port resets the UNO
+
+struct Command
+{
+    const char *name;
+    int ticket;
+    uint8_t first_block;
+    std::vector<uint8_t> data;
+};
+
+static void PrintBlocks(uint8_t first_block, const std::vector<uint8_t> &data)
+{
+    for (size_t offset = 0; offset < data.size(); offset += 16)
+    {
+	printf("%02X ", (unsigned int)(first_block + offset / 16));
+	for (size_t i = offset; i < offset + 16 && i < data.size(); i++)
+	{
+	    printf(" %02X", data[i]);
+	}
+	printf("\n");
+    }
+}
+
+static unsigned long Field(const std::vector<uint8_t> &data, size_t offset, size_t length)
+{
+    unsigned long value = 0;
+    for (size_t i = offset; i < offset + length; i++)
+    {
+	value = value << 8 | data[i];
+    }
+    return value;
+}
+
+static void PrintStats(const std::vector<uint8_t> &data)
+{
+    printf("clients %lu, queue depth %lu (largest %lu), requests %lu, tag commands %lu, coalesced reads %lu\n",
+	   Field(data, 0, 2), Field(data, 2, 2), Field(data, 4, 2), Field(data, 6, 4), Field(data, 10, 4), Field(data, 14, 4));
+    printf("latency %lu us average, %lu us largest\n", Field(data, 18, 4), Field(data, 22, 4));
+}
+
+static bool ParseHex(const char *text, std::vector<uint8_t> &out)
+{
+    size_t length = strlen(text);
+    if (length % 2 != 0)
+	return false;
+    for (size_t i = 0; i < length; i += 2)
+    {
+	char digits[3] = {text[i], text[i + 1], 0};
+	char *end;
+	out.push_back((uint8_t)strtoul(digits, &end, 16));
+	if (*end != 0)
+	    return false;
+    }
+    return true;
+}
+
+static int Usage(const char *program)
+{
+    fprintf(stderr, "usage: %s <serial device | daemon socket> [--no-batch] command...\n"
+		    "  read <block> <count> | write <block> <hex> | erase <block> <count>\n"
+		    "  session | config | session-write <reg> <mask> <value> | stats\n",
+	    program);
+    return 2;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+	return Usage(argv[0]);
+
+    int fd = NTAG_OpenPort(argv[1]);
+    if (fd < 0)
+    {
+	perror(argv[1]);
+	return 1;
+    }
+    if (isatty(fd))
+	usleep(BOOTLOADER_DELAY_MS * 1000);
+
+    NTAG_Client client(fd);
+    std::vector<Command> commands;
+    commands.reserve(argc);
+
+    for (int i = 2; i < argc; i++)
+    {
+	Command command;
+	command.name = argv[i];
+	command.ticket = -1;
+	command.first_block = 0;
+	int remaining = argc - i - 1;
+
+	if (strcmp(argv[i], "--no-batch") == 0)
+	{
+	    client.SetBatching(false);
+	    continue;
+	}
+	commands.push_back(command);
+	Command &queued = commands.back();
+	if (strcmp(argv[i], "read") == 0 && remaining >= 2)
+	{
+	    unsigned long count = strtoul(argv[i + 2], NULL, 0);
+	    if (count == 0 || count > NTAG_FRAME_MAX_BLOCKS)
+		return Usage(argv[0]);
+	    queued.first_block = strtoul(argv[i + 1], NULL, 0);
+	    queued.data.resize(count * 16);
+	    queued.ticket = client.QueueRead(queued.first_block, queued.data.size() / 16, &queued.data[0]);
+	    i += 2;
+	}
+	else if (strcmp(argv[i], "write") == 0 && remaining >= 2)
+	{
+	    std::vector<uint8_t> data;
+	    if (!ParseHex(argv[i + 2], data) || data.empty() || data.size() % 16 != 0 || data.size() > NTAG_FRAME_MAX_BLOCKS * 16)
+		return Usage(argv[0]);
+	    queued.ticket = client.QueueWrite(strtoul(argv[i + 1], NULL, 0), &data[0], data.size() / 16);
+	    i += 2;
+	}
+	else if (strcmp(argv[i], "erase") == 0 && remaining >= 2)
+	{
+	    queued.ticket = client.QueueErase(strtoul(argv[i + 1], NULL, 0), strtoul(argv[i + 2], NULL, 0));
+	    i += 2;
+	}
+	else if (strcmp(argv[i], "session") == 0 || strcmp(argv[i], "config") == 0)
+	{
+	    queued.data.resize(8);
+	    if (argv[i][0] == 's')
+		queued.ticket = client.QueueReadSession(&queued.data[0]);
+	    else
+		queued.ticket = client.QueueReadConfig(&queued.data[0]);
+	}
+	else if (strcmp(argv[i], "stats") == 0)
+	{
+	    queued.data.resize(NTAG_FRAME_STATS_LENGTH);
+	    queued.ticket = client.QueueReadStats(&queued.data[0]);
+	}
+	else if (strcmp(argv[i], "session-write") == 0 && remaining >= 3)
+	{
+	    queued.ticket = client.QueueWriteSession(strtoul(argv[i + 1], NULL, 0), strtoul(argv[i + 2], NULL, 0),
+						     strtoul(argv[i + 3], NULL, 0));
+	    i += 3;
+	}
+	else
+	{
+	    return Usage(argv[0]);
+	}
+    }
+
+    bool ok = client.Flush();
+
+    for (size_t i = 0; i < commands.size(); i++)
+    {
+	uint8_t status = client.Status(commands[i].ticket);
+	printf("%s: status 0x%02X\n", commands[i].name, status);
+	if (status != NTAG_STATUS_OK || commands[i].data.empty())
+	    continue;
+	if (strcmp(commands[i].name, "stats") == 0)
+	    PrintStats(commands[i].data);
+	else
+	    PrintBlocks(commands[i].first_block, commands[i].data);
+    }
+    fprintf(stderr, "%lu frames, %lu bytes sent\n", client.FramesSent(), client.BytesSent());
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,845 @@
+/**************************************************************************/
+/*!
+    @file     main.cpp
+    @author   AtoM
+	@license  BSD (see license.txt)
+
+Shared access to tags on a Linux gateway: the daemon owns each tag and
+serves local clients over a Unix socket with the command frames of
+nfc_dynamic_tag_frame.h. NTAG_Client and ntag_command work unchanged with
+the socket path in place of the serial device.
+
+	ntag_daemon [--stats <seconds>] <socket path> <serial device | sim | sim2k>...
+
+A tag is a serial device with the NTAGMemoryDumpSketch in command mode,
+or a simulated NT3H1101 (sim) or NT3H1201 (sim2k): a child process runs
+the NTAG_CommandServer of the library against lib/ntag_sim and answers at
+the pace of the simulated bus and EEPROM writes.
+
+The requests received while a tag executes the previous ones are queued,
+then run as one round sent to the tag with a single NTAG_Client::Flush()
+(batched and pipelined). In a round:
+	- reads of the same block range share one tag command, and so do the
+	  session and configuration register reads
+	- writes, erases and session register writes run in arrival order; a
+	  read never shares a read planned before a write touching its blocks
+	- each client gets its responses in the order of its requests
+
+The client sockets are non-blocking: responses a client does not read
+at once wait in its output buffer, sent when the socket is writable. A
+client letting more than CLIENT_OUTPUT_MAX bytes pile up is disconnected,
+so that neither the tag nor the other clients wait for it.
+
+CMD_STATS is answered by the daemon itself: clients, queue depth (the
+requests of the last round), requests, tag commands, coalesced reads and
+latency from the request received to the response sent. --stats prints
+the same on stderr every <seconds>.
+
+*/
+/**************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "nfc_dynamic_tag.h"
+#include "ntag_client.h"
+#include "ntag_frame_parser.h"
+#include "ntag_host_port.h"
+#include "ntag_sim_tag.h"
+
+#define BOOTLOADER_DELAY_MS 2000 //opening the port resets the UNO
+#define LISTEN_BACKLOG 16
+#define LOCAL_COMMAND -1 //request answered by the daemon
+#define CLIENT_OUTPUT_MAX 65536 //responses waiting for a client that does not read them
+
+struct Client
+{
+    unsigned long id;
+    int fd;
+    NTAG_FrameParser parser;
+    std::vector<uint8_t> output; //responses not sent yet
+    bool closed;		 //disconnected at the next poll
+};
+
+struct Request
+{
+    unsigned long client;
+    uint8_t type;
+    uint8_t seq;
+    std::vector<uint8_t> arguments; //payload after the sequence number
+    long received_us;
+    int command;    //tag command answering it, or LOCAL_COMMAND
+    uint8_t status; //LOCAL_COMMAND status
+    uint8_t count;  //sub-commands of a batch
+};
+
+struct Command
+{
+    uint8_t type;
+    uint8_t first_block;
+    uint8_t nb_blocks;
+    const std::vector<uint8_t> *arguments; //of the request it was planned for
+    std::vector<uint8_t> data;
+    int ticket;
+};
+
+struct Stats
+{
+    unsigned long requests;
+    unsigned long commands;
+    unsigned long coalesced;
+    unsigned int depth; //requests of the last round
+    unsigned int max_depth;
+    unsigned long long latency_us; //sum over the requests
+    unsigned long max_latency_us;
+};
+
+struct Tag
+{
+    const char *socket_path;
+    const char *device;
+    int listen_fd;
+    int link_fd;
+    pid_t sim_pid;
+    NTAG_Client *link;
+    std::vector<Client> clients;
+    std::vector<Request> queue;
+    unsigned long next_client;
+    Stats stats;
+};
+
+static volatile sig_atomic_t stopping = 0;
+
+static void Stop(int signal)
+{
+    (void)signal;
+    stopping = 1;
+}
+
+static long NowUs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000L + now.tv_nsec / 1000;
+}
+
+/**************************************************************************/
+/*      Simulated tag                                                     */
+/**************************************************************************/
+
+class FdStream : public Stream
+{
+  public:
+    FdStream(int fd) : _fd(fd), _index(0) {}
+
+    int available() { return (int)(_rx.size() - _index); }
+    int read() { return _index < _rx.size() ? _rx[_index++] : -1; }
+    int peek() { return _index < _rx.size() ? _rx[_index] : -1; }
+    size_t write(uint8_t value)
+    {
+	_tx.push_back(value);
+	return 1;
+    }
+    using Print::write;
+
+    bool Receive()
+    {
+	uint8_t buffer[256];
+	ssize_t count;
+
+	do
+	{
+	    count = ::read(_fd, buffer, sizeof(buffer));
+	} while (count < 0 && errno == EINTR);
+	if (count <= 0)
+	    return false;
+	_rx.erase(_rx.begin(), _rx.begin() + _index);
+	_index = 0;
+	_rx.insert(_rx.end(), buffer, buffer + count);
+	return true;
+    }
+
+    bool Send()
+    {
+	size_t sent = 0;
+
+	while (sent < _tx.size())
+	{
+	    ssize_t count = ::write(_fd, &_tx[sent], _tx.size() - sent);
+	    if (count < 0 && errno != EINTR)
+		return false;
+	    if (count > 0)
+		sent += count;
+	}
+	_tx.clear();
+	return true;
+    }
+
+  private:
+    int _fd;
+    std::vector<uint8_t> _rx;
+    size_t _index;
+    std::vector<uint8_t> _tx;
+};
+
+/**************************************************************************/
+/*! SimTagLoop(int fd, uint8_t dynamic_lock_block)
+    @brief  Child process of a simulated tag: the sketch side of the
+			command interface, NTAG_CommandServer on the simulated tag.
+			Responses are held for the simulated time of the commands, so
+			the daemon sees the latency of a real tag.
+    @param  fd					Link to the daemon
+    @param  dynamic_lock_block	NTAG_I2C_DYNAMIC_LOCK_BLOCK or NTAG_I2C_2K_DYNAMIC_LOCK_BLOCK
+*/
+/**************************************************************************/
+
+static void SimTagLoop(int fd, uint8_t dynamic_lock_block)
+{
+    NTAG_SimTag tag(dynamic_lock_block);
+    NXP_NTAG_I2C ntag(NTAG_SIM_I2C_ADDRESS);
+    FdStream port(fd);
+    NTAG_CommandServer server(ntag, port);
+
+    Serial.SetOutput(NULL);
+    Wire.Attach(&tag);
+    Wire.setClock(NTAG_SIM_I2C_CLOCK);
+    ntag.begin();
+    while (port.Receive())
+    {
+	uint64_t start = NTAG_SimMicros();
+	server.Poll();
+	usleep((useconds_t)(NTAG_SimMicros() - start));
+	if (!port.Send())
+	    break;
+    }
+}
+
+/**************************************************************************/
+/*! OpenLink(Tag &tag, const std::vector<Tag> &tags)
+    @brief  Open the serial device of the tag, or start its simulated tag
+			with a socket pair as the serial link. Return false on error.
+    @param  tag
+    @param  tags		All the tags, their links are closed in the child
+*/
+/**************************************************************************/
+
+static bool OpenLink(Tag &tag, const std::vector<Tag> &tags)
+{
+    bool sim = strcmp(tag.device, "sim") == 0;
+    bool sim2k = strcmp(tag.device, "sim2k") == 0;
+
+    tag.sim_pid = -1;
+    if (!sim && !sim2k)
+    {
+	tag.link_fd = NTAG_OpenPort(tag.device);
+	if (tag.link_fd < 0)
+	    return false;
+	if (isatty(tag.link_fd))
+	    usleep(BOOTLOADER_DELAY_MS * 1000);
+	return true;
+    }
+
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0)
+	return false;
+    tag.sim_pid = fork();
+    if (tag.sim_pid < 0)
+	return false;
+    if (tag.sim_pid == 0)
+    {
+	signal(SIGINT, SIG_IGN); //the daemon stops it by closing the link
+	close(pair[0]);
+	for (size_t i = 0; i < tags.size(); i++)
+	{
+	    if (&tags[i] != &tag && tags[i].link_fd >= 0)
+		close(tags[i].link_fd);
+	}
+	SimTagLoop(pair[1], sim2k ? NTAG_I2C_2K_DYNAMIC_LOCK_BLOCK : NTAG_I2C_DYNAMIC_LOCK_BLOCK);
+	_exit(0);
+    }
+    close(pair[1]);
+    tag.link_fd = pair[0];
+    return true;
+}
+
+/**************************************************************************/
+/*      Clients                                                           */
+/**************************************************************************/
+
+static int Listen(const char *path)
+{
+    struct sockaddr_un address;
+
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+	errno = ENAMETOOLONG;
+	return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    unlink(path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+	return -1;
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, LISTEN_BACKLOG) != 0)
+    {
+	close(fd);
+	return -1;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    return fd;
+}
+
+static void Accept(Tag &tag)
+{
+    int fd;
+
+    while ((fd = accept(tag.listen_fd, NULL, NULL)) >= 0)
+    {
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	tag.clients.push_back(Client());
+	tag.clients.back().id = tag.next_client++;
+	tag.clients.back().fd = fd;
+	tag.clients.back().closed = false;
+    }
+}
+
+/**************************************************************************/
+/*! SendOutput(Client &client)
+    @brief  Send what the socket of the client takes of its output buffer.
+			Return false when the connection failed.
+*/
+/**************************************************************************/
+
+static bool SendOutput(Client &client)
+{
+    while (!client.output.empty())
+    {
+	ssize_t count = send(client.fd, &client.output[0], client.output.size(), MSG_NOSIGNAL);
+	if (count < 0 && errno == EINTR)
+	    continue;
+	if (count < 0)
+	    return errno == EAGAIN || errno == EWOULDBLOCK;
+	client.output.erase(client.output.begin(), client.output.begin() + count);
+    }
+    return true;
+}
+
+static void DropClosed(Tag &tag)
+{
+    for (size_t i = 0; i < tag.clients.size();)
+    {
+	if (!tag.clients[i].closed)
+	{
+	    i++;
+	    continue;
+	}
+	close(tag.clients[i].fd);
+	tag.clients.erase(tag.clients.begin() + i);
+    }
+}
+
+/**************************************************************************/
+/*! Respond(Tag &tag, const Request &request, uint8_t status, const uint8_t *data, uint8_t length)
+    @brief  Send a RESPONSE frame to the client of the request, if it is
+			still connected, through its output buffer, and account its
+			latency. The client is closed when the buffer would overflow.
+*/
+/**************************************************************************/
+
+static void Respond(Tag &tag, const Request &request, uint8_t status, const uint8_t *data, uint8_t length)
+{
+    uint8_t frame[NTAG_FRAME_HEADER_LENGTH + NTAG_FRAME_MAX_PAYLOAD + NTAG_FRAME_CRC_LENGTH];
+    size_t size = 0;
+    uint16_t crc = NTAG_FRAME_CRC_INIT;
+
+    frame[size++] = NTAG_FRAME_SOF;
+    frame[size++] = NTAG_FRAME_RESPONSE;
+    frame[size++] = 2 + length;
+    frame[size++] = request.seq;
+    frame[size++] = status;
+    if (length > 0)
+	memcpy(&frame[size], data, length);
+    size += length;
+    for (size_t i = 1; i < size; i++)
+    {
+	crc = NTAG_FrameCRC16(crc, frame[i]);
+    }
+    frame[size++] = crc >> 8;
+    frame[size++] = crc & 0xFF;
+
+    for (size_t i = 0; i < tag.clients.size(); i++)
+    {
+	Client &client = tag.clients[i];
+	if (client.id != request.client)
+	    continue;
+	if (client.closed)
+	    break;
+	if (client.output.size() + size > CLIENT_OUTPUT_MAX)
+	{
+	    client.closed = true;
+	    break;
+	}
+	client.output.insert(client.output.end(), frame, frame + size);
+	if (!SendOutput(client))
+	    client.closed = true;
+	break;
+    }
+
+    if (request.type == NTAG_FRAME_CMD_STATS)
+	return;
+    unsigned long latency = NowUs() - request.received_us;
+    tag.stats.requests++;
+    tag.stats.latency_us += latency;
+    if (latency > tag.stats.max_latency_us)
+	tag.stats.max_latency_us = latency;
+}
+
+static void Put(uint8_t *out, unsigned long value, uint8_t length)
+{
+    for (uint8_t i = 0; i < length; i++)
+    {
+	out[i] = (uint8_t)(value >> (8 * (length - 1 - i)));
+    }
+}
+
+static void StatsPayload(const Tag &tag, uint8_t *out)
+{
+    const Stats &stats = tag.stats;
+    unsigned long average = stats.requests > 0 ? (unsigned long)(stats.latency_us / stats.requests) : 0;
+
+    Put(&out[0], tag.clients.size(), 2);
+    Put(&out[2], stats.depth, 2);
+    Put(&out[4], stats.max_depth, 2);
+    Put(&out[6], stats.requests, 4);
+    Put(&out[10], stats.commands, 4);
+    Put(&out[14], stats.coalesced, 4);
+    Put(&out[18], average, 4);
+    Put(&out[22], stats.max_latency_us, 4);
+}
+
+static void PrintStats(const Tag &tag)
+{
+    const Stats &stats = tag.stats;
+
+    fprintf(stderr, "%s: %zu clients, queue depth %u (largest %u), %lu requests, %lu tag commands, %lu coalesced reads, latency %lu us average, %lu us largest\n",
+	    tag.socket_path, tag.clients.size(), stats.depth, stats.max_depth, stats.requests, stats.commands, stats.coalesced,
+	    stats.requests > 0 ? (unsigned long)(stats.latency_us / stats.requests) : 0, stats.max_latency_us);
+}
+
+/**************************************************************************/
+/*! Enqueue(Tag &tag, const Client &client, const NTAG_Frame &frame)
+    @brief  Queue the request of a command frame, or its sub-commands then
+			itself for a batch. Requests with a bad length, unknown
+			commands and CMD_STATS are answered by the daemon, in their
+			turn.
+*/
+/**************************************************************************/
+
+static bool ValidLength(uint8_t type, size_t length)
+{
+    switch (type)
+    {
+    case NTAG_FRAME_CMD_READ:
+    case NTAG_FRAME_CMD_ERASE:
+	return length == 2;
+    case NTAG_FRAME_CMD_WRITE:
+	return length >= 1 + 16 && (length - 1) % 16 == 0;
+    case NTAG_FRAME_CMD_WRITE_SESSION:
+	return length == 3;
+    default:
+	return length == 0;
+    }
+}
+
+static void Add(Tag &tag, const Client &client, uint8_t type, const uint8_t *payload, uint8_t length, long now)
+{
+    Request request;
+
+    request.client = client.id;
+    request.type = type;
+    request.seq = payload[0];
+    request.arguments.assign(&payload[1], &payload[length]);
+    request.received_us = now;
+    request.command = LOCAL_COMMAND;
+    request.status = NTAG_STATUS_OK;
+    request.count = 0;
+    switch (type)
+    {
+    case NTAG_FRAME_CMD_READ:
+    case NTAG_FRAME_CMD_WRITE:
+    case NTAG_FRAME_CMD_ERASE:
+    case NTAG_FRAME_CMD_READ_SESSION:
+    case NTAG_FRAME_CMD_READ_CONFIG:
+    case NTAG_FRAME_CMD_WRITE_SESSION:
+	if (!ValidLength(type, request.arguments.size()) ||
+	    (type == NTAG_FRAME_CMD_READ && request.arguments[1] > NTAG_FRAME_MAX_BLOCKS) ||
+	    (type == NTAG_FRAME_CMD_WRITE && request.arguments.size() > 1 + NTAG_FRAME_MAX_BLOCKS * 16))
+	    request.status = NTAG_STATUS_BAD_LENGTH;
+	else
+	    request.command = 0; //planned in the round
+	break;
+    case NTAG_FRAME_CMD_STATS:
+	break;
+    default:
+	request.status = NTAG_STATUS_UNKNOWN_COMMAND;
+	break;
+    }
+    tag.queue.push_back(request);
+}
+
+static void Enqueue(Tag &tag, const Client &client, const NTAG_Frame &frame)
+{
+    long now = NowUs();
+
+    if (frame.length < 1)
+	return;
+    if (frame.type != NTAG_FRAME_CMD_BATCH)
+    {
+	Add(tag, client, frame.type, frame.payload, frame.length, now);
+	return;
+    }
+
+    uint8_t index = 1;
+    uint8_t count = 0;
+    while (index + 2 <= frame.length && index + 2 + frame.payload[index + 1] <= frame.length)
+    {
+	if (frame.payload[index + 1] >= 1)
+	{
+	    uint8_t type = frame.payload[index] == NTAG_FRAME_CMD_BATCH ? 0 : frame.payload[index]; //batches do not nest
+	    Add(tag, client, type, &frame.payload[index + 2], frame.payload[index + 1], now);
+	}
+	count++;
+	index += 2 + frame.payload[index + 1];
+    }
+    Add(tag, client, NTAG_FRAME_CMD_BATCH, frame.payload, 1, now);
+    tag.queue.back().status = index == frame.length ? NTAG_STATUS_OK : NTAG_STATUS_BAD_LENGTH;
+    tag.queue.back().count = count;
+}
+
+/**************************************************************************/
+/*! ReadClient(Tag &tag, Client &client)
+    @brief  Queue the frames received from a client. Return false when it
+			closed the connection.
+*/
+/**************************************************************************/
+
+static bool ReadClient(Tag &tag, Client &client)
+{
+    uint8_t buffer[512];
+    ssize_t count = recv(client.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+
+    if (count == 0 || (count < 0 && errno != EAGAIN && errno != EINTR))
+	return false;
+    if (count < 0)
+	return true;
+    client.parser.Feed(buffer, count);
+    NTAG_Frame frame;
+    while (client.parser.Next(frame))
+    {
+	Enqueue(tag, client, frame);
+    }
+    return true;
+}
+
+/**************************************************************************/
+/*      Rounds                                                            */
+/**************************************************************************/
+
+static bool Overlap(const Command &command, uint8_t first_block, uint8_t nb_blocks)
+{
+    return command.first_block < first_block + nb_blocks && first_block < command.first_block + command.nb_blocks;
+}
+
+/**************************************************************************/
+/*! Plan(std::vector<Command> &commands, std::vector<int> &shared, Request &request)
+    @brief  Find the tag command answering a request: a read of the same
+			range planned earlier in the round, or a new command. Only the
+			same range is shared, so that the status is the one the read
+			would get alone. A write removes the reads it touches from the
+			shared ones, so that later reads get the written data.
+    @param  commands	Tag commands of the round, in order
+    @param  shared		Commands later reads may share
+    @param  request
+    Return true when the request shares an earlier command
+*/
+/**************************************************************************/
+
+static bool Plan(std::vector<Command> &commands, std::vector<int> &shared, Request &request)
+{
+    Command command;
+    const std::vector<uint8_t> &arguments = request.arguments;
+
+    command.type = request.type;
+    command.first_block = 0;
+    command.nb_blocks = 0;
+    command.arguments = &request.arguments;
+    command.ticket = -1;
+    switch (request.type)
+    {
+    case NTAG_FRAME_CMD_READ:
+	command.first_block = arguments[0];
+	command.nb_blocks = arguments[1];
+	command.data.resize(command.nb_blocks * 16);
+	break;
+    case NTAG_FRAME_CMD_READ_SESSION:
+    case NTAG_FRAME_CMD_READ_CONFIG:
+	command.data.resize(8);
+	break;
+    case NTAG_FRAME_CMD_WRITE:
+	command.first_block = arguments[0];
+	command.nb_blocks = (arguments.size() - 1) / 16;
+	break;
+    case NTAG_FRAME_CMD_ERASE:
+	command.first_block = arguments[0];
+	command.nb_blocks = arguments[1];
+	break;
+    }
+
+    bool read = request.type == NTAG_FRAME_CMD_READ || request.type == NTAG_FRAME_CMD_READ_SESSION ||
+		request.type == NTAG_FRAME_CMD_READ_CONFIG;
+    for (size_t i = 0; read && i < shared.size(); i++)
+    {
+	const Command &planned = commands[shared[i]];
+	if (planned.type == request.type && planned.first_block == command.first_block && planned.nb_blocks == command.nb_blocks)
+	{
+	    request.command = shared[i];
+	    return true;
+	}
+    }
+
+    // Writes: forget the reads they change, registers included
+    for (size_t i = 0; !read && i < shared.size();)
+    {
+	const Command &planned = commands[shared[i]];
+	bool changed = planned.type != NTAG_FRAME_CMD_READ ||
+		       (request.type != NTAG_FRAME_CMD_WRITE_SESSION && Overlap(planned, command.first_block, command.nb_blocks));
+	if (changed)
+	    shared.erase(shared.begin() + i);
+	else
+	    i++;
+    }
+
+    request.command = (int)commands.size();
+    commands.push_back(command);
+    if (read)
+	shared.push_back(request.command);
+    return false;
+}
+
+static int Queue(NTAG_Client &link, Command &command)
+{
+    const std::vector<uint8_t> &arguments = *command.arguments;
+
+    switch (command.type)
+    {
+    case NTAG_FRAME_CMD_READ:
+	return link.QueueRead(command.first_block, command.nb_blocks, command.data.empty() ? NULL : &command.data[0]);
+    case NTAG_FRAME_CMD_WRITE:
+	return link.QueueWrite(command.first_block, &arguments[1], command.nb_blocks);
+    case NTAG_FRAME_CMD_ERASE:
+	return link.QueueErase(command.first_block, command.nb_blocks);
+    case NTAG_FRAME_CMD_READ_SESSION:
+	return link.QueueReadSession(&command.data[0]);
+    case NTAG_FRAME_CMD_READ_CONFIG:
+	return link.QueueReadConfig(&command.data[0]);
+    default:
+	return link.QueueWriteSession(arguments[0], arguments[1], arguments[2]);
+    }
+}
+
+/**************************************************************************/
+/*! RunRound(Tag &tag)
+    @brief  Plan the queued requests, send the tag commands in one Flush()
+			and answer the requests in order
+*/
+/**************************************************************************/
+
+static void RunRound(Tag &tag)
+{
+    std::vector<Request> round;
+    std::vector<Command> commands;
+    std::vector<int> shared;
+
+    round.swap(tag.queue);
+    tag.stats.depth = round.size();
+    if (tag.stats.depth > tag.stats.max_depth)
+	tag.stats.max_depth = tag.stats.depth;
+
+    for (size_t i = 0; i < round.size(); i++)
+    {
+	if (round[i].command != LOCAL_COMMAND && Plan(commands, shared, round[i]))
+	    tag.stats.coalesced++;
+    }
+    for (size_t i = 0; i < commands.size(); i++)
+    {
+	commands[i].ticket = Queue(*tag.link, commands[i]);
+    }
+    if (!commands.empty())
+	tag.link->Flush();
+    tag.stats.commands += commands.size();
+
+    for (size_t i = 0; i < round.size(); i++)
+    {
+	Request &request = round[i];
+	if (request.command == LOCAL_COMMAND)
+	{
+	    uint8_t stats[NTAG_FRAME_STATS_LENGTH];
+	    if (request.type == NTAG_FRAME_CMD_STATS && request.status == NTAG_STATUS_OK)
+	    {
+		StatsPayload(tag, stats);
+		Respond(tag, request, NTAG_STATUS_OK, stats, sizeof(stats));
+	    }
+	    else
+	    {
+		Respond(tag, request, request.status, &request.count, request.type == NTAG_FRAME_CMD_BATCH ? 1 : 0);
+	    }
+	    continue;
+	}
+
+	const Command &command = commands[request.command];
+	uint8_t status = tag.link->Status(command.ticket);
+	bool data = status == NTAG_STATUS_OK && !command.data.empty();
+	Respond(tag, request, status, data ? &command.data[0] : NULL, data ? command.data.size() : 0);
+    }
+    tag.link->Clear();
+}
+
+static int Usage(const char *program)
+{
+    fprintf(stderr, "usage: %s [--stats <seconds>] <socket path> <serial device | sim | sim2k>...\n", program);
+    return 2;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<Tag> tags;
+    long stats_us = 0;
+    int arg = 1;
+
+    if (arg + 1 < argc && strcmp(argv[arg], "--stats") == 0)
+    {
+	stats_us = strtol(argv[arg + 1], NULL, 0) * 1000000L;
+	arg += 2;
+    }
+    if (arg >= argc || (argc - arg) % 2 != 0)
+	return Usage(argv[0]);
+    tags.resize((argc - arg) / 2);
+    for (size_t i = 0; i < tags.size(); i++)
+    {
+	Tag &tag = tags[i];
+	tag.socket_path = argv[arg + 2 * i];
+	tag.device = argv[arg + 2 * i + 1];
+	tag.listen_fd = tag.link_fd = -1;
+	tag.link = NULL;
+	tag.next_client = 0;
+	memset(&tag.stats, 0, sizeof(tag.stats));
+    }
+
+    // Links first, the simulated tags do not inherit the client sockets
+    for (size_t i = 0; i < tags.size(); i++)
+    {
+	if (!OpenLink(tags[i], tags))
+	{
+	    perror(tags[i].device);
+	    return 1;
+	}
+	tags[i].link = new NTAG_Client(tags[i].link_fd);
+    }
+    for (size_t i = 0; i < tags.size(); i++)
+    {
+	tags[i].listen_fd = Listen(tags[i].socket_path);
+	if (tags[i].listen_fd < 0)
+	{
+	    perror(tags[i].socket_path);
+	    return 1;
+	}
+    }
+    signal(SIGINT, Stop);
+    signal(SIGTERM, Stop);
+    signal(SIGPIPE, SIG_IGN);
+
+    long next_stats = NowUs() + stats_us;
+    while (!stopping)
+    {
+	std::vector<struct pollfd> fds;
+	for (size_t i = 0; i < tags.size(); i++)
+	{
+	    DropClosed(tags[i]);
+	    struct pollfd fd = {tags[i].listen_fd, POLLIN, 0};
+	    fds.push_back(fd);
+	    for (size_t j = 0; j < tags[i].clients.size(); j++)
+	    {
+		fd.fd = tags[i].clients[j].fd;
+		fd.events = tags[i].clients[j].output.empty() ? POLLIN : POLLIN | POLLOUT;
+		fds.push_back(fd);
+	    }
+	}
+	int timeout = -1;
+	if (stats_us > 0)
+	    timeout = next_stats > NowUs() ? (int)((next_stats - NowUs()) / 1000) + 1 : 0;
+	if (poll(&fds[0], fds.size(), timeout) < 0 && errno != EINTR)
+	    break;
+
+	size_t index = 0;
+	for (size_t i = 0; i < tags.size(); i++)
+	{
+	    Tag &tag = tags[i];
+	    bool accept = fds[index++].revents != 0;
+	    for (size_t j = 0; j < tag.clients.size(); j++, index++)
+	    {
+		Client &client = tag.clients[j];
+		if ((fds[index].revents & POLLOUT) && !SendOutput(client))
+		    client.closed = true;
+		if ((fds[index].revents & ~POLLOUT) && !client.closed && !ReadClient(tag, client))
+		    client.closed = true;
+	    }
+	    if (accept)
+		Accept(tag);
+	}
+	for (size_t i = 0; i < tags.size(); i++)
+	{
+	    if (!tags[i].queue.empty())
+		RunRound(tags[i]);
+	}
+	if (stats_us > 0 && NowUs() >= next_stats)
+	{
+	    for (size_t i = 0; i < tags.size(); i++)
+	    {
+		PrintStats(tags[i]);
+	    }
+	    next_stats += stats_us;
+	}
+    }
+
+    for (size_t i = 0; i < tags.size(); i++)
+    {
+	Tag &tag = tags[i];
+	for (size_t j = 0; j < tag.clients.size(); j++)
+	{
+	    close(tag.clients[j].fd);
+	}
+	close(tag.listen_fd);
+	unlink(tag.socket_path);
+	close(tag.link_fd);
+	if (tag.sim_pid > 0)
+	    waitpid(tag.sim_pid, NULL, 0);
+	delete tag.link;
+    }
+    return 0;
+}
@@ -0,0 +1,322 @@
+/**************************************************************************/
+/*!
+    @file     main.cpp
+    @author   AtoM
+	@license  BSD (see license.txt)
+
+Host side of the ProvisioningSketch: streams tag images written by
+Snapshot() (see library/nfc_dynamic_tag_image.h) in IMAGE_DATA / IMAGE_END
+frames and prints the IMAGE_STATUS of each one.
+
+	provision [--max-image bytes] <serial device> image...
+
+Images larger than the image buffers of the sketch, NTAG_PROVISION_IMAGE_MAX
+bytes unless --max-image gives the value the sketch was built with, are
+refused before anything is sent.
+The Arduino holds two images, so the next image is sent while the
+current one is programmed; the image after that waits for the status of
+the first. IMAGE_DATA frames are pipelined within NTAG_FRAME_RX_WINDOW
+bytes, as the commands of ntag_command.
+
+*/
+/**************************************************************************/
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <deque>
+#include <vector>
+
+#include "nfc_dynamic_tag_image.h"
+#include "ntag_frame_parser.h"
+#include "ntag_host_port.h"
+
+#define BOOTLOADER_DELAY_MS 2000 //opening the port resets the UNO
+#define TIMEOUT_MS 5000		 //without any frame, longer than programming a 2k tag
+#define IMAGES_AHEAD 2		 //image buffers of NTAG_Provisioner
+
+struct Image
+{
+    const char *path;
+    std::vector<uint8_t> data;
+    int status; //-1 until the IMAGE_STATUS
+    uint16_t receive_ms;
+    uint16_t program_ms;
+    uint16_t verify_ms;
+};
+
+struct InFlight
+{
+    size_t size;
+    uint8_t seq;
+};
+
+static long NowMs()
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return now.tv_sec * 1000L + now.tv_usec / 1000;
+}
+
+static const char *StatusName(int status)
+{
+    switch (status)
+    {
+    case NTAG_IMAGE_OK:
+	return "ok";
+    case NTAG_IMAGE_BAD_FORMAT:
+	return "bad format";
+    case NTAG_IMAGE_BAD_CRC:
+	return "bad CRC";
+    case NTAG_IMAGE_WRONG_MAP:
+	return "wrong chip";
+    case NTAG_IMAGE_LOCKED:
+	return "locked";
+    case NTAG_PROVISION_VERIFY_FAILED:
+	return "verify failed";
+    case NTAG_PROVISION_TOO_LONG:
+	return "too long";
+    case NTAG_PROVISION_BUSY:
+	return "busy";
+    default:
+	return "no answer";
+    }
+}
+
+static bool ReadFile(const char *path, std::vector<uint8_t> &out)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+	return false;
+    uint8_t buffer[1024];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+	out.insert(out.end(), buffer, buffer + count);
+    }
+    fclose(file);
+    return true;
+}
+
+static void BuildFrame(std::vector<uint8_t> &frame, uint8_t type, uint8_t seq, const uint8_t *data, size_t length)
+{
+    uint16_t crc = NTAG_FrameCRC16(NTAG_FRAME_CRC_INIT, type);
+
+    crc = NTAG_FrameCRC16(crc, (uint8_t)(1 + length));
+    crc = NTAG_FrameCRC16(crc, seq);
+    frame.clear();
+    frame.push_back(NTAG_FRAME_SOF);
+    frame.push_back(type);
+    frame.push_back((uint8_t)(1 + length));
+    frame.push_back(seq);
+    for (size_t i = 0; i < length; i++)
+    {
+	crc = NTAG_FrameCRC16(crc, data[i]);
+	frame.push_back(data[i]);
+    }
+    frame.push_back(crc >> 8);
+    frame.push_back(crc & 0xFF);
+}
+
+static bool Send(int fd, const std::vector<uint8_t> &frame)
+{
+    size_t sent = 0;
+
+    while (sent < frame.size())
+    {
+	ssize_t count = write(fd, &frame[sent], frame.size() - sent);
+	if (count < 0 && errno != EINTR)
+	    return false;
+	if (count > 0)
+	    sent += count;
+    }
+    return true;
+}
+
+/**************************************************************************/
+/*! Acknowledge(std::deque<InFlight> &in_flight, uint8_t seq)
+    @brief  The Arduino consumes the frames in order: a frame answered
+			means that every frame sent before it left its receive buffer
+*/
+/**************************************************************************/
+
+static void Acknowledge(std::deque<InFlight> &in_flight, uint8_t seq)
+{
+    for (size_t i = 0; i < in_flight.size(); i++)
+    {
+	if (in_flight[i].seq != seq)
+	    continue;
+	in_flight.erase(in_flight.begin(), in_flight.begin() + i + 1);
+	return;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long max_image = NTAG_PROVISION_IMAGE_MAX;
+    int first_arg = 1;
+    if (argc > 2 && strcmp(argv[1], "--max-image") == 0)
+    {
+	max_image = strtoul(argv[2], NULL, 0);
+	first_arg = 3;
+    }
+    if (argc < first_arg + 2 || max_image == 0)
+    {
+	fprintf(stderr, "usage: %s [--max-image bytes] <serial device> image...\n", argv[0]);
+	return 2;
+    }
+    const char *device = argv[first_arg];
+
+    std::vector<Image> images(argc - first_arg - 1);
+    for (size_t i = 0; i < images.size(); i++)
+    {
+	Image &image = images[i];
+	image.path = argv[first_arg + 1 + i];
+	image.status = -1;
+	image.receive_ms = image.program_ms = image.verify_ms = 0;
+	if (!ReadFile(image.path, image.data))
+	{
+	    perror(image.path);
+	    return 1;
+	}
+	uint8_t status = NTAG_IMAGE_BAD_FORMAT;
+	if (!image.data.empty())
+	    status = NTAG_ImageCheck(&image.data[0], image.data.size());
+	if (status != NTAG_IMAGE_OK)
+	{
+	    fprintf(stderr, "%s: %s\n", image.path, StatusName(status));
+	    return 1;
+	}
+	image.data.resize((image.data[NTAG_IMAGE_OFFSET_LENGTH] << 8) | image.data[NTAG_IMAGE_OFFSET_LENGTH + 1]);
+	if (image.data.size() > max_image)
+	{
+	    fprintf(stderr, "%s: %zu bytes, the sketch holds images of %lu bytes at most\n", image.path, image.data.size(),
+		    max_image);
+	    return 1;
+	}
+    }
+
+    int fd = NTAG_OpenPort(device);
+    if (fd < 0)
+    {
+	perror(device);
+	return 1;
+    }
+    if (isatty(fd))
+	usleep(BOOTLOADER_DELAY_MS * 1000);
+
+    NTAG_FrameParser parser;
+    std::deque<InFlight> in_flight;
+    std::vector<uint8_t> frame;
+    std::vector<int> by_seq(256, -1); //image of each IMAGE_END in flight
+    size_t sending = 0;		      //image being sent
+    size_t offset = 0;		      //next byte of it
+    size_t done = 0;		      //IMAGE_STATUS received
+    uint8_t next_seq = 0;
+    bool failed = false;
+    long start = NowMs();
+    long deadline = start + TIMEOUT_MS;
+
+    while (done < images.size())
+    {
+	// Next frame: a chunk of the image, or its end once all of it is sent
+	if (frame.empty() && sending < images.size() && sending < done + IMAGES_AHEAD)
+	{
+	    Image &image = images[sending];
+	    uint8_t seq = next_seq++;
+	    if (offset < image.data.size())
+	    {
+		size_t length = image.data.size() - offset;
+		if (length > NTAG_PROVISION_MAX_CHUNK)
+		    length = NTAG_PROVISION_MAX_CHUNK;
+		BuildFrame(frame, NTAG_FRAME_IMAGE_DATA, seq, &image.data[offset], length);
+		offset += length;
+	    }
+	    else
+	    {
+		BuildFrame(frame, NTAG_FRAME_IMAGE_END, seq, NULL, 0);
+		by_seq[seq] = (int)sending;
+		sending++;
+		offset = 0;
+	    }
+	    in_flight.push_back(InFlight());
+	    in_flight.back().size = frame.size();
+	    in_flight.back().seq = seq;
+	}
+
+	// Send it when everything not acknowledged yet fits in the receive buffer
+	if (!frame.empty())
+	{
+	    size_t queued = 0;
+	    for (size_t i = 0; i < in_flight.size(); i++)
+	    {
+		queued += in_flight[i].size;
+	    }
+	    if (queued <= NTAG_FRAME_RX_WINDOW)
+	    {
+		if (!Send(fd, frame))
+		    break;
+		frame.clear();
+		continue;
+	    }
+	}
+
+	// Collect responses and statuses
+	struct pollfd fds;
+	fds.fd = fd;
+	fds.events = POLLIN;
+	long remaining = deadline - NowMs();
+	if (remaining <= 0 || poll(&fds, 1, (int)remaining) <= 0)
+	    break;
+
+	uint8_t buffer[256];
+	ssize_t count = read(fd, buffer, sizeof(buffer));
+	if (count <= 0)
+	    break;
+	parser.Feed(buffer, count);
+	NTAG_Frame response;
+	while (parser.Next(response))
+	{
+	    if (response.length < 2)
+		continue;
+	    uint8_t seq = response.payload[0];
+	    Acknowledge(in_flight, seq);
+	    if (response.type == NTAG_FRAME_RESPONSE && response.payload[1] != NTAG_STATUS_OK)
+		failed = true;
+	    if (response.type != NTAG_FRAME_IMAGE_STATUS || response.length < NTAG_PROVISION_STATUS_LENGTH || by_seq[seq] < 0)
+		continue;
+	    Image &image = images[by_seq[seq]];
+	    by_seq[seq] = -1;
+	    image.status = response.payload[1];
+	    image.receive_ms = (response.payload[2] << 8) | response.payload[3];
+	    image.program_ms = (response.payload[4] << 8) | response.payload[5];
+	    image.verify_ms = (response.payload[6] << 8) | response.payload[7];
+	    printf("%s\t%s\treceive %u ms\tprogram %u ms\tverify %u ms\n", image.path, StatusName(image.status),
+		   image.receive_ms, image.program_ms, image.verify_ms);
+	    fflush(stdout);
+	    done++;
+	}
+	deadline = NowMs() + TIMEOUT_MS;
+    }
+
+    long elapsed = NowMs() - start;
+    unsigned long serial_ms = 0;
+    unsigned long tag_ms = 0;
+    size_t nb_ok = 0;
+    for (size_t i = 0; i < images.size(); i++)
+    {
+	if (images[i].status < 0)
+	    printf("%s\t%s\n", images[i].path, StatusName(images[i].status));
+	serial_ms += images[i].receive_ms;
+	tag_ms += images[i].program_ms + images[i].verify_ms;
+	if (images[i].status == NTAG_IMAGE_OK)
+	    nb_ok++;
+    }
+    fprintf(stderr, "%zu/%zu images programmed in %ld ms (receive %lu ms, program and verify %lu ms)\n", nb_ok,
+	    images.size(), elapsed, serial_ms, tag_ms);
+    return nb_ok == images.size() && !failed ? 0 : 1;
+}
@@ -0,0 +1,400 @@
+/**************************************************************************/
+/*!
+    @file     main.cpp
+    @author   AtoM
+	@license  BSD (see license.txt)
+
+Benchmarks of the RF side of the tag, run on the host: NXP_NTAG_I2C drives
+the simulated tag (lib/ntag_sim) through the Wire shim, NTAG_SimReader
+plays the phone or the reader. Times are simulated, see ntag_sim_tag.h and
+ntag_sim_reader.h for the model.
+
+	sim_bench [taps [update period in ms]]
+
+1. Tap latency: field on to complete NDEF message, versus the message
+   size, READ (phone and reader) and FAST_READ (reader).
+2. Contention: taps while the MCU keeps updating a record, with
+   NTAG_LiveRecord (SRAM mirror) and with plain EEPROM block rewrites.
+   A torn read is a message whose two copies of the value differ.
+3. Pass-through: SRAM throughput RF to I2C and I2C to RF, at 100 and
+   400 kHz on the I2C side.
+4. Watchdog sweep: for each watchdog time, I2C_LOCKED release measured by
+   MeasureLockRelease(), delay before a reader gets an answer after an
+   EEPROM write by the MCU, and pass-through throughput.
+
+*/
+/**************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "nfc_dynamic_tag.h"
+#include "ntag_sim_reader.h"
+#include "ntag_sim_tag.h"
+
+#define TAP_GAP_US 150000UL //between two taps
+#define UPDATE_PERIOD_MS 20   //MCU loop period during the contention taps, default
+#define PASS_THROUGH_BYTES 4096
+
+class BufferPrint : public Print
+{
+  public:
+    BufferPrint(uint8_t *buffer, size_t size) : _buffer(buffer), _size(size), _length(0) {}
+
+    size_t write(uint8_t value)
+    {
+	if (_length >= _size)
+	    return 0;
+	_buffer[_length++] = value;
+	return 1;
+    }
+    using Print::write;
+    size_t Length() const { return _length; }
+
+  private:
+    uint8_t *_buffer;
+    size_t _size;
+    size_t _length;
+};
+
+static double Milliseconds(uint64_t us)
+{
+    return us / 1000.0;
+}
+
+/**************************************************************************/
+/*! Tap(NTAG_SimReader &reader, uint8_t *message, int size, bool fast_read, uint64_t &latency_us)
+    @brief  One tap: activation and NDEF read, then field off. Return the
+			message length, -1 on failure
+*/
+/**************************************************************************/
+
+static int Tap(NTAG_SimReader &reader, uint8_t *message, int size, bool fast_read, uint64_t &latency_us)
+{
+    uint64_t start = NTAG_SimMicros();
+    int length = -1;
+
+    if (reader.Activate())
+	length = reader.ReadNDEF(message, size, fast_read);
+    latency_us = NTAG_SimMicros() - start;
+    reader.Release();
+    return length;
+}
+
+/**************************************************************************/
+/*      1. Tap latency                                                    */
+/**************************************************************************/
+
+static void TapLatency(NTAG_SimTag &tag, NXP_NTAG_I2C &ntag)
+{
+    static const uint16_t sizes[] = {16, 48, 96, 192, 384, 768};
+    static char uri[1024];
+    uint8_t message[1024];
+
+    printf("1. Tap latency, field on to NDEF message read (ms)\n\n");
+    printf("  message   phone READ   reader READ   reader FAST_READ\n");
+    for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+	// URI record: 5 bytes of record header and prefix code
+	memset(uri, 'a', sizeof(uri));
+	strcpy(uri, "https://example.com/");
+	uri[strlen(uri)] = 'a';
+	uri[sizes[i] - 5 + 8] = '\0';
+	NTAG_URIRecord record(uri);
+	NTAG_BlockWriter writer(ntag);
+	record.WriteTo(writer);
+	writer.Flush();
+
+	NTAG_SimReader phone(tag, NTAG_SimTiming::Phone());
+	NTAG_SimReader reader(tag, NTAG_SimTiming::Reader());
+	uint64_t phone_us, read_us, fast_read_us;
+	int length = Tap(phone, message, sizeof(message), false, phone_us);
+	Tap(reader, message, sizeof(message), false, read_us);
+	Tap(reader, message, sizeof(message), true, fast_read_us);
+	printf("  %7d   %10.1f   %11.1f   %16.1f\n", length, Milliseconds(phone_us), Milliseconds(read_us), Milliseconds(fast_read_us));
+    }
+    printf("\n");
+}
+
+/**************************************************************************/
+/*      2. Contention                                                     */
+/**************************************************************************/
+
+static const char contention_uri[] = "https://example.com/s?v=0000&c=0000";
+
+struct Contention
+{
+    NXP_NTAG_I2C *ntag;
+    NTAG_LiveRecord *live;
+    int16_t offsets[2];
+    uint8_t record[64];
+    uint8_t length;
+    uint8_t block; //next block of the EEPROM rewrite
+    unsigned int counter;
+};
+
+static void SetCounter(Contention &contention, uint8_t *record)
+{
+    char value[5];
+
+    snprintf(value, sizeof(value), "%04u", contention.counter % 10000);
+    for (uint8_t i = 0; i < 2; i++)
+    {
+	memcpy(&record[contention.offsets[i]], value, 4);
+    }
+}
+
+// Record kept in the SRAM mirror: new value, Update() (deferred while RF_LOCKED)
+static void LiveTask(void *context)
+{
+    Contention &contention = *(Contention *)context;
+    char value[5];
+
+    contention.counter++;
+    snprintf(value, sizeof(value), "%04u", contention.counter % 10000);
+    for (uint8_t i = 0; i < 2; i++)
+    {
+	contention.live->SetValue(contention.offsets[i], value);
+    }
+    contention.live->Update();
+}
+
+// Record in the EEPROM rewritten one block per loop, the way a sketch calling WriteDataBlock() does
+static void EEPROMTask(void *context)
+{
+    Contention &contention = *(Contention *)context;
+
+    if (contention.block == 0)
+    {
+	contention.counter++;
+	SetCounter(contention, contention.record);
+    }
+    contention.ntag->WriteDataBlock(NTAG_I2C_USER_MEMORY_BLOCK + contention.block, &contention.record[contention.block * 16], 16);
+    contention.block = (contention.block + 1) % ((contention.length + 15) / 16);
+}
+
+static bool Torn(const uint8_t *message, int length)
+{
+    const char *text = (const char *)message;
+    const char *v = (const char *)memmem(text, length, "v=", 2);
+    const char *c = (const char *)memmem(text, length, "c=", 2);
+
+    return v == NULL || c == NULL || c + 6 > text + length || memcmp(v + 2, c + 2, 4) != 0;
+}
+
+static void ContentionTaps(const char *name, NTAG_SimTag &tag, Contention &contention, void (*task)(void *), int taps, uint32_t period_ms)
+{
+    NTAG_SimReader phone(tag, NTAG_SimTiming::Phone());
+    uint8_t message[128];
+    uint64_t total_us = 0;
+    uint64_t worst_us = 0;
+    int failures = 0;
+    int torn = 0;
+
+    tag.ResetStats();
+    phone.SetBackground(task, &contention, period_ms * 1000);
+    for (int i = 0; i < taps; i++)
+    {
+	uint64_t latency_us;
+	int length = Tap(phone, message, sizeof(message), false, latency_us);
+	if (length < 0)
+	    failures++;
+	else if (Torn(message, length))
+	    torn++;
+	total_us += latency_us;
+	if (latency_us > worst_us)
+	    worst_us = latency_us;
+	phone.Wait(TAP_GAP_US);
+    }
+    phone.SetBackground(NULL, NULL, 0);
+    const NTAG_SimReaderStats &stats = phone.Stats();
+    printf("  %-12s %8.1f %8.1f %6lu %7lu %6d %5d %9lu\n", name, Milliseconds(total_us / taps), Milliseconds(worst_us),
+	   stats.naks, stats.retries, failures, torn, tag.Stats().i2c_naks);
+}
+
+static void ContentionBench(NTAG_SimTag &tag, NXP_NTAG_I2C &ntag, int taps, uint32_t period_ms)
+{
+    Contention contention;
+    NTAG_LiveRecord live(ntag);
+    NTAG_URIRecord uri(contention_uri);
+
+    memset(&contention, 0, sizeof(contention));
+    contention.ntag = &ntag;
+    contention.live = &live;
+    BufferPrint buffer(contention.record, sizeof(contention.record));
+    uri.WriteTo(buffer);
+    contention.length = buffer.Length();
+    const char *text = (const char *)contention.record;
+    contention.offsets[0] = (const char *)memmem(text, contention.length, "v=", 2) - text + 2;
+    contention.offsets[1] = (const char *)memmem(text, contention.length, "c=", 2) - text + 2;
+
+    printf("2. Contention, %d phone taps while the MCU updates the record every %lu ms\n\n", taps, (unsigned long)period_ms);
+    printf("  record       mean(ms) worst(ms)  NAKs retries failed  torn  I2C NAKs\n");
+
+    uri.WriteTo(live);
+    live.Start();
+    ContentionTaps("SRAM live", tag, contention, LiveTask, taps, period_ms);
+
+    // Back to the EEPROM: mirror off, LAST_NDEF_BLOCK cleared
+    NTAG_I2C_SessionUpdate updates[] = {{0, NTAG_I2C_NC_SRAM_MIRROR_ON_OFF, 0}, {1, 0xFF, 0x00}};
+    ntag.WriteSessionRegisters(updates, 2);
+    contention.counter = 0;
+    SetCounter(contention, contention.record);
+    ntag.WriteDataEEPROM(contention.record, contention.length);
+    ContentionTaps("EEPROM", tag, contention, EEPROMTask, taps, period_ms);
+    printf("\n");
+}
+
+/**************************************************************************/
+/*      3. Pass-through                                                   */
+/**************************************************************************/
+
+static double PassThrough(NTAG_SimTag &tag, NXP_NTAG_I2C &ntag, bool rf_to_i2c, bool fast_read, uint32_t clock)
+{
+    NTAG_SimReader reader(tag, NTAG_SimTiming::Reader());
+    uint8_t data[64];
+    uint8_t block[16];
+
+    Wire.setClock(clock);
+    reader.Activate();
+    uint8_t direction = rf_to_i2c ? NTAG_I2C_NC_PTHRU_DIR : 0;
+    ntag.WriteSessionRegister(0, NTAG_I2C_NC_PTHRU_ON_OFF | NTAG_I2C_NC_SRAM_MIRROR_ON_OFF | NTAG_I2C_NC_PTHRU_DIR,
+			      NTAG_I2C_NC_PTHRU_ON_OFF | direction);
+
+    uint64_t start = NTAG_SimMicros();
+    unsigned int transferred = 0;
+    bool ok = true;
+    while (ok && transferred < PASS_THROUGH_BYTES)
+    {
+	memset(data, transferred / 64, sizeof(data));
+	if (rf_to_i2c)
+	{
+	    for (uint8_t page = 0; ok && page < 16; page++)
+	    {
+		ok = reader.Write(0xF0 + page, &data[page * 4]) == NTAG_SIM_ACK;
+	    }
+	    while (ok && !(ntag.ReadSessionRegister(6) & NTAG_I2C_NS_SRAM_I2C_READY))
+	    {
+	    }
+	    for (uint8_t i = 0; ok && i < NTAG_I2C_SRAM_BLOCKS; i++)
+	    {
+		ntag.ReadDataBlock(NTAG_I2C_SRAM_BLOCK + i, block, 16);
+		ok = memcmp(block, &data[i * 16], 16) == 0;
+	    }
+	}
+	else
+	{
+	    ntag.WriteDataSRAM(data, sizeof(data));
+	    if (fast_read)
+	    {
+		ok = reader.FastRead(0xF0, 0xFF, block) == NTAG_SIM_ACK;
+	    }
+	    else
+	    {
+		for (uint8_t page = 0; ok && page < 16; page += 4)
+		{
+		    ok = reader.Read(0xF0 + page, block) == NTAG_SIM_ACK && memcmp(block, &data[page * 4], 16) == 0;
+		}
+	    }
+	}
+	transferred += ok ? sizeof(data) : 0;
+    }
+    uint64_t elapsed_us = NTAG_SimMicros() - start;
+    reader.Release();
+    return ok ? transferred * 1e6 / elapsed_us : 0;
+}
+
+static void PassThroughBench(NTAG_SimTag &tag, NXP_NTAG_I2C &ntag)
+{
+    static const uint32_t clocks[] = {100000, 400000};
+
+    printf("3. Pass-through, %u bytes through the SRAM with the reader profile (B/s, 0 when failed)\n\n", PASS_THROUGH_BYTES);
+    printf("  I2C clock   RF->I2C WRITE   I2C->RF READ   I2C->RF FAST_READ\n");
+    for (uint8_t i = 0; i < 2; i++)
+    {
+	double rf_to_i2c = PassThrough(tag, ntag, true, false, clocks[i]);
+	double read = PassThrough(tag, ntag, false, false, clocks[i]);
+	double fast_read = PassThrough(tag, ntag, false, true, clocks[i]);
+	printf("  %5lu kHz   %13.0f   %12.0f   %17.0f\n", (unsigned long)clocks[i] / 1000, rf_to_i2c, read, fast_read);
+    }
+    Wire.setClock(NTAG_SIM_I2C_CLOCK);
+    printf("\n");
+}
+
+/**************************************************************************/
+/*      4. Watchdog                                                       */
+/**************************************************************************/
+
+/**************************************************************************/
+/*! RFAfterUpdate(NTAG_SimTag &tag, NXP_NTAG_I2C &ntag)
+    @brief  Time from the end of an EEPROM block write by the MCU to the
+			first READ answered to a reader already in the field, in us
+*/
+/**************************************************************************/
+
+static uint64_t RFAfterUpdate(NTAG_SimTag &tag, NXP_NTAG_I2C &ntag)
+{
+    NTAG_SimTiming timing = NTAG_SimTiming::Reader();
+    timing.max_retries = 255;
+    NTAG_SimReader reader(tag, timing);
+    uint8_t block[16];
+
+    reader.Activate();
+    reader.Release(); //RF_LOCKED released, the field comes back below
+    tag.SetField(true);
+    ntag.ReadDataBlock(NTAG_I2C_USER_MEMORY_BLOCK, block, 16);
+    ntag.WriteDataBlock(NTAG_I2C_USER_MEMORY_BLOCK, block, 16);
+    uint64_t start = NTAG_SimMicros();
+    uint8_t answer = reader.Read(4, block);
+    uint64_t latency_us = NTAG_SimMicros() - start;
+    reader.Release();
+    return answer == NTAG_SIM_ACK ? latency_us : 0;
+}
+
+static void WatchdogBench(NTAG_SimTag &tag, NXP_NTAG_I2C &ntag)
+{
+    static const uint16_t wdt_values[] = {0x0040, 0x0100, 0x0400, NTAG_I2C_WDT_DEFAULT, 0x1000, 0x2000};
+    uint16_t saved = ntag.WatchdogTime();
+
+    printf("4. Watchdog sweep (ms)\n\n");
+    printf("  WDT      nominal   I2C_LOCKED release   RF after EEPROM write   pass-through I2C->RF (B/s)\n");
+    for (uint8_t i = 0; i < sizeof(wdt_values) / sizeof(wdt_values[0]); i++)
+    {
+	uint32_t nominal_us = NTAG_I2C_WDT_US(wdt_values[i]);
+	ntag.SetWatchdogTime(wdt_values[i]);
+	tag.SetField(true);
+	uint32_t release_us = ntag.MeasureLockRelease(2 * nominal_us / 1000 + 10);
+	tag.SetField(false);
+	uint64_t rf_us = RFAfterUpdate(tag, ntag);
+	double throughput = PassThrough(tag, ntag, false, true, NTAG_SIM_I2C_CLOCK);
+	printf("  0x%04X %9.2f %20.2f %23.2f %28.0f\n", wdt_values[i], Milliseconds(nominal_us), Milliseconds(release_us), Milliseconds(rf_us), throughput);
+    }
+    ntag.SetWatchdogTime(saved);
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    int taps = argc > 1 ? atoi(argv[1]) : 20;
+    int period_ms = argc > 2 ? atoi(argv[2]) : UPDATE_PERIOD_MS;
+    NTAG_SimTag tag;
+    NXP_NTAG_I2C ntag(tag.Address());
+
+    if (taps <= 0 || period_ms <= 0)
+    {
+	fprintf(stderr, "usage: sim_bench [taps [update period in ms]]\n");
+	return 1;
+    }
+    Wire.Attach(&tag);
+    ntag.begin();
+
+    TapLatency(tag, ntag);
+    ContentionBench(tag, ntag, taps, period_ms);
+
+    PassThroughBench(tag, ntag);
+    WatchdogBench(tag, ntag);
+    return 0;
+}
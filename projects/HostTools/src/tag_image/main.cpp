@@ -0,0 +1,183 @@
+/**************************************************************************/
+/*!
+    @file     main.cpp
+    @author   AtoM
+	@license  BSD (see license.txt)
+
+Reader for the tag images written by Snapshot() (see
+library/nfc_dynamic_tag_image.h).
+
+	tag_image [--dump] <image file | capture file>
+
+The file is memory-mapped and the image is looked up by its magic, so a
+raw capture of the serial port holding text before the image works as
+well. Prints the header and the runs, or the user memory like
+UserMemoryDump() with --dump.
+
+*/
+/**************************************************************************/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "nfc_dynamic_tag_image.h"
+#include "nfc_dynamic_tag_map.h"
+
+static void PrintHex(const uint8_t *data, unsigned int length, const char *separator)
+{
+    for (unsigned int i = 0; i < length; i++)
+    {
+	printf("%s%02X", i == 0 ? "" : separator, data[i]);
+    }
+}
+
+/**************************************************************************/
+/*! FindImage(const uint8_t *data, size_t size, size_t &offset)
+    @brief  Look for the first valid image of the file, return its status
+			(NTAG_IMAGE_OK, or the error of the last candidate found)
+*/
+/**************************************************************************/
+
+static uint8_t FindImage(const uint8_t *data, size_t size, size_t &offset)
+{
+    uint8_t status = NTAG_IMAGE_BAD_FORMAT;
+
+    for (offset = 0; offset + sizeof(ntag_image_magic) <= size; offset++)
+    {
+	if (memcmp(&data[offset], ntag_image_magic, sizeof(ntag_image_magic)) != 0)
+	    continue;
+	status = NTAG_ImageCheck(&data[offset], size - offset);
+	if (status == NTAG_IMAGE_OK)
+	    break;
+    }
+    return status;
+}
+
+/**************************************************************************/
+/*! PrintSummary(const uint8_t *image)
+    @brief  Header fields and runs, with the blocks a restore writes on a
+			blank tag against the whole user memory
+*/
+/**************************************************************************/
+
+static void PrintSummary(const uint8_t *image)
+{
+    uint8_t lock_block = image[NTAG_IMAGE_OFFSET_LOCK_BLOCK];
+    uint16_t length = (uint16_t)image[NTAG_IMAGE_OFFSET_LENGTH] << 8 | image[NTAG_IMAGE_OFFSET_LENGTH + 1];
+    const char *variant = lock_block == NTAG_I2C_1K::dynamic_lock_block   ? "NT3H1101 (1k)"
+			  : lock_block == NTAG_I2C_2K::dynamic_lock_block ? "NT3H1201 (2k)"
+									  : "unknown";
+
+    printf("NTAG I2C tag image v%u, %s, %u bytes\n\n", image[NTAG_IMAGE_OFFSET_VERSION], variant, length);
+    printf("Static Lock Bytes      : ");
+    PrintHex(&image[NTAG_IMAGE_OFFSET_STATIC_LOCK], 2, " ");
+    printf("\nCapability Container   : ");
+    PrintHex(&image[NTAG_IMAGE_OFFSET_CC], 4, " ");
+    printf("\nDynamic Lock Bytes     : ");
+    PrintHex(&image[NTAG_IMAGE_OFFSET_DYNAMIC_LOCK], 3, " ");
+    printf("\nConfiguration Register : ");
+    PrintHex(&image[NTAG_IMAGE_OFFSET_CONF_REG], 8, " ");
+    printf("\n\nRuns:\n");
+
+    NTAG_ImageRun run;
+    uint16_t offset = NTAG_IMAGE_HEADER_LENGTH;
+    unsigned int nb_blocks = 0;
+    while (NTAG_ImageNextRun(image, offset, run))
+    {
+	printf("  %02X-%02X  %3u block(s)\n", run.first_block, run.first_block + run.nb_blocks - 1, run.nb_blocks);
+	nb_blocks += run.nb_blocks;
+    }
+    printf("\n%u of %u user blocks stored, %u blank (%u bytes instead of %u)\n", nb_blocks, lock_block, lock_block - nb_blocks,
+	   length, lock_block * 16 + NTAG_IMAGE_MIN_LENGTH);
+}
+
+/**************************************************************************/
+/*! PrintDump(const uint8_t *image)
+    @brief  Render the user memory like UserMemoryDump(), blank blocks
+			included
+*/
+/**************************************************************************/
+
+static void PrintDump(const uint8_t *image)
+{
+    static const uint8_t blank[16] = {0};
+    uint8_t lock_block = image[NTAG_IMAGE_OFFSET_LOCK_BLOCK];
+    NTAG_ImageRun run = {0, 0, NULL};
+    uint16_t offset = NTAG_IMAGE_HEADER_LENGTH;
+    bool more = NTAG_ImageNextRun(image, offset, run);
+
+    for (unsigned int block = NTAG_I2C_USER_MEMORY_BLOCK; block <= lock_block; block++)
+    {
+	if (more && block >= run.first_block + run.nb_blocks)
+	    more = NTAG_ImageNextRun(image, offset, run);
+	const uint8_t *data = more && block >= run.first_block ? &run.data[(block - run.first_block) * 16] : blank;
+	unsigned int length = block == lock_block ? 8 : 16;
+
+	printf("%02X  ", block);
+	PrintHex(data, length, " ");
+	printf("%*s  [", (16 - length) * 3, "");
+	for (unsigned int i = 0; i < length; i++)
+	{
+	    putchar(data[i] < 128 && data[i] > 19 ? data[i] : '.');
+	}
+	printf("]\n");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bool dump = false;
+    const char *path = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+	if (strcmp(argv[i], "--dump") == 0)
+	    dump = true;
+	else
+	    path = argv[i];
+    }
+    if (path == NULL)
+    {
+	fprintf(stderr, "usage: %s [--dump] <image file | capture file>\n", argv[0]);
+	return 2;
+    }
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+	perror(path);
+	return 1;
+    }
+    if (st.st_size == 0)
+    {
+	fprintf(stderr, "%s: empty file\n", path);
+	return 1;
+    }
+    const uint8_t *data = (const uint8_t *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+	perror(path);
+	return 1;
+    }
+
+    size_t offset;
+    uint8_t status = FindImage(data, st.st_size, offset);
+    if (status != NTAG_IMAGE_OK)
+    {
+	fprintf(stderr, "%s: no valid image found (%s)\n", path, status == NTAG_IMAGE_BAD_CRC ? "bad CRC" : "bad format");
+	munmap((void *)data, st.st_size);
+	return 1;
+    }
+    if (dump)
+	PrintDump(&data[offset]);
+    else
+	PrintSummary(&data[offset]);
+    munmap((void *)data, st.st_size);
+    return 0;
+}
@@ -0,0 +1,515 @@
+/**************************************************************************/
+/*!
+    @file     main.cpp
+    @author   AtoM
+	@license  BSD (see license.txt)
+
+Bus efficiency gate of the library: each public NXP_NTAG_I2C operation
+runs against a fresh simulated tag (lib/ntag_sim) and its I2C
+transactions and waits are recorded (ntag_sim_trace.h), then compared
+with golden traces.
+
+	trace_gate [--tolerance <percent>] [--verbose] <golden file>
+	trace_gate --record <golden file>
+
+An operation fails when its transaction count, byte count or total wait
+time grows past the golden value plus the tolerance (0 by default); the
+first event that differs is printed. A sequence that changed without
+costing more is reported but does not fail. The exit status is 1 when an
+operation fails or has no golden trace, so the tool can gate a build.
+After an intended change, record the traces again and commit them with
+the change.
+
+*/
+/**************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "nfc_dynamic_tag.h"
+#include "ntag_sim_tag.h"
+#include "ntag_sim_trace.h"
+
+#define SETTLE_MS 50 //between the setup and the traced operation, EEPROM writes over
+
+class NullPrint : public Print
+{
+  public:
+    size_t write(uint8_t value)
+    {
+	(void)value;
+	return 1;
+    }
+    size_t write(const uint8_t *buffer, size_t size)
+    {
+	(void)buffer;
+	return size;
+    }
+    using Print::write;
+};
+
+class BufferPrint : public Print
+{
+  public:
+    BufferPrint(uint8_t *buffer, size_t size) : _buffer(buffer), _size(size), _length(0) {}
+
+    size_t write(uint8_t value)
+    {
+	if (_length >= _size)
+	    return 0;
+	_buffer[_length++] = value;
+	return 1;
+    }
+    using Print::write;
+    size_t Length() const { return _length; }
+
+  private:
+    uint8_t *_buffer;
+    size_t _size;
+    size_t _length;
+};
+
+struct Operation
+{
+    const char *name;
+    void (*setup)(NXP_NTAG_I2C &ntag);
+    void (*run)(NXP_NTAG_I2C &ntag);
+};
+
+struct Golden
+{
+    std::string name;
+    unsigned long transactions;
+    unsigned long bytes;
+    unsigned long wait_us;
+    std::vector<NTAG_SimEvent> events;
+};
+
+static const char uri[] = "https://www.example.com/s?v=0000";
+static const char other_uri[] = "https://www.example.com/products/nfc-dynamic-tag?id=0042";
+static NullPrint null_print;
+static uint8_t image[1024];
+static size_t image_length;
+static uint8_t block_mem[16];
+
+// Setups, not traced
+
+static void WriteURI(NXP_NTAG_I2C &ntag, const char *text)
+{
+    NTAG_NDEFUpdater updater(ntag);
+    NTAG_URIRecord record(text);
+    record.WriteTo(updater);
+    updater.Commit();
+}
+
+static void URISetup(NXP_NTAG_I2C &ntag)
+{
+    WriteURI(ntag, uri);
+}
+
+static void ImageSetup(NXP_NTAG_I2C &ntag)
+{
+    WriteURI(ntag, other_uri);
+    BufferPrint buffer(image, sizeof(image));
+    image_length = ntag.Snapshot(buffer);
+    WriteURI(ntag, uri);
+}
+
+static void SameImageSetup(NXP_NTAG_I2C &ntag)
+{
+    WriteURI(ntag, uri);
+    BufferPrint buffer(image, sizeof(image));
+    image_length = ntag.Snapshot(buffer);
+}
+
+// Traced operations
+
+static void BeginRun(NXP_NTAG_I2C &ntag)
+{
+    ntag.begin();
+}
+
+static void ReadBlockRun(NXP_NTAG_I2C &ntag)
+{
+    ntag.ReadDataBlock(NTAG_I2C_USER_MEMORY_BLOCK, block_mem, 16);
+}
+
+static void WriteBlockRun(NXP_NTAG_I2C &ntag)
+{
+    memset(block_mem, 0x5A, 16);
+    ntag.WriteDataBlock(0x10, block_mem, 16);
+}
+
+static void WriteEEPROMRun(NXP_NTAG_I2C &ntag)
+{
+    uint8_t data[100];
+    for (uint8_t i = 0; i < sizeof(data); i++)
+    {
+	data[i] = i;
+    }
+    ntag.WriteDataEEPROM(data, sizeof(data));
+}
+
+static void ReplaceContentRun(NXP_NTAG_I2C &ntag)
+{
+    uint8_t data[100];
+    for (uint8_t i = 0; i < sizeof(data); i++)
+    {
+	data[i] = i;
+    }
+    ntag.ReplaceContent(data, sizeof(data));
+}
+
+static void CleanWriteRun(NXP_NTAG_I2C &ntag)
+{
+    uint8_t data[100];
+    for (uint8_t i = 0; i < sizeof(data); i++)
+    {
+	data[i] = i;
+    }
+    ntag.CleanData();
+    ntag.WriteDataEEPROM(data, sizeof(data));
+}
+
+static void WriteSegmentsRun(NXP_NTAG_I2C &ntag)
+{
+    static const uint8_t header[] = {0x03, 0x29, 0xD1, 0x01, 0x25, 0x55, 0x02};
+    static const char path[] PROGMEM = "example.com/products/nfc-dynamic-tag";
+    static const uint8_t terminator[] = {0xFE};
+    const NTAG_Segment segments[] = {{header, sizeof(header), NTAG_SEGMENT_RAM},
+				     {path, sizeof(path) - 1, NTAG_SEGMENT_PROGMEM},
+				     {terminator, sizeof(terminator), NTAG_SEGMENT_RAM}};
+    ntag.WriteSegments(segments, 3);
+}
+
+static void WriteSRAMRun(NXP_NTAG_I2C &ntag)
+{
+    uint8_t data[NTAG_I2C_SRAM_BLOCKS * 16];
+    memset(data, 0xA5, sizeof(data));
+    ntag.WriteDataSRAM(data, sizeof(data));
+}
+
+static void CleanDataRun(NXP_NTAG_I2C &ntag)
+{
+    ntag.CleanData();
+}
+
+static void ReadSessionRun(NXP_NTAG_I2C &ntag)
+{
+    ntag.ReadSession();
+}
+
+static void ReadConfigurationRun(NXP_NTAG_I2C &ntag)
+{
+    ntag.ReadConfiguration();
+}
+
+static void WriteSessionRun(NXP_NTAG_I2C &ntag)
+{
+    const NTAG_I2C_SessionUpdate updates[2] = {{0, 0x01, 0x01}, {2, 0xFF, 0xF8}};
+    ntag.WriteSessionRegisters(updates, 2);
+}
+
+static void WatchdogRun(NXP_NTAG_I2C &ntag)
+{
+    ntag.SetWatchdogTime(0x0100);
+}
+
+static void WaitEEPROMRun(NXP_NTAG_I2C &ntag)
+{
+    ntag.WaitEEPROMReady();
+}
+
+static void PlanWriteRun(NXP_NTAG_I2C &ntag)
+{
+    ntag.PlanWrite(NTAG_I2C_USER_MEMORY_BLOCK, 8);
+}
+
+static void FullReportRun(NXP_NTAG_I2C &ntag)
+{
+    ntag.GetNTAGFullReport();
+}
+
+static void DumpRun(NXP_NTAG_I2C &ntag)
+{
+    ntag.UserMemoryDump(null_print);
+}
+
+static void DumpBinaryRun(NXP_NTAG_I2C &ntag)
+{
+    ntag.UserMemoryDumpBinary(null_print);
+}
+
+static void SnapshotRun(NXP_NTAG_I2C &ntag)
+{
+    ntag.Snapshot(null_print);
+}
+
+static void RestoreRun(NXP_NTAG_I2C &ntag)
+{
+    ntag.Restore(image, image_length);
+}
+
+static void NDEFUpdateRun(NXP_NTAG_I2C &ntag)
+{
+    WriteURI(ntag, other_uri);
+}
+
+static void BlockWriterRun(NXP_NTAG_I2C &ntag)
+{
+    NTAG_BlockWriter writer(ntag);
+    NTAG_URIRecord record(other_uri);
+    record.WriteTo(writer);
+    writer.Flush();
+}
+
+static void LiveRecordRun(NXP_NTAG_I2C &ntag)
+{
+    NTAG_LiveRecord live(ntag);
+    NTAG_URIRecord record(uri);
+    record.WriteTo(live);
+    live.Start();
+    live.SetValue(live.Find("0000"), "1234");
+    live.Update();
+}
+
+static void PatchRun(NXP_NTAG_I2C &ntag)
+{
+    NTAG_RecordIndex index(ntag);
+    index.Build();
+    index.Patch(0, index.Record(0).payload_length - 4, (const uint8_t *)"1234", 4);
+}
+
+static const Operation operations[] = {
+    {"begin", NULL, BeginRun},
+    {"ReadDataBlock", NULL, ReadBlockRun},
+    {"WriteDataBlock", NULL, WriteBlockRun},
+    {"WriteDataEEPROM", NULL, WriteEEPROMRun},
+    {"WriteDataSRAM", NULL, WriteSRAMRun},
+    {"WriteSegments", NULL, WriteSegmentsRun},
+    {"CleanData", URISetup, CleanDataRun},
+    {"CleanDataWriteDataEEPROM", URISetup, CleanWriteRun},
+    {"ReplaceContent", URISetup, ReplaceContentRun},
+    {"ReadSession", NULL, ReadSessionRun},
+    {"ReadConfiguration", NULL, ReadConfigurationRun},
+    {"WriteSessionRegisters", NULL, WriteSessionRun},
+    {"SetWatchdogTime", NULL, WatchdogRun},
+    {"WaitEEPROMReady", NULL, WaitEEPROMRun},
+    {"PlanWrite", NULL, PlanWriteRun},
+    {"GetNTAGFullReport", URISetup, FullReportRun},
+    {"UserMemoryDump", URISetup, DumpRun},
+    {"UserMemoryDumpBinary", URISetup, DumpBinaryRun},
+    {"Snapshot", URISetup, SnapshotRun},
+    {"Restore", ImageSetup, RestoreRun},
+    {"RestoreUnchanged", SameImageSetup, RestoreRun},
+    {"NTAG_NDEFUpdater", URISetup, NDEFUpdateRun},
+    {"NTAG_BlockWriter", NULL, BlockWriterRun},
+    {"NTAG_LiveRecord", NULL, LiveRecordRun},
+    {"NTAG_RecordIndex", URISetup, PatchRun},
+};
+
+/**************************************************************************/
+/*! Trace(const Operation &operation, NTAG_SimTrace &trace)
+    @brief  Run the setup then the operation on a tag as delivered, only
+			the operation is traced
+*/
+/**************************************************************************/
+
+static void Trace(const Operation &operation, NTAG_SimTrace &trace)
+{
+    NTAG_SimTag tag;
+    NXP_NTAG_I2C ntag(NTAG_SIM_I2C_ADDRESS);
+
+    Wire.Attach(&tag);
+    Wire.setClock(NTAG_SIM_I2C_CLOCK);
+    if (operation.setup != NULL)
+	operation.setup(ntag);
+    NTAG_SimAdvance(SETTLE_MS * 1000);
+    trace.Clear();
+    NTAG_SimTraceTo(&trace);
+    operation.run(ntag);
+    NTAG_SimTraceTo(NULL);
+    Wire.Attach(NULL);
+}
+
+static bool Record(const char *path)
+{
+    FILE *out = fopen(path, "w");
+    if (out == NULL)
+    {
+	perror(path);
+	return false;
+    }
+    fprintf(out, "# Golden bus traces of the library, trace_gate --record\n");
+    fprintf(out, "# op <name> <transactions> <bytes> <wait us> <bus us>, then one event per line (ntag_sim_trace.h)\n");
+    for (size_t i = 0; i < sizeof(operations) / sizeof(operations[0]); i++)
+    {
+	NTAG_SimTrace trace;
+	Trace(operations[i], trace);
+	fprintf(out, "op %s %lu %lu %lu %lu\n", operations[i].name, trace.Transactions(), trace.Bytes(),
+		(unsigned long)trace.WaitUs(), (unsigned long)trace.BusUs());
+	for (size_t j = 0; j < trace.Events().size(); j++)
+	{
+	    NTAG_SimTrace::Print(out, trace.Events()[j]);
+	}
+	printf("%-24s %5lu transactions %6lu bytes %8.1f ms wait\n", operations[i].name, trace.Transactions(), trace.Bytes(),
+	       trace.WaitUs() / 1000.0);
+    }
+    fclose(out);
+    return true;
+}
+
+static bool Load(const char *path, std::vector<Golden> &goldens)
+{
+    FILE *in = fopen(path, "r");
+    if (in == NULL)
+    {
+	perror(path);
+	return false;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), in) != NULL)
+    {
+	if (line[0] == '#' || line[0] == '\n')
+	    continue;
+	if (strncmp(line, "op ", 3) == 0)
+	{
+	    char name[128];
+	    Golden golden;
+	    unsigned long bus_us;
+	    if (sscanf(line + 3, "%127s %lu %lu %lu %lu", name, &golden.transactions, &golden.bytes, &golden.wait_us, &bus_us) != 5)
+		break;
+	    golden.name = name;
+	    goldens.push_back(golden);
+	    continue;
+	}
+	NTAG_SimEvent event;
+	if (goldens.empty() || !NTAG_SimTrace::Parse(line, event))
+	{
+	    fprintf(stderr, "%s: bad line: %s", path, line);
+	    fclose(in);
+	    return false;
+	}
+	goldens.back().events.push_back(event);
+    }
+    fclose(in);
+    return true;
+}
+
+static bool SameEvent(const NTAG_SimEvent &a, const NTAG_SimEvent &b)
+{
+    return a.kind == b.kind && a.address == b.address && a.first == b.first && a.length == b.length && a.result == b.result &&
+	   (a.kind != NTAG_SIM_EVENT_WAIT || a.us == b.us);
+}
+
+static void PrintDivergence(const Golden &golden, const NTAG_SimTrace &trace)
+{
+    const std::vector<NTAG_SimEvent> &events = trace.Events();
+    size_t i = 0;
+
+    while (i < events.size() && i < golden.events.size() && SameEvent(events[i], golden.events[i]))
+    {
+	i++;
+    }
+    printf("    first difference at event %zu\n", i);
+    if (i < golden.events.size())
+    {
+	printf("    golden: ");
+	NTAG_SimTrace::Print(stdout, golden.events[i]);
+    }
+    if (i < events.size())
+    {
+	printf("    now:    ");
+	NTAG_SimTrace::Print(stdout, events[i]);
+    }
+}
+
+static bool Grew(const unsigned long now, const unsigned long golden, const double tolerance)
+{
+    return now > golden + golden * tolerance / 100.0;
+}
+
+int main(int argc, char **argv)
+{
+    bool record = false;
+    bool verbose = false;
+    double tolerance = 0;
+    const char *path = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+	if (strcmp(argv[i], "--record") == 0)
+	    record = true;
+	else if (strcmp(argv[i], "--verbose") == 0)
+	    verbose = true;
+	else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+	    tolerance = atof(argv[++i]);
+	else if (path == NULL && argv[i][0] != '-')
+	    path = argv[i];
+	else
+	    path = NULL, i = argc;
+    }
+    if (path == NULL)
+    {
+	fprintf(stderr, "usage: trace_gate [--tolerance <percent>] [--verbose] <golden file>\n"
+			"       trace_gate --record <golden file>\n");
+	return 2;
+    }
+    Serial.SetOutput(NULL); //GetNTAGFullReport() prints to Serial
+    if (record)
+	return Record(path) ? 0 : 1;
+
+    std::vector<Golden> goldens;
+    if (!Load(path, goldens))
+	return 1;
+
+    int failures = 0;
+    printf("%-24s %13s %13s %17s\n", "operation", "transactions", "bytes", "wait ms");
+    for (size_t i = 0; i < sizeof(operations) / sizeof(operations[0]); i++)
+    {
+	const Operation &operation = operations[i];
+	const Golden *golden = NULL;
+	for (size_t j = 0; j < goldens.size() && golden == NULL; j++)
+	{
+	    if (goldens[j].name == operation.name)
+		golden = &goldens[j];
+	}
+	NTAG_SimTrace trace;
+	Trace(operation, trace);
+	if (golden == NULL)
+	{
+	    printf("%-24s %13lu %13lu %17.1f  NO GOLDEN TRACE\n", operation.name, trace.Transactions(), trace.Bytes(),
+		   trace.WaitUs() / 1000.0);
+	    failures++;
+	    continue;
+	}
+
+	bool regression = Grew(trace.Transactions(), golden->transactions, tolerance) || Grew(trace.Bytes(), golden->bytes, tolerance) ||
+			  Grew((unsigned long)trace.WaitUs(), golden->wait_us, tolerance);
+	bool same = trace.Events().size() == golden->events.size();
+	for (size_t j = 0; same && j < golden->events.size(); j++)
+	{
+	    same = SameEvent(trace.Events()[j], golden->events[j]);
+	}
+	const char *verdict = "ok";
+	if (regression)
+	    verdict = "REGRESSION";
+	else if (trace.Transactions() < golden->transactions || trace.Bytes() < golden->bytes || trace.WaitUs() < golden->wait_us)
+	    verdict = "improved, record again";
+	else if (!same)
+	    verdict = "sequence changed";
+	printf("%-24s %5lu (%5lu) %5lu (%5lu) %7.1f (%7.1f)  %s\n", operation.name, trace.Transactions(), golden->transactions,
+	       trace.Bytes(), golden->bytes, trace.WaitUs() / 1000.0, golden->wait_us / 1000.0, verdict);
+	if (!same && (regression || verbose))
+	    PrintDivergence(*golden, trace);
+	if (regression)
+	    failures++;
+    }
+    printf("%d operation(s) failed, tolerance %.1f %%\n", failures, tolerance);
+    return failures > 0 ? 1 : 0;
+}
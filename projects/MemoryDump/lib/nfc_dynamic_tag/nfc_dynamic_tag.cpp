@@ -35,33 +35,64 @@ This is a library for the NXP NTAG_I2C board
 #include <Wire.h>
 #include <nfc_dynamic_tag.h>
 
-#define NTAG_I2C_SERIAL_NB_BLOCK 0x00
-#define NTAG_I2C_USER_MEMORY_BLOCK 0x01  //first user memory block, last one is 0x38
-#define NTAG_I2C_DYNAMIC_LOCK_BLOCK 0x38 //Dynamic Lock Bytes are bytes 8, 9 and 10; previous bytes are last user memory bytes
-#define NTAG_I2C_CONF_REG_BLOCK 0x3A
-#define NTAG_I2C_SRAM_BLOCK 0xF8
-#define NTAG_I2C_SESSION_REG_BLOCK 0xFE
+#define NTAG_I2C_HEX_LINE_BYTES 16 //bytes rendered per dump line by PrintHex/PrintHexASCII
+
+// NTAG_ProvisionImage states
+
+#define NTAG_PROVISION_FREE 0
+#define NTAG_PROVISION_RECEIVING 1
+#define NTAG_PROVISION_READY 2       //IMAGE_END received, waiting for the tag
+#define NTAG_PROVISION_PROGRAMMING 3
 
 /**************************************************************************/
 /*! NXP_NTAG_I2C(const byte device_address)
     @brief  Instantiates new NXP_NTAG_I2C
     @param  device_address			I2C device_address (7 bits SA)
+		The memory map is the NT3H1101 (1k) one until begin() or
+		DetectMemoryMap() reads the tag
 */
 /**************************************************************************/
 
-NXP_NTAG_I2C::NXP_NTAG_I2C(const byte device_address) : _device_address(device_address)
+NXP_NTAG_I2C::NXP_NTAG_I2C(const byte device_address) : _device_address(device_address), _session_cached(0), _idle_task(NULL), _idle_context(NULL)
 {
+    UseMemoryMap<NTAG_I2C_1K>();
 }
 
 /**************************************************************************/
-/*! NXP_NTAG_I2C::begin()
-    @brief  Instantiates Wire.h and create new Serial connection
+/*! NXP_NTAG_I2C::begin(const bool detect_map)
+    @brief  Instantiates Wire.h and create new Serial connection, then
+			detects the memory map of the tag. begin() always detects it,
+			NTAG_I2C_Tag<Map> keeps the one it is bound to
+    @param  detect_map
 */
 /**************************************************************************/
 
-void NXP_NTAG_I2C::begin()
+void NXP_NTAG_I2C::begin(const bool detect_map)
 {
     delay(100);
+    if (detect_map)
+	DetectMemoryMap();
+}
+
+/**************************************************************************/
+/*! DetectMemoryMap()
+    @brief  Select the NT3H1101 (1k) or NT3H1201 (2k) memory map from the
+			NDEF area size of the capability container (block 0, byte 14):
+			0x6D on the 1k, 0xEA on the 2k as delivered by NXP. A tag
+			without a NDEF capability container keeps the 1k map.
+			see p. 19 of the datasheet Rev3.2 for the capability container
+*/
+/**************************************************************************/
+
+NTAG_I2C_MemoryMap NXP_NTAG_I2C::DetectMemoryMap()
+{
+    NTAG_I2C_CapabilityContainer cc = ReadCapabilityContainer();
+
+    if (cc.magic == 0xE1 && cc.size > NTAG_I2C_1K::cc_size * 8)
+	UseMemoryMap<NTAG_I2C_2K>();
+    else
+	UseMemoryMap<NTAG_I2C_1K>();
+    return _map;
 }
 
 /**************************************************************************/
@@ -96,6 +127,8 @@ int NXP_NTAG_I2C::ReadDataBlock(const byte block_address, uint8_t *out_buffer, i
 /**************************************************************************/
 /*! WriteDataBlock(const byte block_address, uint8_t * input_buffer, int input_buffer_length)
     @brief write a complete Data block, i.e. a block of 16 bytes following a block address
+		The EEPROM programming time is waited for, the SRAM blocks are
+		available again at once
     @param  block_address
     @param  input_buffer
     @param  input_buffer_length
@@ -116,7 +149,8 @@ void NXP_NTAG_I2C::WriteDataBlock(const byte block_address, uint8_t *input_buffe
 	Wire.write(0x00);
     }
     Wire.endTransmission();
-    delay(5);
+    if (block_address < NTAG_I2C_SRAM_BLOCK)
+	WaitProgramming();
 }
 
 /**************************************************************************/
@@ -136,23 +170,44 @@ void NXP_NTAG_I2C::CleanDataBlock(const byte block_address)
     }
     Wire.endTransmission();
 
-    delay(5);
+    WaitProgramming();
 }
 
 /**************************************************************************/
 /*! CleanData()
-    @brief Clean data block applied on all EEPROM blocks
+    @brief Clean data block applied on all EEPROM blocks, blocks covered by
+		a lock bit are skipped
 */
 /**************************************************************************/
 
 void NXP_NTAG_I2C::CleanData()
 {
-    for (int i = 1; i < 56; i++)
+    CleanUserBlocks(_map);
+}
+
+/**************************************************************************/
+/*! CleanUserBlocks(const Map &map)
+    @brief  CleanData() over the user memory of map, either the detected
+			NTAG_I2C_MemoryMap or a variant trait whose block addresses are
+			then compile-time constants (NTAG_I2C_Tag<Map>)
+    @param  map
+*/
+/**************************************************************************/
+
+template <class Map>
+void NXP_NTAG_I2C::CleanUserBlocks(const Map &map)
+{
+    NTAG_I2C_WritePlan plan = PlanUserBlocks(map, NTAG_I2C_USER_MEMORY_BLOCK, map.dynamic_lock_block);
+
+    for (int i = 1; i < map.dynamic_lock_block; i++)
     {
-	CleanDataBlock(i);
+	if (plan.IsWritable(i))
+	    CleanDataBlock(i);
     }
+    if (!plan.IsWritable(map.dynamic_lock_block))
+	return;
     Wire.beginTransmission((uint8_t)_device_address);
-    Wire.write(0x38);
+    Wire.write(map.dynamic_lock_block);
     for (int j = 0; j < 8; j++)
     {
 	Wire.write(0x00);
@@ -162,53 +217,318 @@ void NXP_NTAG_I2C::CleanData()
 	Wire.write(0x00);
     }
     Wire.endTransmission();
-    delay(5);
+    WaitProgramming();
+}
+
+/**************************************************************************/
+/*! PlanWrite(const uint8_t first_block, const uint8_t nb_blocks)
+    @brief  Read the static lock bytes (block 0, bytes 10 and 11) and the
+			dynamic lock bytes (block 0x38 or 0x78, bytes 8 and 9) once, and return
+			the map of the blocks no lock bit covers together with the
+			number of locked blocks and the write time of the given range.
+			Block 0 (serial number, lock bytes, CC) is reported locked. No
+			lock bit covers the blocks past the user memory: the
+			configuration register is governed by REG_LOCK and the SRAM
+			cannot be locked.
+			see pp. 16-18 of the datasheet Rev3.2 for the lock bytes
+    @param  first_block
+    @param  nb_blocks
+*/
+/**************************************************************************/
+
+NTAG_I2C_WritePlan NXP_NTAG_I2C::PlanWrite(const uint8_t first_block, const uint8_t nb_blocks)
+{
+    return PlanUserBlocks(_map, first_block, nb_blocks);
+}
+
+/**************************************************************************/
+/*! PlanUserBlocks(const Map &map, const uint8_t first_block, const uint8_t nb_blocks)
+    @brief  PlanWrite() for the lock layout of map; with a variant trait the
+			lock group division is by a constant, a shift on AVR
+    @param  map
+    @param  first_block
+    @param  nb_blocks
+*/
+/**************************************************************************/
+
+template <class Map>
+NTAG_I2C_WritePlan NXP_NTAG_I2C::PlanUserBlocks(const Map &map, const uint8_t first_block, const uint8_t nb_blocks)
+{
+    NTAG_I2C_WritePlan plan;
+    NTAG_I2C_StaticLock static_lock = ReadStaticLock();
+    uint8_t dynamic_lock[16];
+
+    ReadDataBlock(map.dynamic_lock_block, dynamic_lock, 16);
+    memset(plan.writable, 0, sizeof(plan.writable));
+
+    for (uint8_t block = NTAG_I2C_USER_MEMORY_BLOCK; block <= map.dynamic_lock_block; block++)
+    {
+	bool locked;
+	if (block < 4) //static lock bits, one per page: block n holds pages 4n to 4n + 3, page_locks bit 0 being page 3
+	{
+	    locked = (static_lock.page_locks >> (4 * block - 3)) & 0x0F;
+	}
+	else //dynamic lock bits, one per 16 pages (4 blocks) from page 16, 32 pages (8 blocks) on 2k
+	{
+	    uint8_t group = (block - 4) / map.lock_bit_blocks;
+	    locked = (dynamic_lock[8 + group / 8] >> (group % 8)) & 0x01;
+	}
+	if (!locked)
+	    plan.writable[block >> 3] |= 1 << (block & 7);
+    }
+    for (uint8_t block = map.dynamic_lock_block + 1; block < NTAG_I2C_MAP_MAX_BLOCKS; block++)
+    {
+	plan.writable[block >> 3] |= 1 << (block & 7);
+    }
+
+    plan.first_block = first_block;
+    plan.nb_blocks = nb_blocks;
+    plan.nb_locked = 0;
+    for (uint16_t block = first_block; block < (uint16_t)first_block + nb_blocks; block++)
+    {
+	if (!plan.IsWritable(block))
+	    plan.nb_locked++;
+    }
+    plan.write_ms = (uint16_t)(nb_blocks - plan.nb_locked) * NTAG_I2C_BLOCK_WRITE_MS;
+    return plan;
 }
+
 /**************************************************************************/
 /*! StartSRAMMirror()
     @brief activate the SRAM Mirror on address 0x01
+		The configuration register only gets SRAM_MIRROR_BLOCK = 0x01, the
+		other settings are kept and the EEPROM is not written again when
+		the mirror block is already set
 */
 /**************************************************************************/
 
 void NXP_NTAG_I2C::StartSRAMMirror()
 {
-    byte newConf[] = {0x01, 0x00, 0x01, 0x48, 0x08, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-    //Modify the configuration register with the new configuration
-    WriteDataBlock(0x3A, newConf, 16);
-    // Note the special sequence for the writing in session register
-    Wire.beginTransmission(0x55);
-    //write on the block address 0xFE
-    Wire.write(0xFE);
-    //select the byte to be modified i.e. 0x00
-    Wire.write(0x00);
-    //select the bit(s) to be modified i.e. the second bit for SRAM Mirror enabling
-    Wire.write(0x02);
-    //give the desired result i.e. 0x03 (b00000011) as the previous value was 0x01 (b00000001)
-    Wire.write(0x03);
-    //stop
-    Wire.endTransmission(true);
+    NTAG_I2C_Configuration conf = ReadConfiguration();
+    conf.sram_mirror_block = 0x01;
+    WriteConfiguration(conf);
+    //Mirror block and mirror enable in the session register, effective at once and without EEPROM write
+    NTAG_I2C_SessionUpdate updates[] = {{2, 0xFF, 0x01}, {0, NTAG_I2C_NC_SRAM_MIRROR_ON_OFF, NTAG_I2C_NC_SRAM_MIRROR_ON_OFF}};
+    WriteSessionRegisters(updates, 2);
 }
 
 /**************************************************************************/
 /*! WriteDataEEPROM(uint8_t * input_buffer, int input_buffer_length)
     @brief write an array of byte values in the EEPROM memory, filling the block from the address 0x01 (I2C addressing) up until the last full or incomplete block
+		Return false, without writing anything, when the data exceeds the user memory or one of these blocks is locked (see PlanWrite)
     @param  input_buffer
     @param  input_buffer_length
 */
 /**************************************************************************/
 
-void NXP_NTAG_I2C::WriteDataEEPROM(uint8_t *input_buffer, int input_buffer_length)
+bool NXP_NTAG_I2C::WriteDataEEPROM(uint8_t *input_buffer, int input_buffer_length)
 {
     int32_t full_block;
     uint32_t last_block_remainder;
 
     full_block = (uint32_t)(input_buffer_length / 16);
     last_block_remainder = input_buffer_length % 16;
+    if (input_buffer_length > _map.UserBytes()) //would reach the dynamic lock bytes
+	return false;
+    if (PlanWrite(NTAG_I2C_USER_MEMORY_BLOCK, full_block + 1).nb_locked > 0)
+	return false;
     for (int i = 1; i < full_block + 1; i++)
     {
 	WriteDataBlock(i, &input_buffer[0 + (i - 1) * 16], 16);
     }
     WriteDataBlock(full_block + 1, &input_buffer[full_block * 16], last_block_remainder);
+    return true;
+}
+
+/**************************************************************************/
+/*! SegmentsLength(const NTAG_Segment *segments, const uint8_t nb_segments)
+    @brief  Total length of the segments
+    @param  segments
+    @param  nb_segments
+*/
+/**************************************************************************/
+
+static uint32_t SegmentsLength(const NTAG_Segment *segments, const uint8_t nb_segments)
+{
+    uint32_t length = 0;
+
+    for (uint8_t i = 0; i < nb_segments; i++)
+    {
+	length += segments[i].length;
+    }
+    return length;
+}
+
+/**************************************************************************/
+/*! WriteSegmentBlocks(const NTAG_Segment *segments, const uint8_t nb_segments, const uint8_t last_block)
+    @brief  Write the segments from block 1 to last_block, the bytes going
+			from each segment to the I2C buffer of its block write; the
+			last block is padded with 0x00
+    @param  segments
+    @param  nb_segments
+    @param  last_block
+*/
+/**************************************************************************/
+
+void NXP_NTAG_I2C::WriteSegmentBlocks(const NTAG_Segment *segments, const uint8_t nb_segments, const uint8_t last_block)
+{
+    uint8_t segment = 0;
+    uint16_t offset = 0;
+
+    for (uint8_t block = NTAG_I2C_USER_MEMORY_BLOCK; block <= last_block; block++)
+    {
+	uint8_t count = 0;
+	Wire.beginTransmission((uint8_t)_device_address);
+	Wire.write(block);
+	while (count < 16 && segment < nb_segments)
+	{
+	    if (offset >= segments[segment].length)
+	    {
+		segment++;
+		offset = 0;
+		continue;
+	    }
+	    const uint8_t *data = (const uint8_t *)segments[segment].data + offset++;
+	    Wire.write(segments[segment].memory == NTAG_SEGMENT_PROGMEM ? pgm_read_byte(data) : *data);
+	    count++;
+	}
+	for (; count < 16; count++)
+	{
+	    Wire.write(0x00);
+	}
+	Wire.endTransmission();
+	WaitProgramming();
+    }
+}
+
+/**************************************************************************/
+/*! WriteSegments(const NTAG_Segment *segments, const uint8_t nb_segments)
+    @brief  Same as WriteDataEEPROM() for a content made of pieces in RAM
+			or PROGMEM (TLV header, record header, type, payload parts,
+			terminator) packed into the 16 byte block writes as they are
+			sent, without assembling them in a buffer first.
+			Return false, without writing anything, when the content
+			exceeds the user memory or one of its blocks is locked
+    @param  segments
+    @param  nb_segments
+*/
+/**************************************************************************/
+
+bool NXP_NTAG_I2C::WriteSegments(const NTAG_Segment *segments, const uint8_t nb_segments)
+{
+    uint32_t length = SegmentsLength(segments, nb_segments);
+
+    if (length == 0)
+	return true;
+    if (length > _map.UserBytes())
+	return false;
+    uint8_t nb_blocks = (length + 15) / 16;
+    if (PlanWrite(NTAG_I2C_USER_MEMORY_BLOCK, nb_blocks).nb_locked > 0)
+	return false;
+    WriteSegmentBlocks(segments, nb_segments, NTAG_I2C_USER_MEMORY_BLOCK + nb_blocks - 1);
+    return true;
+}
+
+/**************************************************************************/
+/*! NDEFLastBlock(const uint8_t *block, uint8_t dynamic_lock_block, const uint8_t unknown)
+    @brief  Last block holding the NDEF TLV (terminator included) according
+			to the TLVs of block 1; block 1 when a terminator comes first,
+			unknown when block 1 does not tell
+    @param  block		Content of block 1
+    @param  dynamic_lock_block	Last user memory block
+    @param  unknown		Returned when there is no NDEF TLV in block 1
+*/
+/**************************************************************************/
+
+static uint8_t NDEFLastBlock(const uint8_t *block, const uint8_t dynamic_lock_block, const uint8_t unknown = NTAG_I2C_USER_MEMORY_BLOCK)
+{
+    uint8_t i = 0;
+
+    while (i < 16 && block[i] != NTAG_NDEF_TLV_TERMINATOR)
+    {
+	if (block[i] == 0x00) //NULL TLV
+	{
+	    i++;
+	    continue;
+	}
+	if (i + 1 >= 16)
+	    break;
+	uint16_t length = block[i + 1];
+	uint8_t header = 2;
+	if (length == 0xFF)
+	{
+	    if (i + 3 >= 16)
+		break;
+	    length = (uint16_t)block[i + 2] << 8 | block[i + 3];
+	    header = 4;
+	}
+	if (block[i] == NTAG_NDEF_TLV)
+	{
+	    uint16_t last = NTAG_I2C_USER_MEMORY_BLOCK + (i + header + length) / 16;
+	    return last < dynamic_lock_block ? last : dynamic_lock_block;
+	}
+	if (i + header + length >= 16)
+	    break;
+	i += header + length;
+    }
+    if (i < 16 && block[i] == NTAG_NDEF_TLV_TERMINATOR)
+	return NTAG_I2C_USER_MEMORY_BLOCK;
+    return unknown;
+}
+
+/**************************************************************************/
+/*! ReplaceContent(const uint8_t *content, const int length)
+    @brief  Same as CleanData() then WriteDataEEPROM() with each block
+			written once, see ReplaceContent(segments, nb_segments)
+    @param  content		New user memory content from block 1, usually a NDEF TLV
+    @param  length
+*/
+/**************************************************************************/
+
+bool NXP_NTAG_I2C::ReplaceContent(const uint8_t *content, const int length)
+{
+    if (length < 0 || length > _map.UserBytes())
+	return false;
+    NTAG_Segment segment = {content, (uint16_t)length, NTAG_SEGMENT_RAM};
+    return ReplaceContent(&segment, 1);
+}
+
+/**************************************************************************/
+/*! ReplaceContent(const NTAG_Segment *segments, const uint8_t nb_segments)
+    @brief  Same as CleanData() then WriteSegments() with each block
+			written once: the blocks of the new content are written, and
+			only the blocks of the previous NDEF TLV past its end are
+			cleaned. The previous end is read from the TLV length in block
+			1; when block 1 holds no NDEF TLV the whole user memory past the
+			new content is cleaned, as CleanData() does. Bytes left after
+			the previous terminator TLV are not cleaned.
+			Return false, without writing anything, when the content
+			exceeds the user memory or one of the blocks to write is locked
+    @param  segments		New user memory content from block 1, usually a NDEF TLV
+    @param  nb_segments
+*/
+/**************************************************************************/
+
+bool NXP_NTAG_I2C::ReplaceContent(const NTAG_Segment *segments, const uint8_t nb_segments)
+{
+    uint8_t block_mem[16];
+    uint32_t length = SegmentsLength(segments, nb_segments);
+
+    if (length > _map.UserBytes())
+	return false;
+    ReadDataBlock(NTAG_I2C_USER_MEMORY_BLOCK, block_mem, 16);
+    uint8_t old_last = NDEFLastBlock(block_mem, _map.dynamic_lock_block, _map.dynamic_lock_block);
+    uint8_t new_last = NTAG_I2C_USER_MEMORY_BLOCK + (length > 0 ? (length - 1) / 16 : 0);
+    uint8_t last = old_last > new_last ? old_last : new_last;
+    if (PlanWrite(NTAG_I2C_USER_MEMORY_BLOCK, last).nb_locked > 0)
+	return false;
+
+    WriteSegmentBlocks(segments, nb_segments, new_last);
+    for (uint8_t block = new_last + 1; block <= old_last; block++)
+    {
+	CleanDataBlock(block);
+    }
+    return true;
 }
 
 /**************************************************************************/
@@ -226,16 +546,35 @@ void NXP_NTAG_I2C::WriteDataSRAM(uint8_t *input_buffer, int input_buffer_length)
 
     full_block = (uint32_t)(input_buffer_length / 16);
     last_block_remainder = input_buffer_length % 16;
-    for (int i = 248; i < 248 + full_block + 1; i++)
+    for (int i = NTAG_I2C_SRAM_BLOCK; i < NTAG_I2C_SRAM_BLOCK + full_block; i++)
     {
-	WriteDataBlock(i, &input_buffer[0 + (i - 248) * 16], 16);
+	WriteDataBlock(i, &input_buffer[0 + (i - NTAG_I2C_SRAM_BLOCK) * 16], 16);
     }
-    WriteDataBlock(248 + full_block + 1, &input_buffer[full_block * 16], last_block_remainder);
+    if (last_block_remainder > 0)
+	WriteDataBlock(NTAG_I2C_SRAM_BLOCK + full_block, &input_buffer[full_block * 16], last_block_remainder);
+}
+
+/**************************************************************************/
+/*! PutHexByte(char *cursor, uint8_t value)
+    @brief  Renders one byte as two upper case hexadecimal digits using the
+			nibble lookup table, returns the cursor past the written digits
+    @param  cursor		Destination in the line buffer
+    @param  value		Byte to render
+*/
+/**************************************************************************/
+
+static const char hex_digits[] PROGMEM = "0123456789ABCDEF";
+
+static char *PutHexByte(char *cursor, uint8_t value)
+{
+    *cursor++ = pgm_read_byte(&hex_digits[value >> 4]);
+    *cursor++ = pgm_read_byte(&hex_digits[value & 0x0F]);
+    return cursor;
 }
 
 /**************************************************************************/
 /*! PrintHex(const byte * data, const uint32_t nbBytes, bool prefix)
-    @brief  Prints a hexadecimal value with or without Ox prefix
+    @brief  Prints a hexadecimal value with or without Ox prefix on Serial
     @param  data		Pointer to the byte data
     @param  nbBytes		Data length in bytes
     @param  prefix		Leading 0x prefix enabler
@@ -244,32 +583,55 @@ void NXP_NTAG_I2C::WriteDataSRAM(uint8_t *input_buffer, int input_buffer_length)
 
 void NXP_NTAG_I2C::PrintHex(const byte *data, const uint32_t nbBytes, bool prefix)
 {
-    uint32_t index;
-    for (index = 0; index < nbBytes; index++)
+    PrintHex(Serial, data, nbBytes, prefix);
+}
+
+/**************************************************************************/
+/*! PrintHex(Print &out, const byte * data, const uint32_t nbBytes, bool prefix)
+    @brief  Prints a hexadecimal value with or without Ox prefix on any Print
+			sink. Bytes are rendered by chunks of 16 into a line buffer that
+			is sent with a single write()
+    @param  out			Output sink (Serial, SoftwareSerial, File...)
+    @param  data		Pointer to the byte data
+    @param  nbBytes		Data length in bytes
+    @param  prefix		Leading 0x prefix enabler
+*/
+/**************************************************************************/
+
+void NXP_NTAG_I2C::PrintHex(Print &out, const byte *data, const uint32_t nbBytes, bool prefix)
+{
+    char line[NTAG_I2C_HEX_LINE_BYTES * 5 + 2];
+    uint32_t index = 0;
+
+    do
     {
-	if (prefix == true)
+	char *cursor = line;
+	uint32_t line_end = index + NTAG_I2C_HEX_LINE_BYTES;
+	if (line_end > nbBytes)
+	    line_end = nbBytes;
+	for (; index < line_end; index++)
 	{
-	    Serial.print(F("0x"));
+	    if (prefix == true)
+	    {
+		*cursor++ = '0';
+		*cursor++ = 'x';
+	    }
+	    cursor = PutHexByte(cursor, data[index]);
+	    *cursor++ = ' ';
 	}
-	// Append leading 0 for small values
-	if (data[index] > 0x0F)
+	if (index == nbBytes)
 	{
-	    Serial.print(data[index], HEX);
+	    *cursor++ = '\r';
+	    *cursor++ = '\n';
 	}
-	else
-	{
-	    Serial.print("0");
-	    Serial.print(data[index], HEX);
-	}
-	Serial.print(F(" "));
-    }
-    Serial.println();
+	out.write((const uint8_t *)line, cursor - line);
+    } while (index < nbBytes);
 }
 
 /**************************************************************************/
 /*! PrintHexASCII(const byte * data, const uint32_t nbBytes)
     @brief  Prints a hexadecimal value  without the 0x prefix and the
-			corresponding ASCII code in brackets
+			corresponding ASCII code in brackets on Serial
     @param  data      Pointer to the byte data
     @param  nbBytes  Data length in bytes
 */
@@ -277,267 +639,3001 @@ void NXP_NTAG_I2C::PrintHex(const byte *data, const uint32_t nbBytes, bool prefi
 
 void NXP_NTAG_I2C::PrintHexASCII(const byte *data, const uint32_t nbBytes)
 {
-    uint32_t index;
-    for (index = 0; index < nbBytes; index++)
+    PrintHexASCII(Serial, data, nbBytes);
+}
+
+/**************************************************************************/
+/*! PrintHexASCII(Print &out, const byte * data, const uint32_t nbBytes)
+    @brief  Prints a hexadecimal value  without the 0x prefix and the
+			corresponding ASCII code in brackets on any Print sink, one
+			dump line (16 bytes) per write()
+    @param  out       Output sink
+    @param  data      Pointer to the byte data
+    @param  nbBytes  Data length in bytes
+*/
+/**************************************************************************/
+
+void NXP_NTAG_I2C::PrintHexASCII(Print &out, const byte *data, const uint32_t nbBytes)
+{
+    char line[NTAG_I2C_HEX_LINE_BYTES * 4 + 9];
+    uint32_t index = 0;
+
+    do
     {
-	// Append leading 0 for small values
-	if (data[index] > 0x0F)
+	char *cursor = line;
+	const byte *line_data = &data[index];
+	uint32_t line_length = nbBytes - index;
+	if (line_length > NTAG_I2C_HEX_LINE_BYTES)
+	    line_length = NTAG_I2C_HEX_LINE_BYTES;
+	uint32_t i;
+	for (i = 0; i < line_length; i++)
 	{
-	    Serial.print(data[index], HEX);
+	    cursor = PutHexByte(cursor, line_data[i]);
+	    *cursor++ = ' ';
 	}
-	else
-	{
-	    Serial.print("0");
-	    Serial.print(data[index], HEX);
-	}
-	Serial.print(F(" "));
-    }
-    if (nbBytes != 16)
-    {
-	Serial.print("                        ");
-    }
-    Serial.print("  [");
-    for (index = 0; index < nbBytes; index++)
-    {
-	if (data[index] < 128 && data[index] > 19)
+	// Pad short lines so that the ASCII column stays aligned
+	for (; i < NTAG_I2C_HEX_LINE_BYTES; i++)
 	{
-	    Serial.write(data[index]);
+	    *cursor++ = ' ';
+	    *cursor++ = ' ';
+	    *cursor++ = ' ';
 	}
-	else
+	*cursor++ = ' ';
+	*cursor++ = ' ';
+	*cursor++ = '[';
+	for (i = 0; i < line_length; i++)
 	{
-	    Serial.print(".");
+	    if (line_data[i] < 128 && line_data[i] > 19)
+		*cursor++ = line_data[i];
+	    else
+		*cursor++ = '.';
 	}
-    }
-    Serial.print("]");
-    Serial.print('\r');
-    Serial.println();
+	*cursor++ = ']';
+	*cursor++ = '\r';
+	*cursor++ = '\r';
+	*cursor++ = '\n';
+	out.write((const uint8_t *)line, cursor - line);
+	index += line_length;
+    } while (index < nbBytes);
 }
 
 /**************************************************************************/
-/*! GetSerialNumber()
-    @brief  Get and display the NTAG I2C serial number
+/*! ReadSerialNumber()
+    @brief  Read the NTAG I2C serial number (block 0, bytes 0 to 6)
 			see pp. 15-16 of the datasheet Rev3.2 for more details on S/N
 */
 /**************************************************************************/
 
-void NXP_NTAG_I2C::GetSerialNumber()
+NTAG_I2C_SerialNumber NXP_NTAG_I2C::ReadSerialNumber()
 {
-    uint8_t NTAG_serial[7];
+    NTAG_I2C_SerialNumber serial;
 
-    ReadDataBlock(NTAG_I2C_SERIAL_NB_BLOCK, NTAG_serial, 7);
-
-    Serial.println();
-    Serial.print("------------------------------------------------------------------");
-    Serial.println();
-    Serial.print("   NTAG I2C Serial Number : ");
-    PrintHex(NTAG_serial, 7, true);
-    Serial.println();
-    Serial.print('\r');
-    Serial.print("First byte is manufacturer code (NXP = 0x04)");
-    Serial.println();
-    Serial.print("------------------------------------------------------------------");
-    Serial.println();
+    ReadDataBlock(NTAG_I2C_SERIAL_NB_BLOCK, serial.uid, 7);
+    return serial;
 }
 
 /**************************************************************************/
-/*! GetStaticLockStatus()
-    @brief  Get and display the NTAG Static Lock Bytes
+/*! ReadStaticLock()
+    @brief  Read and decode the static lock bytes (block 0, bytes 10 and 11)
 			see p. 16 of the datasheet Rev3.2 for more details on static lock bytes
 */
 /**************************************************************************/
 
-void NXP_NTAG_I2C::GetStaticLockStatus()
+NTAG_I2C_StaticLock NXP_NTAG_I2C::ReadStaticLock()
 {
-    uint8_t buffer_static_lock_bytes[16];
-    uint8_t static_lock_bytes[2];
-
-    ReadDataBlock(NTAG_I2C_SERIAL_NB_BLOCK, buffer_static_lock_bytes, 16);
-
-    for (int i = 0; i < 2; i++)
-    {
-	static_lock_bytes[i] = buffer_static_lock_bytes[i + 10];
-    }
-
-    Serial.println();
-    Serial.print("------------------------------------------------------------------");
-    Serial.println();
-    Serial.print("                 Static Lock Bytes :");
-    PrintHex(static_lock_bytes, 2, true);
-    Serial.println();
-    Serial.print("+------------+---+---+---+---+---+---+---+---+---+---+---+---+---+");
-    Serial.println();
-    Serial.print("|Locked pages|C-C| 4 | 5 | 6 | 7 | 8 | 9 | 10| 11| 12| 13| 14| 15|");
-    Serial.println();
-    Serial.print("+------------+---+---+---+---+---+---+---+---+---+---+---+---+---+");
-    Serial.println();
-    Serial.print("|   Status   | ");
-    Serial.print(bitRead(static_lock_bytes[0], 3));
-    Serial.print(" | ");
-    Serial.print(bitRead(static_lock_bytes[0], 4));
-    Serial.print(" | ");
-    Serial.print(bitRead(static_lock_bytes[0], 5));
-    Serial.print(" | ");
-    Serial.print(bitRead(static_lock_bytes[0], 6));
-    Serial.print(" | ");
-    Serial.print(bitRead(static_lock_bytes[0], 7));
-    Serial.print(" | ");
-    Serial.print(bitRead(static_lock_bytes[1], 0));
-    Serial.print(" | ");
-    Serial.print(bitRead(static_lock_bytes[1], 1));
-    Serial.print(" | ");
-    Serial.print(bitRead(static_lock_bytes[1], 2));
-    Serial.print(" | ");
-    Serial.print(bitRead(static_lock_bytes[1], 3));
-    Serial.print(" | ");
-    Serial.print(bitRead(static_lock_bytes[1], 4));
-    Serial.print(" | ");
-    Serial.print(bitRead(static_lock_bytes[1], 5));
-    Serial.print(" | ");
-    Serial.print(bitRead(static_lock_bytes[1], 6));
-    Serial.print(" | ");
-    Serial.print(bitRead(static_lock_bytes[1], 7));
-    Serial.print(" |");
-    Serial.println();
-    Serial.print("+------------+---+---+---+---+---+---+---+---+---+---+---+---+---+");
-    Serial.println();
-    Serial.println();
-    Serial.print("                  Static Block Lock Bytes");
-    Serial.println();
-    Serial.println();
-    Serial.print("+------------+-----+-----+-----+");
-    Serial.println();
-    Serial.print("|Block Locker| C-C | 4-9 |10-15|");
-    Serial.println();
-    Serial.print("+------------+-----+-----+-----+");
-    Serial.println();
-    Serial.print("|   Status   |  ");
-    Serial.print(bitRead(static_lock_bytes[0], 0));
-    Serial.print("  |  ");
-    Serial.print(bitRead(static_lock_bytes[0], 1));
-    Serial.print("  |  ");
-    Serial.print(bitRead(static_lock_bytes[0], 2));
-    Serial.print("  |  ");
-    Serial.println();
-    Serial.print("+------------+-----+-----+-----+");
-    Serial.println();
+    NTAG_I2C_StaticLock lock;
+    uint8_t block[16];
+
+    ReadDataBlock(NTAG_I2C_SERIAL_NB_BLOCK, block, 16);
+    lock.raw[0] = block[10];
+    lock.raw[1] = block[11];
+    lock.page_locks = (uint16_t)(block[10] >> 3) | ((uint16_t)block[11] << 5);
+    lock.block_locks = block[10] & 0x07;
+    return lock;
 }
 
 /**************************************************************************/
-/*! GetCapabilityContainer()
-    @brief  Get and display the NTAG I2C capability container
+/*! ReadCapabilityContainer()
+    @brief  Read and decode the capability container (block 0, bytes 12 to 15)
 			see p. 19 of the datasheet Rev3.2 for more details on capability
 			container
 */
 /**************************************************************************/
 
-void NXP_NTAG_I2C::GetCapabilityContainer()
+NTAG_I2C_CapabilityContainer NXP_NTAG_I2C::ReadCapabilityContainer()
 {
-    uint8_t buffer_cc[16];
-    uint8_t capability_container[4];
-
-    ReadDataBlock(NTAG_I2C_SERIAL_NB_BLOCK, buffer_cc, 16);
-
-    for (int i = 0; i < 4; i++)
-    {
-	capability_container[i] = buffer_cc[i + 12];
-    }
-
-    Serial.print("------------------------------------------------------------------");
-    Serial.println();
-    Serial.print("Capability Container : ");
-    PrintHex(capability_container, 4, true);
-    Serial.println();
+    NTAG_I2C_CapabilityContainer cc;
+    uint8_t block[16];
+
+    ReadDataBlock(NTAG_I2C_SERIAL_NB_BLOCK, block, 16);
+    cc.magic = block[12];
+    cc.version = block[13];
+    cc.size = (uint16_t)block[14] * 8;
+    cc.access = block[15];
+    return cc;
 }
 
 /**************************************************************************/
-/*! GetConfigurationStatus()
-    @brief  Get and display the NTAG I2C session register
+/*! ReadConfiguration()
+    @brief  Read and decode the configuration register (block 0x3A, 0x7A on 2k)
 			see pp. 20-26  of the datasheet Rev3.2 for more details on conf and
 			session registers
 */
 /**************************************************************************/
 
-void NXP_NTAG_I2C::GetConfigurationStatus()
+NTAG_I2C_Configuration NXP_NTAG_I2C::ReadConfiguration()
 {
-    uint8_t configuration_register[8];
+    NTAG_I2C_Configuration conf;
+    uint8_t reg[7];
+
+    ReadDataBlock(_map.conf_reg_block, reg, 7);
+    conf.nc_reg = reg[0];
+    conf.last_ndef_block = reg[1];
+    conf.sram_mirror_block = reg[2];
+    conf.wdt = (uint16_t)reg[3] | ((uint16_t)reg[4] << 8);
+    conf.i2c_clock_str = reg[5];
+    conf.reg_lock = reg[6];
+    return conf;
+}
 
-    ReadDataBlock(NTAG_I2C_CONF_REG_BLOCK, configuration_register, 8);
+/**************************************************************************/
+/*! ConfigurationBytes(const NTAG_I2C_Configuration &conf, uint8_t *reg)
+    @brief  Encode the configuration register, 8 bytes
+*/
+/**************************************************************************/
 
-    Serial.print("------------------------------------------------------------------");
-    Serial.println();
-    Serial.print("Configuration Register : ");
-    PrintHex(configuration_register, 8, true);
-    Serial.println();
+static void ConfigurationBytes(const NTAG_I2C_Configuration &conf, uint8_t *reg)
+{
+    reg[0] = conf.nc_reg;
+    reg[1] = conf.last_ndef_block;
+    reg[2] = conf.sram_mirror_block;
+    reg[3] = conf.wdt & 0xFF;
+    reg[4] = conf.wdt >> 8;
+    reg[5] = conf.i2c_clock_str;
+    reg[6] = conf.reg_lock;
+    reg[7] = 0x00;
 }
 
 /**************************************************************************/
-/*! GetSessionStatus()
-    @brief  Get and display the NTAG I2C session register
-			see pp. 20-26  of the datasheet Rev3.2 for more details on conf and
-			session registers
+/*! WriteConfiguration(const NTAG_I2C_Configuration &conf)
+    @brief  Write the configuration register back, typically after changing
+			a few fields of ReadConfiguration(). The register is read again
+			and the EEPROM block is only written when one of the fields
+			differs. Nothing is written when REG_LOCK_I2C is set. Return
+			NTAG_CONFIG_UNCHANGED, NTAG_CONFIG_WRITTEN or NTAG_CONFIG_LOCKED.
+			The new values take effect in the session register at the next
+			power-on
+    @param  conf
 */
 /**************************************************************************/
 
-void NXP_NTAG_I2C::GetSessionStatus()
+uint8_t NXP_NTAG_I2C::WriteConfiguration(const NTAG_I2C_Configuration &conf)
 {
+    uint8_t current[8];
+    uint8_t reg[8];
+
+    ConfigurationBytes(conf, reg);
+    ReadDataBlock(_map.conf_reg_block, current, 8);
+    if (memcmp(current, reg, 7) == 0)
+	return NTAG_CONFIG_UNCHANGED;
+    if (current[6] & NTAG_I2C_REG_LOCK_I2C)
+	return NTAG_CONFIG_LOCKED;
+    WriteDataBlock(_map.conf_reg_block, reg, 8);
+    return NTAG_CONFIG_WRITTEN;
+}
 
-    Serial.print("------------------------------------------------------------------");
-    Serial.println();
-    Serial.print("Session Register : ");
+/**************************************************************************/
+/*! ReadSession()
+    @brief  Read and decode the session register (REGA 0 to 6, REGA 7 is
+			always 0x00 and is not read)
+*/
+/**************************************************************************/
 
-    uint8_t session_register[8];
+NTAG_I2C_Session NXP_NTAG_I2C::ReadSession()
+{
+    NTAG_I2C_Session session;
+    uint8_t reg[7];
 
-    for (int i = 0; i < 8; i++)
+    for (uint8_t i = 0; i < 7; i++)
     {
-	Wire.beginTransmission((uint8_t)_device_address);
-	Wire.write(254);
-	Wire.write(i);
-	Wire.endTransmission();
-	Wire.beginTransmission((uint8_t)_device_address);
-	Wire.requestFrom((uint32_t)_device_address, 1, true);
-	session_register[i] = Wire.read();
-	Wire.endTransmission(true);
-	delay(10);
+	reg[i] = ReadSessionRegister(i);
     }
-    PrintHex(session_register, 8, true);
-
-    Serial.println();
+    session.nc_reg = reg[0];
+    session.last_ndef_block = reg[1];
+    session.sram_mirror_block = reg[2];
+    session.wdt = (uint16_t)reg[3] | ((uint16_t)reg[4] << 8);
+    session.i2c_clock_str = reg[5];
+    session.ns_reg = reg[6];
+    return session;
 }
 
 /**************************************************************************/
-/*! GetNTAGFullReport()
-    @brief  Get and display Serial Number, CC, StaticLockStatus Conf Status
-			and Session Status.
+/*! Report descriptor tables
+    @brief  The register reports are generated from these PROGMEM tables by
+			RenderReport(): one column per field, the value of a field is the
+			masked bits of one of the values decoded by ReadStaticLock(),
+			ReadConfiguration() or ReadSession(), so that each register has
+			a single decoder. All the report strings stay in flash.
 */
 /**************************************************************************/
 
-void NXP_NTAG_I2C::GetNTAGFullReport()
+struct NTAG_I2C_ReportField
 {
-    GetSerialNumber();
-    GetCapabilityContainer();
-    GetStaticLockStatus();
-    GetConfigurationStatus();
-    GetSessionStatus();
-}
+    char name[7];  //column header, padded to the table width
+    uint8_t value; //index in the values given to RenderReport()
+    uint16_t mask;
+};
+
+struct NTAG_I2C_ReportTable
+{
+    const char *title; //PROGMEM string printed above the table, or NULL
+    const char *label; //PROGMEM string, 12 characters header of the first column
+    const NTAG_I2C_ReportField *fields;
+    uint8_t nb_fields;
+    uint8_t width; //column width
+};
+
+#define NTAG_I2C_REPORT_LABEL_WIDTH 12
+#define NTAG_I2C_REPORT_LINE_LENGTH 84
+
+static const char report_rule[] PROGMEM = "------------------------------------------------------------------";
+static const char report_status[] PROGMEM = "   Status   ";
+
+// Static lock values: NTAG_I2C_StaticLock page_locks, block_locks
+
+static const NTAG_I2C_ReportField static_lock_page_fields[] PROGMEM = {
+    {"C-C", 0, 0x0001},
+    {" 4 ", 0, 0x0002},
+    {" 5 ", 0, 0x0004},
+    {" 6 ", 0, 0x0008},
+    {" 7 ", 0, 0x0010},
+    {" 8 ", 0, 0x0020},
+    {" 9 ", 0, 0x0040},
+    {" 10", 0, 0x0080},
+    {" 11", 0, 0x0100},
+    {" 12", 0, 0x0200},
+    {" 13", 0, 0x0400},
+    {" 14", 0, 0x0800},
+    {" 15", 0, 0x1000},
+};
+
+static const NTAG_I2C_ReportField static_lock_block_fields[] PROGMEM = {
+    {" C-C ", 1, 0x01},
+    {" 4-9 ", 1, 0x02},
+    {"10-15", 1, 0x04},
+};
+
+// Register values: nc_reg, then ns_reg for the session register
+
+static const NTAG_I2C_ReportField nc_reg_fields[] PROGMEM = {
+    {"I2CRST", 0, NTAG_I2C_NC_I2C_RST_ON_OFF},
+    {"PTHRU", 0, NTAG_I2C_NC_PTHRU_ON_OFF},
+    {"FD_OFF", 0, NTAG_I2C_NC_FD_OFF_MASK},
+    {"FD_ON", 0, NTAG_I2C_NC_FD_ON_MASK},
+    {"MIRROR", 0, NTAG_I2C_NC_SRAM_MIRROR_ON_OFF},
+    {"DIR", 0, NTAG_I2C_NC_PTHRU_DIR},
+};
+
+static const NTAG_I2C_ReportField ns_reg_fields[] PROGMEM = {
+    {"NDEFRD", 1, NTAG_I2C_NS_NDEF_DATA_READ},
+    {"I2C_LK", 1, NTAG_I2C_NS_I2C_LOCKED},
+    {"RF_LK", 1, NTAG_I2C_NS_RF_LOCKED},
+    {"SR_I2C", 1, NTAG_I2C_NS_SRAM_I2C_READY},
+    {"SR_RF", 1, NTAG_I2C_NS_SRAM_RF_READY},
+    {"WR_ERR", 1, NTAG_I2C_NS_EEPROM_WR_ERR},
+    {"WR_BSY", 1, NTAG_I2C_NS_EEPROM_WR_BUSY},
+    {"RF_FLD", 1, NTAG_I2C_NS_RF_FIELD_PRESENT},
+};
+
+static const char static_lock_page_label[] PROGMEM = "Locked pages";
+static const char static_lock_block_title[] PROGMEM = "                  Static Block Lock Bytes";
+static const char static_lock_block_label[] PROGMEM = "Block Locker";
+static const char nc_reg_label[] PROGMEM = "   NC_REG   ";
+static const char ns_reg_label[] PROGMEM = "   NS_REG   ";
+
+static const NTAG_I2C_ReportTable static_lock_report[] PROGMEM = {
+    {NULL, static_lock_page_label, static_lock_page_fields, 13, 3},
+    {static_lock_block_title, static_lock_block_label, static_lock_block_fields, 3, 5},
+};
+
+static const NTAG_I2C_ReportTable configuration_report[] PROGMEM = {
+    {NULL, nc_reg_label, nc_reg_fields, 6, 6},
+};
+
+static const NTAG_I2C_ReportTable session_report[] PROGMEM = {
+    {NULL, nc_reg_label, nc_reg_fields, 6, 6},
+    {NULL, ns_reg_label, ns_reg_fields, 8, 6},
+};
 
 /**************************************************************************/
-/*! UserMemoryDump()
-    @brief  Get and display User Memory
+/*! RenderReport(Print &out, const NTAG_I2C_ReportTable *tables, uint8_t nb_tables, const uint16_t *values)
+    @brief  Render PROGMEM report tables, each as a header row and a status
+			row. Each line is built in a buffer and sent with one write().
+			Nothing is read from the tag.
+    @param  out			Output sink
+    @param  tables		PROGMEM table array
+    @param  nb_tables	Number of tables
+    @param  values		Decoded register values the fields refer to
 */
 /**************************************************************************/
 
-void NXP_NTAG_I2C::UserMemoryDump()
+void NXP_NTAG_I2C::RenderReport(Print &out, const NTAG_I2C_ReportTable *tables, uint8_t nb_tables, const uint16_t *values)
 {
-    uint8_t block_mem[16];
-    uint8_t last_block_mem[8];
+    char line[NTAG_I2C_REPORT_LINE_LENGTH];
 
-    for (int i = 1; i < 55; i++)
+    for (uint8_t t = 0; t < nb_tables; t++)
     {
-	ReadDataBlock(i, block_mem, 16);
-	PrintHexASCII(block_mem, 16);
-    }
+	NTAG_I2C_ReportTable table;
+	memcpy_P(&table, &tables[t], sizeof(table));
+	if (NTAG_I2C_REPORT_LABEL_WIDTH + 4 + table.nb_fields * (table.width + 1) > NTAG_I2C_REPORT_LINE_LENGTH)
+	    continue;
 
-    ReadDataBlock(56, last_block_mem, 8);
-    PrintHexASCII(last_block_mem, 8);
-    Serial.println();
+	if (table.title != NULL)
+	{
+	    out.println();
+	    out.println((const __FlashStringHelper *)table.title);
+	    out.println();
+	}
+
+	// Separator, header and status rows
+	for (uint8_t row = 0; row < 5; row++)
+	{
+	    char *cursor = line;
+	    bool separator = (row % 2) == 0;
+	    *cursor++ = separator ? '+' : '|';
+	    if (separator)
+	    {
+		memset(cursor, '-', NTAG_I2C_REPORT_LABEL_WIDTH);
+	    }
+	    else
+	    {
+		memcpy_P(cursor, row == 1 ? table.label : report_status, NTAG_I2C_REPORT_LABEL_WIDTH);
+	    }
+	    cursor += NTAG_I2C_REPORT_LABEL_WIDTH;
+	    *cursor++ = separator ? '+' : '|';
+
+	    for (uint8_t f = 0; f < table.nb_fields; f++)
+	    {
+		NTAG_I2C_ReportField field;
+		memcpy_P(&field, &table.fields[f], sizeof(field));
+		memset(cursor, separator ? '-' : ' ', table.width);
+		if (row == 1)
+		{
+		    uint8_t name_length = strlen(field.name);
+		    memcpy(cursor, field.name, name_length < table.width ? name_length : table.width);
+		}
+		else if (row == 3)
+		{
+		    uint16_t value = values[field.value] & field.mask;
+		    for (uint16_t mask = field.mask; mask != 0 && (mask & 0x01) == 0; mask >>= 1)
+		    {
+			value >>= 1;
+		    }
+		    // Values of the bit fields are at most 3 digits, centered
+		    char digits[3];
+		    uint8_t nb_digits = 0;
+		    do
+		    {
+			digits[nb_digits++] = '0' + value % 10;
+			value /= 10;
+		    } while (value != 0);
+		    char *digit = cursor + (table.width - nb_digits + 1) / 2;
+		    while (nb_digits > 0)
+		    {
+			*digit++ = digits[--nb_digits];
+		    }
+		}
+		cursor += table.width;
+		*cursor++ = separator ? '+' : '|';
+	    }
+	    *cursor++ = '\r';
+	    *cursor++ = '\n';
+	    out.write((const uint8_t *)line, cursor - line);
+	}
+    }
+}
+
+/**************************************************************************/
+/*! GetSerialNumber()
+    @brief  Get and display the NTAG I2C serial number
+			see pp. 15-16 of the datasheet Rev3.2 for more details on S/N
+*/
+/**************************************************************************/
+
+void NXP_NTAG_I2C::GetSerialNumber()
+{
+    NTAG_I2C_SerialNumber serial = ReadSerialNumber();
+
+    Serial.println();
+    Serial.println((const __FlashStringHelper *)report_rule);
+    Serial.print(F("   NTAG I2C Serial Number : "));
+    PrintHex(serial.uid, 7, true);
+    Serial.println();
+    Serial.print('\r');
+    Serial.println(F("First byte is manufacturer code (NXP = 0x04)"));
+    Serial.println((const __FlashStringHelper *)report_rule);
+}
+
+/**************************************************************************/
+/*! GetStaticLockStatus()
+    @brief  Get and display the NTAG Static Lock Bytes
+			see p. 16 of the datasheet Rev3.2 for more details on static lock bytes
+*/
+/**************************************************************************/
+
+void NXP_NTAG_I2C::GetStaticLockStatus()
+{
+    NTAG_I2C_StaticLock lock = ReadStaticLock();
+    uint16_t values[2] = {lock.page_locks, lock.block_locks};
+
+    Serial.println();
+    Serial.println((const __FlashStringHelper *)report_rule);
+    Serial.print(F("                 Static Lock Bytes :"));
+    PrintHex(lock.raw, 2, true);
+    Serial.println();
+    RenderReport(Serial, static_lock_report, 2, values);
+}
+
+/**************************************************************************/
+/*! GetCapabilityContainer()
+    @brief  Get and display the NTAG I2C capability container
+			see p. 19 of the datasheet Rev3.2 for more details on capability
+			container
+*/
+/**************************************************************************/
+
+void NXP_NTAG_I2C::GetCapabilityContainer()
+{
+    NTAG_I2C_CapabilityContainer cc = ReadCapabilityContainer();
+    uint8_t capability_container[4] = {cc.magic, cc.version, (uint8_t)(cc.size / 8), cc.access};
+
+    Serial.println((const __FlashStringHelper *)report_rule);
+    Serial.print(F("Capability Container : "));
+    PrintHex(capability_container, 4, true);
+    Serial.println();
+}
+
+/**************************************************************************/
+/*! GetConfigurationStatus()
+    @brief  Get and display the NTAG I2C configuration register
+			see pp. 20-26  of the datasheet Rev3.2 for more details on conf and
+			session registers
+*/
+/**************************************************************************/
+
+void NXP_NTAG_I2C::GetConfigurationStatus()
+{
+    NTAG_I2C_Configuration conf = ReadConfiguration();
+    uint8_t configuration_register[8];
+    uint16_t values[1] = {conf.nc_reg};
+
+    ConfigurationBytes(conf, configuration_register);
+    Serial.println((const __FlashStringHelper *)report_rule);
+    Serial.print(F("Configuration Register : "));
+    PrintHex(configuration_register, 8, true);
+    RenderReport(Serial, configuration_report, 1, values);
+    Serial.println();
+}
+
+/**************************************************************************/
+/*! GetSessionStatus()
+    @brief  Get and display the NTAG I2C session register
+			see pp. 20-26  of the datasheet Rev3.2 for more details on conf and
+			session registers
+*/
+/**************************************************************************/
+
+void NXP_NTAG_I2C::GetSessionStatus()
+{
+    NTAG_I2C_Session session = ReadSession();
+    uint8_t session_register[8] = {session.nc_reg, session.last_ndef_block, session.sram_mirror_block, (uint8_t)(session.wdt & 0xFF),
+				   (uint8_t)(session.wdt >> 8), session.i2c_clock_str, session.ns_reg, 0x00};
+    uint16_t values[2] = {session.nc_reg, session.ns_reg};
+
+    Serial.println((const __FlashStringHelper *)report_rule);
+    Serial.print(F("Session Register : "));
+    PrintHex(session_register, 8, true);
+    RenderReport(Serial, session_report, 2, values);
+
+    Serial.println();
+}
+
+/**************************************************************************/
+/*! ReadSessionRegister(const uint8_t reg)
+    @brief  Read one session register: MEMA 0xFE and REGA are sent, then
+			the register byte is read back
+			see p. 37 of the datasheet Rev3.2 for the register read sequence
+    @param  reg			Register address REGA (0 = NC_REG ... 6 = NS_REG)
+*/
+/**************************************************************************/
+
+uint8_t NXP_NTAG_I2C::ReadSessionRegister(const uint8_t reg)
+{
+    uint8_t value;
+
+    Wire.beginTransmission((uint8_t)_device_address);
+    Wire.write(NTAG_I2C_SESSION_REG_BLOCK);
+    Wire.write(reg);
+    Wire.endTransmission();
+    Wire.beginTransmission((uint8_t)_device_address);
+    Wire.requestFrom((uint32_t)_device_address, 1, true);
+    value = Wire.read();
+    Wire.endTransmission(true);
+    if (reg < 8 && reg != 6)
+    {
+	_session[reg] = value;
+	_session_cached |= 1 << reg;
+    }
+    return value;
+}
+
+/**************************************************************************/
+/*! ReadSessionRegisters(uint8_t *out_buffer)
+    @brief  Read the 8 session registers one by one (REGA 0 to 7)
+    @param  out_buffer		Output buffer of at least 8 bytes
+*/
+/**************************************************************************/
+
+void NXP_NTAG_I2C::ReadSessionRegisters(uint8_t *out_buffer)
+{
+    for (int i = 0; i < 8; i++)
+    {
+	out_buffer[i] = ReadSessionRegister(i);
+    }
+}
+
+/**************************************************************************/
+/*! WriteSessionRegister(const uint8_t reg, const uint8_t mask, const uint8_t value)
+    @brief  Masked write of one session register: only the bits set in mask
+			take the value of the corresponding bits in value. The session
+			register is RAM, no EEPROM write is involved
+			see p. 38 of the datasheet Rev3.2 for the register write sequence
+    @param  reg			Register address REGA
+    @param  mask		Bits to modify
+    @param  value		New value of the masked bits
+*/
+/**************************************************************************/
+
+void NXP_NTAG_I2C::WriteSessionRegister(const uint8_t reg, const uint8_t mask, const uint8_t value)
+{
+    Wire.beginTransmission((uint8_t)_device_address);
+    Wire.write(NTAG_I2C_SESSION_REG_BLOCK);
+    Wire.write(reg);
+    Wire.write(mask);
+    Wire.write(value);
+    Wire.endTransmission(true);
+
+    if (reg == 6 || reg > 7)
+	return;
+    if (_session_cached & (1 << reg))
+	_session[reg] = (_session[reg] & ~mask) | (value & mask);
+    else if (mask == 0xFF)
+	_session[reg] = value;
+    else
+	return;
+    _session_cached |= 1 << reg;
+}
+
+/**************************************************************************/
+/*! WriteSessionRegisters(const NTAG_I2C_SessionUpdate *updates, const uint8_t nb_updates)
+    @brief  Apply several masked updates back to back. Updates of the same
+			register are merged into one write (later ones win on common
+			bits), registers are written in the order of their first
+			update. The chip takes one register per write sequence, so this
+			is one bus transaction per register touched, with no delay
+    @param  updates
+    @param  nb_updates
+*/
+/**************************************************************************/
+
+void NXP_NTAG_I2C::WriteSessionRegisters(const NTAG_I2C_SessionUpdate *updates, const uint8_t nb_updates)
+{
+    uint8_t written = 0; //bit n set once register n has been written
+
+    for (uint8_t i = 0; i < nb_updates; i++)
+    {
+	uint8_t reg = updates[i].reg;
+	if (reg > 7 || (written & (1 << reg)))
+	    continue;
+	uint8_t mask = 0;
+	uint8_t value = 0;
+	for (uint8_t j = i; j < nb_updates; j++)
+	{
+	    if (updates[j].reg != reg)
+		continue;
+	    mask |= updates[j].mask;
+	    value = (value & ~updates[j].mask) | (updates[j].value & updates[j].mask);
+	}
+	WriteSessionRegister(reg, mask, value);
+	written |= 1 << reg;
+    }
+}
+
+/**************************************************************************/
+/*! CachedSessionRegister(const uint8_t reg)
+    @brief  Session register as last read or written by this instance, read
+			from the chip only the first time. NS_REG (6) holds live status
+			flags and is always read. Use ReadSessionRegister() to refresh a
+			register the chip may change by itself, e.g. PTHRU_ON_OFF when
+			the RF field goes off
+    @param  reg			Register address REGA
+*/
+/**************************************************************************/
+
+uint8_t NXP_NTAG_I2C::CachedSessionRegister(const uint8_t reg)
+{
+    if (reg < 8 && reg != 6 && (_session_cached & (1 << reg)))
+	return _session[reg];
+    return ReadSessionRegister(reg);
+}
+
+/**************************************************************************/
+/*! WaitEEPROMReady(const uint16_t timeout_ms)
+    @brief  Poll NS_REG until the memory is not locked by the RF interface
+			and no EEPROM write is in progress. A pending EEPROM_WR_ERR is
+			cleared and reported. Return NTAG_UPDATE_OK, NTAG_UPDATE_BUSY on
+			timeout or NTAG_UPDATE_WRITE_ERROR
+    @param  timeout_ms
+*/
+/**************************************************************************/
+
+uint8_t NXP_NTAG_I2C::WaitEEPROMReady(const uint16_t timeout_ms)
+{
+    unsigned long start = millis();
+    uint8_t ns_reg;
+
+    while ((ns_reg = ReadSessionRegister(6)) & (NTAG_I2C_NS_RF_LOCKED | NTAG_I2C_NS_EEPROM_WR_BUSY))
+    {
+	if (millis() - start > timeout_ms)
+	    return NTAG_UPDATE_BUSY;
+    }
+    if (ns_reg & NTAG_I2C_NS_EEPROM_WR_ERR)
+    {
+	WriteSessionRegister(6, NTAG_I2C_NS_EEPROM_WR_ERR, 0x00);
+	return NTAG_UPDATE_WRITE_ERROR;
+    }
+    return NTAG_UPDATE_OK;
+}
+
+/**************************************************************************/
+/*! SetWatchdogTime(const uint16_t wdt, const bool persistent)
+    @brief  Time after the last I2C access at which the tag releases the
+			memory to the RF interface (I2C_LOCKED), in 9.43 us steps. A
+			short time lets a phone read sooner after an update, a long
+			one keeps the memory for a host writing several blocks apart.
+			The session registers take it at once. Return the
+			WriteConfiguration() result when persistent, so that it
+			survives a power-on, NTAG_CONFIG_UNCHANGED otherwise
+    @param  wdt			WDT_MS << 8 | WDT_LS, see NTAG_I2C_WDT_US()
+    @param  persistent	Also store it in the configuration register
+*/
+/**************************************************************************/
+
+uint8_t NXP_NTAG_I2C::SetWatchdogTime(const uint16_t wdt, const bool persistent)
+{
+    NTAG_I2C_SessionUpdate updates[] = {{3, 0xFF, (uint8_t)(wdt & 0xFF)}, {4, 0xFF, (uint8_t)(wdt >> 8)}};
+    WriteSessionRegisters(updates, 2);
+    if (!persistent)
+	return NTAG_CONFIG_UNCHANGED;
+
+    NTAG_I2C_Configuration conf = ReadConfiguration();
+    conf.wdt = wdt;
+    return WriteConfiguration(conf);
+}
+
+/**************************************************************************/
+/*! WatchdogTime()
+    @brief  Watchdog time in use (session registers WDT_MS << 8 | WDT_LS)
+*/
+/**************************************************************************/
+
+uint16_t NXP_NTAG_I2C::WatchdogTime()
+{
+    return CachedSessionRegister(3) | (uint16_t)CachedSessionRegister(4) << 8;
+}
+
+/**************************************************************************/
+/*! SetClockStretching(const bool on)
+    @brief  I2C clock stretching while the tag prepares data. Its session
+			copy is read only: the configuration register is written and
+			the setting applies from the next power-on. Return the
+			WriteConfiguration() result
+    @param  on
+*/
+/**************************************************************************/
+
+uint8_t NXP_NTAG_I2C::SetClockStretching(const bool on)
+{
+    NTAG_I2C_Configuration conf = ReadConfiguration();
+    conf.i2c_clock_str = on ? 0x01 : 0x00;
+    return WriteConfiguration(conf);
+}
+
+/**************************************************************************/
+/*! MeasureLockRelease(const uint16_t timeout_ms)
+    @brief  Arbitration latency seen by the RF side: take the memory with
+			one I2C block read, then poll NS_REG until the watchdog
+			releases I2C_LOCKED. Return the time in us, 0 on timeout. The
+			resolution is one session register read (about 0.3 ms at
+			100 kHz)
+    @param  timeout_ms
+*/
+/**************************************************************************/
+
+uint32_t NXP_NTAG_I2C::MeasureLockRelease(const uint16_t timeout_ms)
+{
+    uint8_t block[16];
+
+    ReadDataBlock(NTAG_I2C_USER_MEMORY_BLOCK, block, 16);
+    unsigned long start = micros();
+    while (ReadSessionRegister(6) & NTAG_I2C_NS_I2C_LOCKED)
+    {
+	if (micros() - start > (uint32_t)timeout_ms * 1000)
+	    return 0;
+    }
+    return micros() - start;
+}
+
+/**************************************************************************/
+/*! WatchdogSweep(Print &out, const uint16_t *wdt_values, const uint8_t nb_values)
+    @brief  MeasureLockRelease() for each watchdog value, printed as a table
+			(value, nominal and measured time in us). The watchdog time in
+			use is restored afterwards, nothing is written to the EEPROM
+    @param  out
+    @param  wdt_values
+    @param  nb_values
+*/
+/**************************************************************************/
+
+void NXP_NTAG_I2C::WatchdogSweep(Print &out, const uint16_t *wdt_values, const uint8_t nb_values)
+{
+    uint16_t saved = WatchdogTime();
+
+    out.println(F("WDT\tnominal us\trelease us"));
+    for (uint8_t i = 0; i < nb_values; i++)
+    {
+	uint32_t nominal_us = NTAG_I2C_WDT_US(wdt_values[i]);
+	SetWatchdogTime(wdt_values[i]);
+	uint32_t release_us = MeasureLockRelease(2 * nominal_us / 1000 + 10);
+
+	out.print(F("0x"));
+	for (uint8_t shift = 12;; shift -= 4)
+	{
+	    out.print((wdt_values[i] >> shift) & 0x0F, HEX);
+	    if (shift == 0)
+		break;
+	}
+	out.print('\t');
+	out.print(nominal_us);
+	out.print('\t');
+	if (release_us == 0)
+	    out.println(F("timeout"));
+	else
+	    out.println(release_us);
+    }
+    SetWatchdogTime(saved);
+}
+
+/**************************************************************************/
+/*! SetIdleTask(void (*task)(void *), void *context)
+    @brief  Work to run while an EEPROM block is programmed. The task is
+			called repeatedly for the NTAG_I2C_PROGRAMMING_MS of each write
+			instead of delay() and must return quickly; it must not access
+			the tag. NULL restores the plain delay
+    @param  task
+    @param  context		Passed to task
+*/
+/**************************************************************************/
+
+void NXP_NTAG_I2C::SetIdleTask(void (*task)(void *), void *context)
+{
+    _idle_task = task;
+    _idle_context = context;
+}
+
+/**************************************************************************/
+/*! WaitProgramming()
+    @brief  Wait for the EEPROM block just written, running the idle task
+*/
+/**************************************************************************/
+
+void NXP_NTAG_I2C::WaitProgramming()
+{
+    if (_idle_task == NULL)
+    {
+	delay(NTAG_I2C_PROGRAMMING_MS);
+	return;
+    }
+    unsigned long start = micros();
+    while (micros() - start < NTAG_I2C_PROGRAMMING_MS * 1000UL)
+    {
+	_idle_task(_idle_context);
+    }
+}
+
+/**************************************************************************/
+/*! GetNTAGFullReport()
+    @brief  Get and display Serial Number, CC, StaticLockStatus Conf Status
+			and Session Status.
+*/
+/**************************************************************************/
+
+void NXP_NTAG_I2C::GetNTAGFullReport()
+{
+    GetSerialNumber();
+    GetCapabilityContainer();
+    GetStaticLockStatus();
+    GetConfigurationStatus();
+    GetSessionStatus();
+}
+
+/**************************************************************************/
+/*! UserMemoryDump()
+    @brief  Get and display User Memory on Serial
+*/
+/**************************************************************************/
+
+void NXP_NTAG_I2C::UserMemoryDump()
+{
+    UserMemoryDump(Serial);
+}
+
+/**************************************************************************/
+/*! UserMemoryDump(Print &out)
+    @brief  Get and display User Memory on any Print sink
+    @param  out			Output sink
+*/
+/**************************************************************************/
+
+void NXP_NTAG_I2C::UserMemoryDump(Print &out)
+{
+    DumpUserBlocks(out, _map);
+}
+
+/**************************************************************************/
+/*! DumpUserBlocks(Print &out, const Map &map)
+    @brief  UserMemoryDump() over the user memory of map
+    @param  out			Output sink
+    @param  map
+*/
+/**************************************************************************/
+
+template <class Map>
+void NXP_NTAG_I2C::DumpUserBlocks(Print &out, const Map &map)
+{
+    uint8_t block_mem[16];
+    uint8_t last_block_mem[8];
+
+    for (int i = 1; i < map.dynamic_lock_block; i++)
+    {
+	ReadDataBlock(i, block_mem, 16);
+	PrintHexASCII(out, block_mem, 16);
+    }
+
+    ReadDataBlock(map.dynamic_lock_block, last_block_mem, 8);
+    PrintHexASCII(out, last_block_mem, 8);
+    out.println();
+}
+
+// The detected map and the variant traits of NTAG_I2C_Tag<Map>
+
+template void NXP_NTAG_I2C::CleanUserBlocks(const NTAG_I2C_MemoryMap &);
+template void NXP_NTAG_I2C::CleanUserBlocks(const NTAG_I2C_1K &);
+template void NXP_NTAG_I2C::CleanUserBlocks(const NTAG_I2C_2K &);
+template NTAG_I2C_WritePlan NXP_NTAG_I2C::PlanUserBlocks(const NTAG_I2C_MemoryMap &, const uint8_t, const uint8_t);
+template NTAG_I2C_WritePlan NXP_NTAG_I2C::PlanUserBlocks(const NTAG_I2C_1K &, const uint8_t, const uint8_t);
+template NTAG_I2C_WritePlan NXP_NTAG_I2C::PlanUserBlocks(const NTAG_I2C_2K &, const uint8_t, const uint8_t);
+template void NXP_NTAG_I2C::DumpUserBlocks(Print &, const NTAG_I2C_MemoryMap &);
+template void NXP_NTAG_I2C::DumpUserBlocks(Print &, const NTAG_I2C_1K &);
+template void NXP_NTAG_I2C::DumpUserBlocks(Print &, const NTAG_I2C_2K &);
+
+/**************************************************************************/
+/*! UserMemoryDumpBinary(Print &out)
+    @brief  Dump blocks 0x00 up to the dynamic lock block, the configuration
+			and the session registers as CRC protected binary frames (see
+			nfc_dynamic_tag_frame.h). About 1 KB on the wire instead of
+			3.5 KB for the text dump.
+    @param  out			Output sink
+*/
+/**************************************************************************/
+
+void NXP_NTAG_I2C::UserMemoryDumpBinary(Print &out)
+{
+    NTAG_FrameWriter frame(out);
+    uint8_t block_mem[16];
+    uint8_t frame_count = 0;
+
+    frame.Begin(NTAG_FRAME_DUMP_BEGIN, 2);
+    frame.Write(NTAG_FRAME_VERSION);
+    frame.Write(_map.dynamic_lock_block + 1);
+    frame.End();
+    frame_count++;
+
+    uint8_t block = NTAG_I2C_SERIAL_NB_BLOCK;
+    while (block <= _map.dynamic_lock_block)
+    {
+	uint8_t count = _map.dynamic_lock_block + 1 - block;
+	if (count > NTAG_FRAME_MAX_BLOCKS)
+	    count = NTAG_FRAME_MAX_BLOCKS;
+
+	frame.Begin(NTAG_FRAME_BLOCKS, 1 + count * 16);
+	frame.Write(block);
+	for (; count > 0; count--, block++)
+	{
+	    ReadDataBlock(block, block_mem, 16);
+	    frame.Write(block_mem, 16);
+	}
+	frame.End();
+	frame_count++;
+    }
+
+    ReadDataBlock(_map.conf_reg_block, block_mem, 8);
+    frame.Begin(NTAG_FRAME_CONF_REG, 8);
+    frame.Write(block_mem, 8);
+    frame.End();
+    frame_count++;
+
+    ReadSessionRegisters(block_mem);
+    frame.Begin(NTAG_FRAME_SESSION_REG, 8);
+    frame.Write(block_mem, 8);
+    frame.End();
+    frame_count++;
+
+    frame.Begin(NTAG_FRAME_DUMP_END, 1);
+    frame.Write(frame_count);
+    frame.End();
+}
+
+/**************************************************************************/
+/*! WriteImageBytes(Print &out, const uint8_t *data, uint8_t length, uint16_t &crc)
+    @brief  Send bytes of a tag image and update its running CRC
+*/
+/**************************************************************************/
+
+static void WriteImageBytes(Print &out, const uint8_t *data, const uint8_t length, uint16_t &crc)
+{
+    for (uint8_t i = 0; i < length; i++)
+    {
+	crc = NTAG_FrameCRC16(crc, data[i]);
+    }
+    out.write(data, length);
+}
+
+static bool BlockIsBlank(const uint8_t *data, const uint8_t length)
+{
+    for (uint8_t i = 0; i < length; i++)
+    {
+	if (data[i] != 0x00)
+	    return false;
+    }
+    return true;
+}
+
+/**************************************************************************/
+/*! Snapshot(Print &out)
+    @brief  Send the image of the tag (user memory, configuration register,
+			static and dynamic lock bytes and CC, see nfc_dynamic_tag_image.h).
+			The user memory is read twice: once to find the blank blocks,
+			which are left out of the image, then to send the others. Return
+			the image length, i.e. the number of bytes sent
+    @param  out			Output sink
+*/
+/**************************************************************************/
+
+uint16_t NXP_NTAG_I2C::Snapshot(Print &out)
+{
+    uint8_t block_mem[16];
+    uint8_t used[NTAG_I2C_MAP_MAX_BLOCKS / 8];
+    uint8_t header[NTAG_IMAGE_HEADER_LENGTH];
+    uint16_t length = NTAG_IMAGE_MIN_LENGTH;
+    uint16_t crc = NTAG_FRAME_CRC_INIT;
+
+    memset(used, 0, sizeof(used));
+    for (uint8_t block = NTAG_I2C_USER_MEMORY_BLOCK; block <= _map.dynamic_lock_block; block++)
+    {
+	ReadDataBlock(block, block_mem, 16);
+	if (BlockIsBlank(block_mem, block == _map.dynamic_lock_block ? 8 : 16))
+	    continue;
+	used[block >> 3] |= 1 << (block & 7);
+	length += 16;
+	if (block == NTAG_I2C_USER_MEMORY_BLOCK || !((used[(block - 1) >> 3] >> ((block - 1) & 7)) & 0x01))
+	    length += NTAG_IMAGE_RUN_HEADER_LENGTH;
+    }
+
+    memcpy(header, ntag_image_magic, 4);
+    header[NTAG_IMAGE_OFFSET_VERSION] = NTAG_IMAGE_VERSION;
+    header[NTAG_IMAGE_OFFSET_LOCK_BLOCK] = _map.dynamic_lock_block;
+    header[NTAG_IMAGE_OFFSET_CONF_BLOCK] = _map.conf_reg_block;
+    header[NTAG_IMAGE_OFFSET_LENGTH] = length >> 8;
+    header[NTAG_IMAGE_OFFSET_LENGTH + 1] = length & 0xFF;
+    ReadDataBlock(NTAG_I2C_SERIAL_NB_BLOCK, block_mem, 16);
+    memcpy(&header[NTAG_IMAGE_OFFSET_STATIC_LOCK], &block_mem[10], 6); //static lock bytes and CC
+    ReadDataBlock(_map.dynamic_lock_block, block_mem, 16);
+    memcpy(&header[NTAG_IMAGE_OFFSET_DYNAMIC_LOCK], &block_mem[8], 3);
+    ReadDataBlock(_map.conf_reg_block, &header[NTAG_IMAGE_OFFSET_CONF_REG], 8);
+    WriteImageBytes(out, header, NTAG_IMAGE_HEADER_LENGTH, crc);
+
+    uint8_t block = NTAG_I2C_USER_MEMORY_BLOCK;
+    while (block <= _map.dynamic_lock_block)
+    {
+	if (!((used[block >> 3] >> (block & 7)) & 0x01))
+	{
+	    block++;
+	    continue;
+	}
+	uint8_t run[NTAG_IMAGE_RUN_HEADER_LENGTH] = {block, 0};
+	while (block + run[1] <= _map.dynamic_lock_block && ((used[(block + run[1]) >> 3] >> ((block + run[1]) & 7)) & 0x01))
+	{
+	    run[1]++;
+	}
+	WriteImageBytes(out, run, NTAG_IMAGE_RUN_HEADER_LENGTH, crc);
+	for (; run[1] > 0; run[1]--, block++)
+	{
+	    ReadDataBlock(block, block_mem, 16);
+	    if (block == _map.dynamic_lock_block)
+		memset(&block_mem[8], 0, 8);
+	    WriteImageBytes(out, block_mem, 16, crc);
+	}
+    }
+
+    block_mem[0] = NTAG_IMAGE_END;
+    WriteImageBytes(out, block_mem, 1, crc);
+    block_mem[0] = crc >> 8;
+    block_mem[1] = crc & 0xFF;
+    out.write(block_mem, NTAG_IMAGE_CRC_LENGTH);
+    return length;
+}
+
+/**************************************************************************/
+/*! Restore(const uint8_t *image, const uint16_t length, const bool apply_locks)
+    @brief  Program a tag image taken by Snapshot(). The image is checked
+			first and nothing is written when it is damaged, of the other
+			chip variant, or when a block or the configuration register it
+			changes is locked (REG_LOCK_I2C for the latter). Every user
+			block is read and only written when it differs from the image:
+			the blocks of the runs get their data, the others are cleaned.
+			The configuration register and the CC are handled the same way,
+			so restoring a mostly empty image costs a few block writes
+			instead of the whole user memory.
+			The lock bytes and REG_LOCK of the image are one-way and are
+			only programmed with apply_locks, after the data. Return
+			NTAG_IMAGE_OK or one of the NTAG_IMAGE_* errors
+    @param  image
+    @param  length		Bytes available at image
+    @param  apply_locks	Also program the lock bytes and REG_LOCK of the image
+*/
+/**************************************************************************/
+
+uint8_t NXP_NTAG_I2C::Restore(const uint8_t *image, const uint16_t length, const bool apply_locks)
+{
+    uint8_t status = NTAG_ImageCheck(image, length);
+    if (status != NTAG_IMAGE_OK)
+	return status;
+    if (image[NTAG_IMAGE_OFFSET_LOCK_BLOCK] != _map.dynamic_lock_block || image[NTAG_IMAGE_OFFSET_CONF_BLOCK] != _map.conf_reg_block)
+	return NTAG_IMAGE_WRONG_MAP;
+
+    uint8_t block_mem[16];
+    NTAG_I2C_WritePlan plan = PlanWrite(NTAG_I2C_USER_MEMORY_BLOCK, _map.dynamic_lock_block);
+    NTAG_I2C_StaticLock static_lock = ReadStaticLock();
+    NTAG_ImageRun run = {0, 0, NULL};
+    uint16_t offset;
+
+    // Locked blocks the image would change, checked before anything is written
+    offset = NTAG_IMAGE_HEADER_LENGTH;
+    bool more = NTAG_ImageNextRun(image, offset, run);
+    for (uint8_t block = NTAG_I2C_USER_MEMORY_BLOCK; block <= _map.dynamic_lock_block; block++)
+    {
+	if (more && block >= run.first_block + run.nb_blocks)
+	    more = NTAG_ImageNextRun(image, offset, run);
+	if (plan.IsWritable(block))
+	    continue;
+	uint8_t user_bytes = block == _map.dynamic_lock_block ? 8 : 16;
+	ReadDataBlock(block, block_mem, user_bytes);
+	bool in_run = more && block >= run.first_block;
+	if (in_run ? memcmp(block_mem, &run.data[(block - run.first_block) * 16], user_bytes) != 0 : !BlockIsBlank(block_mem, user_bytes))
+	    return NTAG_IMAGE_LOCKED;
+    }
+    ReadDataBlock(NTAG_I2C_SERIAL_NB_BLOCK, block_mem, 16);
+    bool cc_changed = memcmp(&block_mem[12], &image[NTAG_IMAGE_OFFSET_CC], 4) != 0;
+    if (cc_changed && (static_lock.page_locks & 0x01))
+	return NTAG_IMAGE_LOCKED;
+
+    // Configuration register, REG_LOCK kept unless the locks are applied
+    const uint8_t *reg = &image[NTAG_IMAGE_OFFSET_CONF_REG];
+    NTAG_I2C_Configuration conf = ReadConfiguration();
+    uint8_t current_reg[8];
+    uint8_t image_reg[8];
+    ConfigurationBytes(conf, current_reg);
+    conf.nc_reg = reg[0];
+    conf.last_ndef_block = reg[1];
+    conf.sram_mirror_block = reg[2];
+    conf.wdt = (uint16_t)reg[3] | ((uint16_t)reg[4] << 8);
+    conf.i2c_clock_str = reg[5];
+    if (apply_locks)
+	conf.reg_lock = reg[6];
+    ConfigurationBytes(conf, image_reg);
+    if (memcmp(current_reg, image_reg, 7) != 0 && (current_reg[6] & NTAG_I2C_REG_LOCK_I2C))
+	return NTAG_IMAGE_LOCKED;
+
+    // User memory, only the blocks that differ from the image are written
+    offset = NTAG_IMAGE_HEADER_LENGTH;
+    more = NTAG_ImageNextRun(image, offset, run);
+    for (uint8_t block = NTAG_I2C_USER_MEMORY_BLOCK; block <= _map.dynamic_lock_block; block++)
+    {
+	if (more && block >= run.first_block + run.nb_blocks)
+	    more = NTAG_ImageNextRun(image, offset, run);
+	if (!plan.IsWritable(block))
+	    continue;
+	uint8_t user_bytes = block == _map.dynamic_lock_block ? 8 : 16;
+	ReadDataBlock(block, block_mem, user_bytes);
+	if (more && block >= run.first_block)
+	{
+	    const uint8_t *data = &run.data[(block - run.first_block) * 16];
+	    if (memcmp(block_mem, data, user_bytes) != 0)
+		WriteDataBlock(block, (uint8_t *)data, user_bytes);
+	}
+	else if (!BlockIsBlank(block_mem, user_bytes))
+	{
+	    CleanDataBlock(block);
+	}
+    }
+
+    if (WriteConfiguration(conf) == NTAG_CONFIG_LOCKED)
+	return NTAG_IMAGE_LOCKED;
+
+    // Block 0: byte 0 sets the I2C address when written, the lock bits are one-way
+    ReadDataBlock(NTAG_I2C_SERIAL_NB_BLOCK, block_mem, 16);
+    bool static_lock_changed = apply_locks && memcmp(&block_mem[10], &image[NTAG_IMAGE_OFFSET_STATIC_LOCK], 2) != 0;
+    if (cc_changed || static_lock_changed)
+    {
+	block_mem[0] = _device_address << 1;
+	if (apply_locks)
+	{
+	    block_mem[10] |= image[NTAG_IMAGE_OFFSET_STATIC_LOCK];
+	    block_mem[11] |= image[NTAG_IMAGE_OFFSET_STATIC_LOCK + 1];
+	}
+	memcpy(&block_mem[12], &image[NTAG_IMAGE_OFFSET_CC], 4);
+	WriteDataBlock(NTAG_I2C_SERIAL_NB_BLOCK, block_mem, 16);
+    }
+
+    if (apply_locks)
+    {
+	ReadDataBlock(_map.dynamic_lock_block, block_mem, 16);
+	if (memcmp(&block_mem[8], &image[NTAG_IMAGE_OFFSET_DYNAMIC_LOCK], 3) != 0)
+	{
+	    for (uint8_t i = 0; i < 3; i++)
+	    {
+		block_mem[8 + i] |= image[NTAG_IMAGE_OFFSET_DYNAMIC_LOCK + i];
+	    }
+	    WriteDataBlock(_map.dynamic_lock_block, block_mem, 16);
+	}
+    }
+    return NTAG_IMAGE_OK;
+}
+
+/**************************************************************************/
+/*! NTAG_FrameWriter(Print &out)
+    @brief  Instantiates a frame writer streaming to a Print sink. The payload
+			is not buffered, the CRC is computed on the fly.
+    @param  out			Output sink
+*/
+/**************************************************************************/
+
+NTAG_FrameWriter::NTAG_FrameWriter(Print &out) : _out(out), _crc(NTAG_FRAME_CRC_INIT)
+{
+}
+
+/**************************************************************************/
+/*! Begin(const uint8_t type, const uint8_t length)
+    @brief  Send a frame header. Exactly length payload bytes must follow
+			before End()
+    @param  type		Frame type (NTAG_FRAME_*)
+    @param  length		Payload length
+*/
+/**************************************************************************/
+
+void NTAG_FrameWriter::Begin(const uint8_t type, const uint8_t length)
+{
+    uint8_t header[NTAG_FRAME_HEADER_LENGTH] = {NTAG_FRAME_SOF, type, length};
+
+    _crc = NTAG_FrameCRC16(NTAG_FRAME_CRC_INIT, type);
+    _crc = NTAG_FrameCRC16(_crc, length);
+    _out.write(header, NTAG_FRAME_HEADER_LENGTH);
+}
+
+/**************************************************************************/
+/*! Write(const uint8_t value)
+    @brief  Send one payload byte
+    @param  value
+*/
+/**************************************************************************/
+
+void NTAG_FrameWriter::Write(const uint8_t value)
+{
+    _crc = NTAG_FrameCRC16(_crc, value);
+    _out.write(value);
+}
+
+/**************************************************************************/
+/*! Write(const uint8_t *data, const uint8_t length)
+    @brief  Send payload bytes with a single write()
+    @param  data
+    @param  length
+*/
+/**************************************************************************/
+
+void NTAG_FrameWriter::Write(const uint8_t *data, const uint8_t length)
+{
+    for (uint8_t i = 0; i < length; i++)
+    {
+	_crc = NTAG_FrameCRC16(_crc, data[i]);
+    }
+    _out.write(data, length);
+}
+
+/**************************************************************************/
+/*! End()
+    @brief  Send the frame CRC
+*/
+/**************************************************************************/
+
+void NTAG_FrameWriter::End()
+{
+    uint8_t crc[NTAG_FRAME_CRC_LENGTH] = {(uint8_t)(_crc >> 8), (uint8_t)(_crc & 0xFF)};
+
+    _out.write(crc, NTAG_FRAME_CRC_LENGTH);
+}
+
+/**************************************************************************/
+/*! NTAG_FrameReader()
+    @brief  Instantiates a frame receiver waiting for a SOF
+*/
+/**************************************************************************/
+
+#define NTAG_FRAME_READER_SOF 0
+#define NTAG_FRAME_READER_TYPE 1
+#define NTAG_FRAME_READER_LENGTH 2
+#define NTAG_FRAME_READER_PAYLOAD 3
+
+NTAG_FrameReader::NTAG_FrameReader() : _state(NTAG_FRAME_READER_SOF), _type(0), _length(0), _index(0), _crc(NTAG_FRAME_CRC_INIT)
+{
+}
+
+/**************************************************************************/
+/*! Feed(const uint8_t value)
+    @brief  Push one received byte. Return true when it completes a frame
+			with a valid CRC; Type(), Length() and Payload() then describe it
+			until the next call. A bad CRC drops the frame silently, the
+			host is expected to time out and retry.
+    @param  value		Received byte
+*/
+/**************************************************************************/
+
+bool NTAG_FrameReader::Feed(const uint8_t value)
+{
+    switch (_state)
+    {
+    case NTAG_FRAME_READER_SOF:
+	if (value == NTAG_FRAME_SOF)
+	    _state = NTAG_FRAME_READER_TYPE;
+	return false;
+    case NTAG_FRAME_READER_TYPE:
+	_type = value;
+	_crc = NTAG_FrameCRC16(NTAG_FRAME_CRC_INIT, value);
+	_state = NTAG_FRAME_READER_LENGTH;
+	return false;
+    case NTAG_FRAME_READER_LENGTH:
+	_length = value;
+	_crc = NTAG_FrameCRC16(_crc, value);
+	_index = 0;
+	_state = NTAG_FRAME_READER_PAYLOAD;
+	return false;
+    }
+
+    // Payload then the two CRC bytes, stored after the payload
+    _payload[_index] = value;
+    if (_index < _length)
+	_crc = NTAG_FrameCRC16(_crc, value);
+    _index++;
+    if (_index < _length + NTAG_FRAME_CRC_LENGTH)
+	return false;
+
+    _state = NTAG_FRAME_READER_SOF;
+    return _payload[_length] == (_crc >> 8) && _payload[_length + 1] == (_crc & 0xFF);
+}
+
+/**************************************************************************/
+/*! NTAG_CommandServer(NXP_NTAG_I2C &ntag, Stream &port)
+    @brief  Instantiates a binary command server (see nfc_dynamic_tag_frame.h)
+    @param  ntag		Tag driven by the commands
+    @param  port		Stream receiving commands and sending responses
+*/
+/**************************************************************************/
+
+NTAG_CommandServer::NTAG_CommandServer(NXP_NTAG_I2C &ntag, Stream &port) : _ntag(ntag), _port(port)
+{
+}
+
+/**************************************************************************/
+/*! Poll()
+    @brief  Consume the received bytes and execute every command they
+			complete, back to back. Call it from loop(): the host keeps
+			queueing commands while the previous ones are executed.
+*/
+/**************************************************************************/
+
+void NTAG_CommandServer::Poll()
+{
+    while (_port.available() > 0)
+    {
+	if (!_reader.Feed((uint8_t)_port.read()))
+	    continue;
+	if (_reader.Type() == NTAG_FRAME_CMD_BATCH)
+	    ExecuteBatch(_reader.Payload(), _reader.Length());
+	else
+	    Execute(_reader.Type(), _reader.Payload(), _reader.Length());
+    }
+}
+
+/**************************************************************************/
+/*! Respond(const uint8_t seq, const uint8_t status, const uint8_t *data, const uint8_t length)
+    @brief  Send a RESPONSE frame
+*/
+/**************************************************************************/
+
+void NTAG_CommandServer::Respond(const uint8_t seq, const uint8_t status, const uint8_t *data, const uint8_t length)
+{
+    NTAG_FrameWriter frame(_port);
+
+    frame.Begin(NTAG_FRAME_RESPONSE, 2 + length);
+    frame.Write(seq);
+    frame.Write(status);
+    frame.Write(data, length);
+    frame.End();
+}
+
+/**************************************************************************/
+/*! ExecuteBatch(const uint8_t *payload, const uint8_t length)
+    @brief  Execute the sub-commands of a batch in order, then answer the
+			batch with the number of sub-commands executed. Batches do not
+			nest.
+    @param  payload		Batch payload, starting with the sequence number
+    @param  length		Payload length
+*/
+/**************************************************************************/
+
+void NTAG_CommandServer::ExecuteBatch(const uint8_t *payload, const uint8_t length)
+{
+    uint8_t index = 1;
+    uint8_t executed = 0;
+
+    if (length < 1)
+	return;
+
+    while (index + 2 <= length && index + 2 + payload[index + 1] <= length)
+    {
+	Execute(payload[index], &payload[index + 2], payload[index + 1]);
+	executed++;
+	index += 2 + payload[index + 1];
+    }
+    Respond(payload[0], index == length ? NTAG_STATUS_OK : NTAG_STATUS_BAD_LENGTH, &executed, 1);
+}
+
+static bool BlockRangeValid(const uint8_t first_block, const uint8_t nb_blocks, const uint8_t lowest, const uint8_t highest)
+{
+    return nb_blocks > 0 && first_block >= lowest && first_block <= highest && nb_blocks - 1 <= highest - first_block;
+}
+
+// Whole user blocks and SRAM only: a raw write would OR bytes 8 to 10 of the
+// dynamic lock block into the lock bits for good, and would bypass the
+// REG_LOCK check of WriteConfiguration() on the configuration block
+
+static bool WritableRange(const uint8_t first_block, const uint8_t nb_blocks, const NTAG_I2C_MemoryMap &map)
+{
+    return BlockRangeValid(first_block, nb_blocks, NTAG_I2C_USER_MEMORY_BLOCK, map.dynamic_lock_block - 1) ||
+	   BlockRangeValid(first_block, nb_blocks, NTAG_I2C_SRAM_BLOCK, NTAG_I2C_SRAM_BLOCK + NTAG_I2C_SRAM_BLOCKS - 1);
+}
+
+/**************************************************************************/
+/*! Execute(const uint8_t type, const uint8_t *payload, const uint8_t length)
+    @brief  Execute one command frame and answer it. Block 0 (I2C address)
+			and the session block are never written through block writes.
+    @param  type		Command frame type
+    @param  payload		Command payload, starting with the sequence number
+    @param  length		Payload length
+*/
+/**************************************************************************/
+
+void NTAG_CommandServer::Execute(const uint8_t type, const uint8_t *payload, const uint8_t length)
+{
+    uint8_t data[16];
+
+    if (length < 1)
+	return;
+
+    uint8_t seq = payload[0];
+
+    switch (type)
+    {
+    case NTAG_FRAME_CMD_READ:
+    {
+	if (length != 3 || payload[2] > NTAG_FRAME_MAX_BLOCKS)
+	    break;
+	uint8_t first_block = payload[1];
+	uint8_t nb_blocks = payload[2];
+	if (!BlockRangeValid(first_block, nb_blocks, NTAG_I2C_SERIAL_NB_BLOCK, _ntag.MemoryMap().conf_reg_block) &&
+	    !BlockRangeValid(first_block, nb_blocks, NTAG_I2C_SRAM_BLOCK, NTAG_I2C_SRAM_BLOCK + NTAG_I2C_SRAM_BLOCKS - 1))
+	{
+	    Respond(seq, NTAG_STATUS_BAD_RANGE, NULL, 0);
+	    return;
+	}
+	// Blocks streamed into the response as they are read, no frame sized buffer
+	NTAG_FrameWriter frame(_port);
+	frame.Begin(NTAG_FRAME_RESPONSE, 2 + nb_blocks * 16);
+	frame.Write(seq);
+	frame.Write(NTAG_STATUS_OK);
+	for (uint8_t i = 0; i < nb_blocks; i++)
+	{
+	    _ntag.ReadDataBlock(first_block + i, data, 16);
+	    frame.Write(data, 16);
+	}
+	frame.End();
+	return;
+    }
+    case NTAG_FRAME_CMD_WRITE:
+    {
+	if (length < 2 + 16 || (length - 2) % 16 != 0)
+	    break;
+	uint8_t first_block = payload[1];
+	uint8_t nb_blocks = (length - 2) / 16;
+	if (!WritableRange(first_block, nb_blocks, _ntag.MemoryMap()))
+	{
+	    Respond(seq, NTAG_STATUS_BAD_RANGE, NULL, 0);
+	    return;
+	}
+	if (first_block < NTAG_I2C_SRAM_BLOCK && _ntag.PlanWrite(first_block, nb_blocks).nb_locked > 0)
+	{
+	    Respond(seq, NTAG_STATUS_LOCKED, NULL, 0);
+	    return;
+	}
+	for (uint8_t i = 0; i < nb_blocks; i++)
+	{
+	    _ntag.WriteDataBlock(first_block + i, (uint8_t *)&payload[2 + i * 16], 16);
+	}
+	Respond(seq, NTAG_STATUS_OK, NULL, 0);
+	return;
+    }
+    case NTAG_FRAME_CMD_ERASE:
+    {
+	if (length != 3)
+	    break;
+	uint8_t first_block = payload[1];
+	uint8_t nb_blocks = payload[2];
+	if (!BlockRangeValid(first_block, nb_blocks, NTAG_I2C_USER_MEMORY_BLOCK, _ntag.MemoryMap().dynamic_lock_block))
+	{
+	    Respond(seq, NTAG_STATUS_BAD_RANGE, NULL, 0);
+	    return;
+	}
+	if (_ntag.PlanWrite(first_block, nb_blocks).nb_locked > 0)
+	{
+	    Respond(seq, NTAG_STATUS_LOCKED, NULL, 0);
+	    return;
+	}
+	for (uint8_t i = 0; i < nb_blocks; i++)
+	{
+	    _ntag.CleanDataBlock(first_block + i);
+	}
+	Respond(seq, NTAG_STATUS_OK, NULL, 0);
+	return;
+    }
+    case NTAG_FRAME_CMD_READ_SESSION:
+	if (length != 1)
+	    break;
+	_ntag.ReadSessionRegisters(data);
+	Respond(seq, NTAG_STATUS_OK, data, 8);
+	return;
+    case NTAG_FRAME_CMD_READ_CONFIG:
+	if (length != 1)
+	    break;
+	_ntag.ReadDataBlock(_ntag.MemoryMap().conf_reg_block, data, 8);
+	Respond(seq, NTAG_STATUS_OK, data, 8);
+	return;
+    case NTAG_FRAME_CMD_WRITE_SESSION:
+	if (length != 4)
+	    break;
+	if (payload[1] > 7)
+	{
+	    Respond(seq, NTAG_STATUS_BAD_RANGE, NULL, 0);
+	    return;
+	}
+	_ntag.WriteSessionRegister(payload[1], payload[2], payload[3]);
+	Respond(seq, NTAG_STATUS_OK, NULL, 0);
+	return;
+    default:
+	Respond(seq, NTAG_STATUS_UNKNOWN_COMMAND, NULL, 0);
+	return;
+    }
+    Respond(seq, NTAG_STATUS_BAD_LENGTH, NULL, 0);
+}
+
+/**************************************************************************/
+/*! NTAG_BlockWriter(NXP_NTAG_I2C &ntag, const uint8_t first_block)
+    @brief  Instantiates a Print sink that fills the EEPROM block by block
+			from first_block through a single 16 bytes buffer. Writing stops
+			at the user bytes of the dynamic lock block so that an oversized
+			message can never reach the lock bytes.
+    @param  ntag			Tag to write to
+    @param  first_block		First block written (user memory start by default)
+*/
+/**************************************************************************/
+
+NTAG_BlockWriter::NTAG_BlockWriter(NXP_NTAG_I2C &ntag, const uint8_t first_block) : _ntag(ntag), _block(first_block), _index(0), _blocks_written(0)
+{
+}
+
+/**************************************************************************/
+/*! write(uint8_t value)
+    @brief  Print interface, buffer one byte. Return 0 once the user memory
+			is full
+    @param  value
+*/
+/**************************************************************************/
+
+size_t NTAG_BlockWriter::write(uint8_t value)
+{
+    return write(&value, 1);
+}
+
+/**************************************************************************/
+/*! write(const uint8_t *buffer, size_t size)
+    @brief  Print interface, buffer bytes and write every completed block.
+			Return the number of bytes accepted
+    @param  buffer
+    @param  size
+*/
+/**************************************************************************/
+
+size_t NTAG_BlockWriter::write(const uint8_t *buffer, size_t size)
+{
+    size_t written = 0;
+
+    uint8_t last_block = _ntag.MemoryMap().dynamic_lock_block;
+
+    while (written < size && _block <= last_block)
+    {
+	uint8_t room = (_block == last_block ? 8 : 16) - _index;
+	if (room == 0)
+	    break;
+	if (room > size - written)
+	    room = size - written;
+	memcpy(&_buffer[_index], &buffer[written], room);
+	_index += room;
+	written += room;
+	if (_index == 16)
+	    Flush();
+    }
+    return written;
+}
+
+/**************************************************************************/
+/*! Flush()
+    @brief  Write the pending partial block, padded with 0x00, and return
+			the number of blocks written so far
+*/
+/**************************************************************************/
+
+uint8_t NTAG_BlockWriter::Flush()
+{
+    if (_index > 0)
+    {
+	_ntag.WriteDataBlock(_block++, _buffer, _index);
+	_index = 0;
+	_blocks_written++;
+    }
+    return _blocks_written;
+}
+
+/**************************************************************************/
+/*! NDEF record helpers
+    @brief  Lengths are computed up front so that a record can be streamed
+			in one pass without buffering: a short record (SR) has a 1 byte
+			payload length, a long record 4 bytes; the TLV length takes
+			1 byte below 0xFF, 0xFF and 2 bytes above
+*/
+/**************************************************************************/
+
+static uint16_t NDEFRecordLength(const uint8_t type_length, const uint16_t payload_length)
+{
+    return 2 + (payload_length < 0x100 ? 1 : 4) + type_length + payload_length;
+}
+
+static uint16_t NDEFTLVLength(const uint16_t record_length)
+{
+    return (record_length < 0xFF ? 2 : 4) + record_length + 1;
+}
+
+static size_t WriteWord(Print &out, const uint16_t value)
+{
+    uint8_t word[2] = {(uint8_t)(value >> 8), (uint8_t)(value & 0xFF)};
+
+    return out.write(word, 2);
+}
+
+static size_t WriteNDEFTLVStart(Print &out, const uint16_t record_length)
+{
+    size_t n = out.write((uint8_t)NTAG_NDEF_TLV);
+
+    if (record_length < 0xFF)
+	return n + out.write((uint8_t)record_length);
+    n += out.write((uint8_t)0xFF);
+    return n + WriteWord(out, record_length);
+}
+
+static size_t WriteNDEFRecordHeader(Print &out, const uint8_t tnf, const uint8_t type_length, const uint16_t payload_length)
+{
+    uint8_t header[6] = {(uint8_t)(NTAG_NDEF_MB | NTAG_NDEF_ME | tnf), type_length, 0x00, 0x00};
+
+    if (payload_length < 0x100)
+    {
+	header[0] |= NTAG_NDEF_SR;
+	header[2] = (uint8_t)payload_length;
+	return out.write(header, 3);
+    }
+    header[4] = (uint8_t)(payload_length >> 8);
+    header[5] = (uint8_t)(payload_length & 0xFF);
+    return out.write(header, 6);
+}
+
+static size_t WriteProgmem(Print &out, const uint8_t *data, const uint8_t length)
+{
+    size_t n = 0;
+
+    for (uint8_t i = 0; i < length; i++)
+    {
+	n += out.write((uint8_t)pgm_read_byte(&data[i]));
+    }
+    return n;
+}
+
+/**************************************************************************/
+/*! NTAG_WifiCredential()
+    @brief  Instantiates an empty WPA2-Personal / AES credential with a
+			00:00:00:00:00:00 MAC address and the WFA Version2 vendor
+			extension
+*/
+/**************************************************************************/
+
+static const uint8_t wsc_record_type[] PROGMEM = {'a', 'p', 'p', 'l', 'i', 'c', 'a', 't', 'i', 'o', 'n', '/', 'v', 'n', 'd', '.', 'w', 'f', 'a', '.', 'w', 's', 'c'};
+static const uint8_t wsc_wfa_vendor_extension[] PROGMEM = {0x00, 0x37, 0x2A, 0x00, 0x01, 0x20}; //WFA vendor id, Version2 = 2.0
+
+NTAG_WifiCredential::NTAG_WifiCredential() : _ssid(""), _key(""), _vendor(NULL), _ssid_length(0), _key_length(0), _vendor_length(sizeof(wsc_wfa_vendor_extension)),
+					     _authentication(NTAG_WSC_AUTH_WPA2_PERSONAL), _encryption(NTAG_WSC_ENCR_AES)
+{
+    memset(_mac, 0, sizeof(_mac));
+}
+
+/**************************************************************************/
+/*! SetSSID(const char *ssid)
+    @brief  Set the network name. The string is not copied. Return false
+			if it is longer than NTAG_WSC_MAX_SSID_LENGTH
+    @param  ssid
+*/
+/**************************************************************************/
+
+bool NTAG_WifiCredential::SetSSID(const char *ssid)
+{
+    size_t length = strlen(ssid);
+
+    if (length > NTAG_WSC_MAX_SSID_LENGTH)
+	return false;
+    _ssid = ssid;
+    _ssid_length = length;
+    return true;
+}
+
+/**************************************************************************/
+/*! SetNetworkKey(const char *key)
+    @brief  Set the passphrase (or hexadecimal key). The string is not
+			copied. Return false if it is longer than NTAG_WSC_MAX_KEY_LENGTH
+    @param  key
+*/
+/**************************************************************************/
+
+bool NTAG_WifiCredential::SetNetworkKey(const char *key)
+{
+    size_t length = strlen(key);
+
+    if (length > NTAG_WSC_MAX_KEY_LENGTH)
+	return false;
+    _key = key;
+    _key_length = length;
+    return true;
+}
+
+/**************************************************************************/
+/*! SetMACAddress(const uint8_t *mac)
+    @brief  Set the 6 bytes MAC address attribute
+    @param  mac
+*/
+/**************************************************************************/
+
+void NTAG_WifiCredential::SetMACAddress(const uint8_t *mac)
+{
+    memcpy(_mac, mac, sizeof(_mac));
+}
+
+/**************************************************************************/
+/*! SetVendorExtension(const uint8_t *data, const uint8_t length)
+    @brief  Replace the vendor extension sent after the credential. The data
+			is not copied. A zero length drops the attribute
+    @param  data
+    @param  length
+*/
+/**************************************************************************/
+
+void NTAG_WifiCredential::SetVendorExtension(const uint8_t *data, const uint8_t length)
+{
+    _vendor = data;
+    _vendor_length = length;
+}
+
+/**************************************************************************/
+/*! Validate()
+    @brief  Check the credential before writing it. Return NTAG_WSC_OK or the
+			first problem found (NTAG_WSC_BAD_*)
+*/
+/**************************************************************************/
+
+uint8_t NTAG_WifiCredential::Validate() const
+{
+    if (_ssid_length == 0)
+	return NTAG_WSC_BAD_SSID;
+
+    switch (_authentication)
+    {
+    case NTAG_WSC_AUTH_OPEN:
+	if (_encryption != NTAG_WSC_ENCR_NONE && _encryption != NTAG_WSC_ENCR_WEP)
+	    return NTAG_WSC_BAD_SECURITY;
+	break;
+    case NTAG_WSC_AUTH_SHARED:
+	if (_encryption != NTAG_WSC_ENCR_WEP)
+	    return NTAG_WSC_BAD_SECURITY;
+	break;
+    case NTAG_WSC_AUTH_WPA_PERSONAL:
+    case NTAG_WSC_AUTH_WPA2_PERSONAL:
+    case NTAG_WSC_AUTH_WPA_ENTERPRISE:
+    case NTAG_WSC_AUTH_WPA2_ENTERPRISE:
+	if (_encryption != NTAG_WSC_ENCR_TKIP && _encryption != NTAG_WSC_ENCR_AES && _encryption != NTAG_WSC_ENCR_AES_TKIP)
+	    return NTAG_WSC_BAD_SECURITY;
+	break;
+    default:
+	return NTAG_WSC_BAD_SECURITY;
+    }
+
+    if (_encryption == NTAG_WSC_ENCR_NONE)
+	return _key_length == 0 ? NTAG_WSC_OK : NTAG_WSC_BAD_KEY;
+    if (_encryption == NTAG_WSC_ENCR_WEP) //40 or 104 bits, as ASCII or hexadecimal
+	return _key_length == 5 || _key_length == 13 || _key_length == 10 || _key_length == 26 ? NTAG_WSC_OK : NTAG_WSC_BAD_KEY;
+    if (_authentication == NTAG_WSC_AUTH_WPA_ENTERPRISE || _authentication == NTAG_WSC_AUTH_WPA2_ENTERPRISE)
+	return NTAG_WSC_OK;
+    if (_key_length < 8)
+	return NTAG_WSC_BAD_KEY;
+    if (_key_length == NTAG_WSC_MAX_KEY_LENGTH) //a 64 characters PSK is the raw key in hexadecimal
+    {
+	for (uint8_t i = 0; i < _key_length; i++)
+	{
+	    if (!isxdigit(_key[i]))
+		return NTAG_WSC_BAD_KEY;
+	}
+    }
+    return NTAG_WSC_OK;
+}
+
+/**************************************************************************/
+/*! CredentialLength(), PayloadLength(), TLVLength()
+    @brief  Nested lengths of the encoded message: credential attribute
+			content, record payload and the whole NDEF TLV including the
+			terminator, i.e. the number of bytes WriteTo() sends
+*/
+/**************************************************************************/
+
+uint16_t NTAG_WifiCredential::CredentialLength() const
+{
+    //network index (1 byte), SSID, authentication, encryption, network key, MAC address, each with a 4 bytes header
+    return 4 + 1 + 4 + _ssid_length + 4 + 2 + 4 + 2 + 4 + _key_length + 4 + sizeof(_mac);
+}
+
+uint16_t NTAG_WifiCredential::PayloadLength() const
+{
+    return 4 + CredentialLength() + (_vendor_length > 0 ? 4 + _vendor_length : 0);
+}
+
+uint16_t NTAG_WifiCredential::TLVLength() const
+{
+    return NDEFTLVLength(NDEFRecordLength(sizeof(wsc_record_type), PayloadLength()));
+}
+
+/**************************************************************************/
+/*! WriteTo(Print &out)
+    @brief  Stream the NDEF TLV holding the application/vnd.wfa.wsc record,
+			followed by the terminator TLV. Nothing is buffered: pass a
+			NTAG_BlockWriter to write the tag directly (then Flush() it) or
+			Serial to inspect the bytes. Return the number of bytes
+			accepted by out, TLVLength() on success
+    @param  out
+*/
+/**************************************************************************/
+
+size_t NTAG_WifiCredential::WriteTo(Print &out) const
+{
+    uint16_t payload_length = PayloadLength();
+    size_t n = 0;
+
+    n += WriteNDEFTLVStart(out, NDEFRecordLength(sizeof(wsc_record_type), payload_length));
+    n += WriteNDEFRecordHeader(out, NTAG_NDEF_TNF_MEDIA, sizeof(wsc_record_type), payload_length);
+    n += WriteProgmem(out, wsc_record_type, sizeof(wsc_record_type));
+
+    n += WriteWord(out, NTAG_WSC_CREDENTIAL);
+    n += WriteWord(out, CredentialLength());
+    n += WriteWord(out, NTAG_WSC_NETWORK_INDEX);
+    n += WriteWord(out, 1);
+    n += out.write((uint8_t)0x01); //deprecated, always 1
+    n += WriteWord(out, NTAG_WSC_SSID);
+    n += WriteWord(out, _ssid_length);
+    n += out.write((const uint8_t *)_ssid, _ssid_length);
+    n += WriteWord(out, NTAG_WSC_AUTHENTICATION);
+    n += WriteWord(out, 2);
+    n += WriteWord(out, _authentication);
+    n += WriteWord(out, NTAG_WSC_ENCRYPTION);
+    n += WriteWord(out, 2);
+    n += WriteWord(out, _encryption);
+    n += WriteWord(out, NTAG_WSC_NETWORK_KEY);
+    n += WriteWord(out, _key_length);
+    n += out.write((const uint8_t *)_key, _key_length);
+    n += WriteWord(out, NTAG_WSC_MAC_ADDRESS);
+    n += WriteWord(out, sizeof(_mac));
+    n += out.write(_mac, sizeof(_mac));
+
+    if (_vendor_length > 0)
+    {
+	n += WriteWord(out, NTAG_WSC_VENDOR_EXTENSION);
+	n += WriteWord(out, _vendor_length);
+	if (_vendor == NULL)
+	    n += WriteProgmem(out, wsc_wfa_vendor_extension, _vendor_length);
+	else
+	    n += out.write(_vendor, _vendor_length);
+    }
+
+    n += out.write((uint8_t)NTAG_NDEF_TLV_TERMINATOR);
+    return n;
+}
+
+/**************************************************************************/
+/*! NTAG_URIRecord(const char *uri)
+    @brief  Instantiates a URI record (well known type "U"). The longest
+			NFC Forum prefix matching the start of the URI is replaced by its
+			1 byte code. The string is not copied
+    @param  uri			Full URI, in RAM
+*/
+/**************************************************************************/
+
+// NFC Forum URI Record Type Definition, abbreviations 0x01 to 0x23 in code
+// order, packed as one PROGMEM blob of NUL terminated strings
+
+static const char uri_prefixes[] PROGMEM =
+    "http://www.\0https://www.\0http://\0https://\0tel:\0mailto:\0"
+    "ftp://anonymous:anonymous@\0ftp://ftp.\0ftps://\0sftp://\0smb://\0"
+    "nfs://\0ftp://\0dav://\0news:\0telnet://\0imap:\0rtsp://\0urn:\0pop:\0"
+    "sip:\0sips:\0tftp:\0btspp://\0btl2cap://\0btgoep://\0tcpobex://\0"
+    "irdaobex://\0file://\0urn:epc:id:\0urn:epc:tag:\0urn:epc:pat:\0"
+    "urn:epc:raw:\0urn:epc:\0urn:nfc:";
+
+NTAG_URIRecord::NTAG_URIRecord(const char *uri) : _progmem(false)
+{
+    Abbreviate(uri);
+}
+
+/**************************************************************************/
+/*! NTAG_URIRecord(const __FlashStringHelper *uri)
+    @brief  Same as above with the URI kept in flash, e.g. F("https://...")
+    @param  uri
+*/
+/**************************************************************************/
+
+NTAG_URIRecord::NTAG_URIRecord(const __FlashStringHelper *uri) : _progmem(true)
+{
+    Abbreviate(reinterpret_cast<const char *>(uri));
+}
+
+/**************************************************************************/
+/*! UriChar(const uint16_t index)
+    @brief  Read one character of the URI from RAM or flash
+    @param  index
+*/
+/**************************************************************************/
+
+char NTAG_URIRecord::UriChar(const uint16_t index) const
+{
+    return _progmem ? (char)pgm_read_byte(&_uri[index]) : _uri[index];
+}
+
+/**************************************************************************/
+/*! Abbreviate(const char *uri)
+    @brief  Scan the prefix table once, keep the longest match (e.g.
+			"https://www." wins over "https://") and move the URI pointer
+			past it
+    @param  uri
+*/
+/**************************************************************************/
+
+void NTAG_URIRecord::Abbreviate(const char *uri)
+{
+    const char *prefix = uri_prefixes;
+    uint8_t best_length = 0;
+
+    _uri = uri;
+    _length = _progmem ? strlen_P(uri) : strlen(uri);
+    _prefix_code = NTAG_NDEF_URI_NO_PREFIX;
+
+    for (uint8_t code = 1; code <= NTAG_NDEF_URI_LAST_PREFIX; code++)
+    {
+	uint8_t i = 0;
+	char c;
+	while ((c = pgm_read_byte(&prefix[i])) != '\0' && i < _length && UriChar(i) == c)
+	{
+	    i++;
+	}
+	if (c == '\0' && i > best_length)
+	{
+	    best_length = i;
+	    _prefix_code = code;
+	}
+	while (pgm_read_byte(&prefix[i]) != '\0') //skip to the next prefix
+	{
+	    i++;
+	}
+	prefix += i + 1;
+    }
+
+    _uri += best_length;
+    _length -= best_length;
+}
+
+/**************************************************************************/
+/*! TLVLength()
+    @brief  Size of the NDEF TLV including the terminator, i.e. the number
+			of bytes WriteTo() sends. The record is a short record as long
+			as the URI (minus its prefix) is below 255 characters
+*/
+/**************************************************************************/
+
+uint16_t NTAG_URIRecord::TLVLength() const
+{
+    return NDEFTLVLength(NDEFRecordLength(1, PayloadLength()));
+}
+
+/**************************************************************************/
+/*! WriteTo(Print &out)
+    @brief  Stream the NDEF TLV holding the URI record, followed by the
+			terminator TLV. Return the number of bytes accepted by out,
+			TLVLength() on success
+    @param  out
+*/
+/**************************************************************************/
+
+size_t NTAG_URIRecord::WriteTo(Print &out) const
+{
+    uint16_t payload_length = PayloadLength();
+    size_t n = 0;
+
+    n += WriteNDEFTLVStart(out, NDEFRecordLength(1, payload_length));
+    n += WriteNDEFRecordHeader(out, NTAG_NDEF_TNF_WELL_KNOWN, 1, payload_length);
+    n += out.write((uint8_t)NTAG_NDEF_URI_TYPE);
+    n += out.write(_prefix_code);
+    if (_progmem)
+    {
+	for (uint16_t i = 0; i < _length; i++)
+	{
+	    n += out.write((uint8_t)UriChar(i));
+	}
+    }
+    else
+    {
+	n += out.write((const uint8_t *)_uri, _length);
+    }
+    n += out.write((uint8_t)NTAG_NDEF_TLV_TERMINATOR);
+    return n;
+}
+
+/**************************************************************************/
+/*! NTAG_NDEFUpdater(NXP_NTAG_I2C &ntag)
+    @brief  Instantiates a Print sink replacing the NDEF message without a
+			reader ever seeing a partial one:
+			1. block 1 is written with an empty NDEF TLV and a terminator,
+			2. the message from byte 16 on is written to blocks 2 and up,
+			3. Commit() writes block 1, holding the real TLV header, last.
+			A reader tapping during the update gets an empty message and
+			the previous content beyond block 1 is never referenced. Each
+			step starts only when NS_REG reports the memory available to
+			I2C and the previous EEPROM write completed without error.
+    @param  ntag
+*/
+/**************************************************************************/
+
+NTAG_NDEFUpdater::NTAG_NDEFUpdater(NXP_NTAG_I2C &ntag) : _ntag(ntag), _body(ntag, NTAG_I2C_USER_MEMORY_BLOCK + 1), _index(0), _status(NTAG_UPDATE_OK), _started(false)
+{
+}
+
+/**************************************************************************/
+/*! write(uint8_t value)
+    @brief  Print interface, see write(const uint8_t *buffer, size_t size)
+    @param  value
+*/
+/**************************************************************************/
+
+size_t NTAG_NDEFUpdater::write(uint8_t value)
+{
+    return write(&value, 1);
+}
+
+/**************************************************************************/
+/*! write(const uint8_t *buffer, size_t size)
+    @brief  Print interface. The first call blanks the message (step 1),
+			the first 16 bytes are kept for Commit(), the next ones go to
+			the tag as blocks fill up. Return the number of bytes accepted,
+			0 once an error occurred
+    @param  buffer
+    @param  size
+*/
+/**************************************************************************/
+
+size_t NTAG_NDEFUpdater::write(const uint8_t *buffer, size_t size)
+{
+    size_t written = 0;
+
+    if (!_started)
+    {
+	uint8_t empty[3] = {NTAG_NDEF_TLV, 0x00, NTAG_NDEF_TLV_TERMINATOR};
+	_started = true;
+	_status = _ntag.WaitEEPROMReady();
+	if (_status == NTAG_UPDATE_OK)
+	{
+	    _ntag.WriteDataBlock(NTAG_I2C_USER_MEMORY_BLOCK, empty, sizeof(empty));
+	    _status = _ntag.WaitEEPROMReady();
+	}
+    }
+    if (_status != NTAG_UPDATE_OK)
+	return 0;
+
+    while (written < size && _index < sizeof(_first))
+    {
+	_first[_index++] = buffer[written++];
+    }
+    if (written < size)
+    {
+	size_t body = _body.write(&buffer[written], size - written);
+	if (body < size - written)
+	    _status = NTAG_UPDATE_TOO_LONG;
+	written += body;
+    }
+    return written;
+}
+
+/**************************************************************************/
+/*! Commit()
+    @brief  Write the last body block, then publish the message with a
+			single write of block 1. On error block 1 keeps the empty
+			message and the update can be started again. Return
+			NTAG_UPDATE_OK or the first error met
+*/
+/**************************************************************************/
+
+uint8_t NTAG_NDEFUpdater::Commit()
+{
+    if (_status != NTAG_UPDATE_OK || !_started)
+	return _status;
+
+    _body.Flush();
+    _status = _ntag.WaitEEPROMReady();
+    if (_status != NTAG_UPDATE_OK)
+	return _status;
+
+    _ntag.WriteDataBlock(NTAG_I2C_USER_MEMORY_BLOCK, _first, _index);
+    _status = _ntag.WaitEEPROMReady();
+    return _status;
+}
+
+/**************************************************************************/
+/*! NTAG_BlockWatcher(NXP_NTAG_I2C &ntag)
+    @brief  Instantiates a watcher reporting the user blocks a phone changed
+			over RF. A CRC of every user block is kept (2 bytes per block);
+			Poll() checks NS_REG and, once a RF write is over, reads again
+			the NDEF area only, i.e. the blocks the NDEF TLV covers before
+			and after the write. Call Baseline() once the tag is set up
+    @param  ntag
+*/
+/**************************************************************************/
+
+NTAG_BlockWatcher::NTAG_BlockWatcher(NXP_NTAG_I2C &ntag) : _ntag(ntag), _last_ndef_block(NTAG_I2C_USER_MEMORY_BLOCK), _armed(false), _notified(false)
+{
+    memset(_crc, 0, sizeof(_crc));
+    memset(_changed, 0, sizeof(_changed));
+}
+
+/**************************************************************************/
+/*! Baseline()
+    @brief  Read the whole user memory and take its CRCs as the reference
+			the next changes are reported against
+*/
+/**************************************************************************/
+
+void NTAG_BlockWatcher::Baseline()
+{
+    uint8_t block_mem[16];
+    uint8_t dynamic_lock_block = _ntag.MemoryMap().dynamic_lock_block;
+
+    for (uint8_t block = NTAG_I2C_USER_MEMORY_BLOCK; block <= dynamic_lock_block; block++)
+    {
+	uint8_t length = block == dynamic_lock_block ? 8 : 16;
+	uint16_t crc = NTAG_FRAME_CRC_INIT;
+	_ntag.ReadDataBlock(block, block_mem, length);
+	for (uint8_t i = 0; i < length; i++)
+	{
+	    crc = NTAG_FrameCRC16(crc, block_mem[i]);
+	}
+	_crc[block] = crc;
+	if (block == NTAG_I2C_USER_MEMORY_BLOCK)
+	    _last_ndef_block = NDEFLastBlock(block_mem, dynamic_lock_block);
+    }
+    memset(_changed, 0, sizeof(_changed));
+    _armed = false;
+    _notified = false;
+}
+
+/**************************************************************************/
+/*! Poll()
+    @brief  Read NS_REG (a single register read when nothing happens) and
+			scan the NDEF area when a RF write may have completed: the RF
+			field or an EEPROM write was seen and both are gone, or Notify()
+			was called and no EEPROM write is in progress. Return the number
+			of changed blocks, see IsChanged()
+*/
+/**************************************************************************/
+
+uint8_t NTAG_BlockWatcher::Poll()
+{
+    return Scan(NULL);
+}
+
+/**************************************************************************/
+/*! Poll(Print &out)
+    @brief  Same as Poll(), each changed block is also printed as its
+			address followed by its new content (see PrintHexASCII)
+    @param  out			Output sink
+*/
+/**************************************************************************/
+
+uint8_t NTAG_BlockWatcher::Poll(Print &out)
+{
+    return Scan(&out);
+}
+
+/**************************************************************************/
+/*! Scan(Print *out)
+    @brief  Poll() and Poll(Print &out), out is NULL when nothing is printed
+    @param  out			Output sink or NULL
+*/
+/**************************************************************************/
+
+uint8_t NTAG_BlockWatcher::Scan(Print *out)
+{
+    uint8_t ns_reg = _ntag.ReadSessionRegister(6);
+
+    if (ns_reg & NTAG_I2C_NS_EEPROM_WR_BUSY)
+    {
+	_armed = true;
+	return 0;
+    }
+    if (ns_reg & NTAG_I2C_NS_RF_FIELD_PRESENT)
+    {
+	_armed = true;
+	if (!_notified)
+	    return 0;
+    }
+    else if (!_armed && !_notified)
+    {
+	return 0;
+    }
+    _armed = false;
+    _notified = false;
+
+    uint8_t block_mem[16];
+    uint8_t dynamic_lock_block = _ntag.MemoryMap().dynamic_lock_block;
+    uint8_t nb_changed = 0;
+
+    memset(_changed, 0, sizeof(_changed));
+    _ntag.ReadDataBlock(NTAG_I2C_USER_MEMORY_BLOCK, block_mem, 16);
+    uint8_t last_ndef_block = NDEFLastBlock(block_mem, dynamic_lock_block);
+    uint8_t last_block = last_ndef_block > _last_ndef_block ? last_ndef_block : _last_ndef_block;
+    _last_ndef_block = last_ndef_block;
+
+    for (uint8_t block = NTAG_I2C_USER_MEMORY_BLOCK; block <= last_block; block++)
+    {
+	uint8_t length = block == dynamic_lock_block ? 8 : 16;
+	uint16_t crc = NTAG_FRAME_CRC_INIT;
+	if (block != NTAG_I2C_USER_MEMORY_BLOCK)
+	    _ntag.ReadDataBlock(block, block_mem, length);
+	for (uint8_t i = 0; i < length; i++)
+	{
+	    crc = NTAG_FrameCRC16(crc, block_mem[i]);
+	}
+	if (crc == _crc[block])
+	    continue;
+	_crc[block] = crc;
+	_changed[block >> 3] |= 1 << (block & 7);
+	nb_changed++;
+	if (out != NULL)
+	{
+	    if (block < 0x10)
+		out->print('0');
+	    out->print(block, HEX);
+	    out->print(F("  "));
+	    _ntag.PrintHexASCII(*out, block_mem, length);
+	}
+    }
+    return nb_changed;
+}
+
+/**************************************************************************/
+/*! NTAG_LiveRecord(NXP_NTAG_I2C &ntag, const uint16_t period_ms)
+    @brief  Instantiates a NDEF record served from the SRAM instead of the
+			EEPROM: the SRAM (64 bytes) is mirrored at block 1, where phones
+			look for the NDEF message, so value updates cost a few SRAM
+			block writes and no EEPROM wear. The template (NDEF TLV and
+			record, e.g. from NTAG_URIRecord::WriteTo) is written to this
+			Print sink, then Start() publishes it and SetValue() / Update()
+			change the value bytes in place.
+			Updates are double buffered: SetValue() changes a copy and
+			Update() writes the blocks that differ from the SRAM in one go,
+			holding I2C_LOCKED, and only when no phone holds the memory
+			(RF_LOCKED). LAST_NDEF_BLOCK is set to the last block of the
+			record so that the RF lock is released as soon as a phone has
+			read the whole record: a phone never reads a record half updated
+    @param  ntag
+    @param  period_ms	Minimum time between two updates of the SRAM
+*/
+/**************************************************************************/
+
+NTAG_LiveRecord::NTAG_LiveRecord(NXP_NTAG_I2C &ntag, const uint16_t period_ms) : _ntag(ntag), _length(0), _period_ms(period_ms), _published_ms(0)
+{
+    memset(_front, 0, sizeof(_front));
+    memset(_back, 0, sizeof(_back));
+}
+
+/**************************************************************************/
+/*! write(uint8_t value)
+    @brief  Append one byte to the template, the terminator TLV must still
+			fit in the SRAM. Return 0 and set the write error when the
+			template is full
+    @param  value
+*/
+/**************************************************************************/
+
+size_t NTAG_LiveRecord::write(uint8_t value)
+{
+    if (_length >= NTAG_LIVE_WINDOW - 1)
+    {
+	setWriteError();
+	return 0;
+    }
+    _back[_length++] = value;
+    return 1;
+}
+
+/**************************************************************************/
+/*! write(const uint8_t *buffer, size_t size)
+    @brief  Append bytes to the template, return the number of bytes taken
+    @param  buffer
+    @param  size
+*/
+/**************************************************************************/
+
+size_t NTAG_LiveRecord::write(const uint8_t *buffer, size_t size)
+{
+    size_t n = 0;
+    while (n < size && write(buffer[n]))
+    {
+	n++;
+    }
+    return n;
+}
+
+/**************************************************************************/
+/*! Find(const char *text)
+    @brief  Offset of a placeholder of the template, e.g. "+00.0" in
+			"https://example.com/t?c=+00.0", or -1 when not found
+    @param  text
+*/
+/**************************************************************************/
+
+int16_t NTAG_LiveRecord::Find(const char *text) const
+{
+    uint8_t length = strlen(text);
+    for (int16_t offset = 0; offset + length <= _length; offset++)
+    {
+	if (memcmp(&_back[offset], text, length) == 0)
+	    return offset;
+    }
+    return -1;
+}
+
+/**************************************************************************/
+/*! Start()
+    @brief  Terminate the template, enable the SRAM mirror at block 1 and
+			set LAST_NDEF_BLOCK (session registers only) and write the whole
+			record to the SRAM. Return false when the template was truncated
+			or is empty
+*/
+/**************************************************************************/
+
+bool NTAG_LiveRecord::Start()
+{
+    if (_length == 0 || getWriteError())
+	return false;
+    _back[_length] = NTAG_NDEF_TLV_TERMINATOR;
+    memcpy(_front, _back, sizeof(_front));
+
+    _ntag.StartSRAMMirror();
+    _ntag.WriteSessionRegister(1, 0xFF, NTAG_I2C_USER_MEMORY_BLOCK + (_length - 1) / 16);
+    for (uint8_t block = 0; block <= _length / 16; block++)
+    {
+	_ntag.WriteDataBlock(NTAG_I2C_SRAM_BLOCK + block, &_front[block * 16], 16);
+    }
+    _published_ms = millis();
+    return true;
+}
+
+/**************************************************************************/
+/*! SetValue(const uint8_t offset, const uint8_t *data, const uint8_t length)
+    @brief  Change bytes of the record, published by the next Update().
+			Return false, changing nothing, out of the template
+    @param  offset		Offset in the template, see Find()
+    @param  data
+    @param  length
+*/
+/**************************************************************************/
+
+bool NTAG_LiveRecord::SetValue(const uint8_t offset, const uint8_t *data, const uint8_t length)
+{
+    if ((uint16_t)offset + length > _length)
+	return false;
+    memcpy(&_back[offset], data, length);
+    return true;
+}
+
+/**************************************************************************/
+/*! SetValue(const uint8_t offset, const char *text)
+    @brief  Same as above for a text value, without its terminating 0
+    @param  offset
+    @param  text
+*/
+/**************************************************************************/
+
+bool NTAG_LiveRecord::SetValue(const uint8_t offset, const char *text)
+{
+    return SetValue(offset, (const uint8_t *)text, strlen(text));
+}
+
+/**************************************************************************/
+/*! Update()
+    @brief  Publish the values set since the last update, at most once per
+			period and never while a phone holds the memory. Only the SRAM
+			blocks that changed are written, within an I2C_LOCKED section.
+			Call it from loop(); return one of NTAG_LIVE_*
+*/
+/**************************************************************************/
+
+uint8_t NTAG_LiveRecord::Update()
+{
+    if (memcmp(_front, _back, _length) == 0)
+	return NTAG_LIVE_IDLE;
+    if (millis() - _published_ms < _period_ms)
+	return NTAG_LIVE_WAITING;
+    if (_ntag.ReadSessionRegister(6) & NTAG_I2C_NS_RF_LOCKED)
+	return NTAG_LIVE_RF_BUSY;
+
+    // The phone may take the memory between the check and the lock
+    _ntag.WriteSessionRegister(6, NTAG_I2C_NS_I2C_LOCKED, NTAG_I2C_NS_I2C_LOCKED);
+    if (_ntag.ReadSessionRegister(6) & NTAG_I2C_NS_RF_LOCKED)
+    {
+	_ntag.WriteSessionRegister(6, NTAG_I2C_NS_I2C_LOCKED, 0);
+	return NTAG_LIVE_RF_BUSY;
+    }
+    for (uint8_t block = 0; block <= (_length - 1) / 16; block++)
+    {
+	if (memcmp(&_front[block * 16], &_back[block * 16], 16) != 0)
+	    _ntag.WriteDataBlock(NTAG_I2C_SRAM_BLOCK + block, &_back[block * 16], 16);
+    }
+    _ntag.WriteSessionRegister(6, NTAG_I2C_NS_I2C_LOCKED, 0);
+
+    memcpy(_front, _back, _length);
+    _published_ms = millis();
+    return NTAG_LIVE_PUBLISHED;
+}
+
+/**************************************************************************/
+/*! NTAG_Provisioner(NXP_NTAG_I2C &ntag, Stream &port)
+    @brief  Instantiates a provisioning server: tag images (see
+			nfc_dynamic_tag_image.h) arrive in IMAGE_DATA / IMAGE_END frames
+			(see nfc_dynamic_tag_frame.h) and are programmed with Restore(),
+			verified and acknowledged with an IMAGE_STATUS frame.
+			There are two image buffers: while one image is programmed the
+			port is drained during each EEPROM write wait (SetIdleTask) into
+			the other one, so the transfer of the next image overlaps the
+			programming of the current one instead of adding to it
+    @param  ntag
+    @param  port		Serial port the host is connected to
+*/
+/**************************************************************************/
+
+NTAG_Provisioner::NTAG_Provisioner(NXP_NTAG_I2C &ntag, Stream &port) : _ntag(ntag), _port(port), _order(0), _dropped(false), _programmed(0)
+{
+    for (uint8_t i = 0; i < 2; i++)
+    {
+	_images[i].length = 0;
+	_images[i].state = NTAG_PROVISION_FREE;
+    }
+}
+
+/**************************************************************************/
+/*! Poll()
+    @brief  Receive the frames available on the port, then program the
+			oldest complete image if any. Call it from loop(); it returns
+			after one image at most
+*/
+/**************************************************************************/
+
+void NTAG_Provisioner::Poll()
+{
+    Receive();
+
+    NTAG_ProvisionImage *next = NULL;
+    for (uint8_t i = 0; i < 2; i++)
+    {
+	if (_images[i].state != NTAG_PROVISION_READY)
+	    continue;
+	if (next == NULL || (int8_t)(_images[i].order - next->order) < 0)
+	    next = &_images[i];
+    }
+    if (next != NULL)
+	Program(*next);
+}
+
+/**************************************************************************/
+/*! ReceiveTask(void *context)
+    @brief  Idle task of the tag while an image is programmed
+    @param  context		The NTAG_Provisioner
+*/
+/**************************************************************************/
+
+void NTAG_Provisioner::ReceiveTask(void *context)
+{
+    ((NTAG_Provisioner *)context)->Receive();
+}
+
+void NTAG_Provisioner::Receive()
+{
+    while (_port.available() > 0)
+    {
+	if (_reader.Feed((uint8_t)_port.read()))
+	    Execute(_reader.Type(), _reader.Payload(), _reader.Length());
+    }
+}
+
+/**************************************************************************/
+/*! Receiving(const bool start)
+    @brief  Return the buffer being received, or with start a free buffer
+			that starts a new image. NULL when there is none
+    @param  start
+*/
+/**************************************************************************/
+
+NTAG_ProvisionImage *NTAG_Provisioner::Receiving(const bool start)
+{
+    for (uint8_t i = 0; i < 2; i++)
+    {
+	if (_images[i].state == NTAG_PROVISION_RECEIVING)
+	    return &_images[i];
+    }
+    if (!start)
+	return NULL;
+    for (uint8_t i = 0; i < 2; i++)
+    {
+	if (_images[i].state != NTAG_PROVISION_FREE)
+	    continue;
+	_images[i].state = NTAG_PROVISION_RECEIVING;
+	_images[i].length = 0;
+	_images[i].error = NTAG_IMAGE_OK;
+	_images[i].start_ms = millis();
+	return &_images[i];
+    }
+    return NULL;
+}
+
+/**************************************************************************/
+/*! Execute(const uint8_t type, const uint8_t *payload, const uint8_t length)
+    @brief  Store an IMAGE_DATA chunk or queue the image on IMAGE_END,
+			both answered with a RESPONSE frame; an image that cannot be
+			queued gets its IMAGE_STATUS at once. Once a chunk was refused
+			for want of a buffer the rest of the image is refused as well,
+			and the image is reported as NTAG_PROVISION_BUSY at its
+			IMAGE_END
+    @param  type
+    @param  payload		Frame payload, starting with the sequence number
+    @param  length
+*/
+/**************************************************************************/
+
+void NTAG_Provisioner::Execute(const uint8_t type, const uint8_t *payload, const uint8_t length)
+{
+    if (length < 1)
+	return;
+
+    uint8_t seq = payload[0];
+    NTAG_ProvisionImage *image;
+
+    switch (type)
+    {
+    case NTAG_FRAME_IMAGE_DATA:
+    {
+	image = _dropped ? NULL : Receiving(true);
+	if (image == NULL)
+	{
+	    _dropped = true;
+	    Respond(seq, NTAG_STATUS_BUSY);
+	    return;
+	}
+	uint8_t nb_bytes = length - 1;
+	if (image->error != NTAG_IMAGE_OK || image->length + nb_bytes > NTAG_PROVISION_IMAGE_MAX)
+	{
+	    image->error = NTAG_PROVISION_TOO_LONG;
+	    Respond(seq, NTAG_STATUS_BAD_LENGTH);
+	    return;
+	}
+	memcpy(&image->data[image->length], &payload[1], nb_bytes);
+	image->length += nb_bytes;
+	Respond(seq, NTAG_STATUS_OK);
+	return;
+    }
+    case NTAG_FRAME_IMAGE_END:
+    {
+	image = Receiving(false);
+	if (_dropped || image == NULL || image->error != NTAG_IMAGE_OK)
+	{
+	    uint8_t status = NTAG_PROVISION_BUSY;
+	    if (!_dropped)
+		status = image == NULL ? NTAG_IMAGE_BAD_FORMAT : image->error;
+	    if (image != NULL)
+		image->state = NTAG_PROVISION_FREE;
+	    _dropped = false;
+	    SendStatus(seq, status, 0, 0, 0);
+	    return;
+	}
+	image->seq = seq;
+	image->order = _order++;
+	image->receive_ms = millis() - image->start_ms;
+	image->state = NTAG_PROVISION_READY;
+	Respond(seq, NTAG_STATUS_OK);
+	return;
+    }
+    default:
+	Respond(seq, NTAG_STATUS_UNKNOWN_COMMAND);
+	return;
+    }
+}
+
+/**************************************************************************/
+/*! Program(NTAG_ProvisionImage &image)
+    @brief  Restore the image, receiving the next one meanwhile, verify it
+			and send its IMAGE_STATUS. The buffer is free afterwards
+    @param  image
+*/
+/**************************************************************************/
+
+void NTAG_Provisioner::Program(NTAG_ProvisionImage &image)
+{
+    image.state = NTAG_PROVISION_PROGRAMMING;
+
+    unsigned long start = millis();
+    _ntag.SetIdleTask(ReceiveTask, this);
+    uint8_t status = _ntag.Restore(image.data, image.length);
+    _ntag.SetIdleTask(NULL, NULL);
+    uint16_t program_ms = millis() - start;
+
+    start = millis();
+    if (status == NTAG_IMAGE_OK && !Verify(image))
+	status = NTAG_PROVISION_VERIFY_FAILED;
+    uint16_t verify_ms = millis() - start;
+
+    if (status == NTAG_IMAGE_OK)
+	_programmed++;
+    SendStatus(image.seq, status, image.receive_ms, program_ms, verify_ms);
+    image.state = NTAG_PROVISION_FREE;
+}
+
+/**************************************************************************/
+/*! Verify(const NTAG_ProvisionImage &image)
+    @brief  Read back the user blocks, the CC and the configuration register
+			and compare them with the image, the blocks no run covers must
+			be blank. REG_LOCK is left out, Restore() keeps it
+    @param  image		Image already checked by Restore()
+*/
+/**************************************************************************/
+
+bool NTAG_Provisioner::Verify(const NTAG_ProvisionImage &image)
+{
+    uint8_t block_mem[16];
+    uint8_t lock_block = _ntag.MemoryMap().dynamic_lock_block;
+    NTAG_ImageRun run = {0, 0, NULL};
+    uint16_t offset = NTAG_IMAGE_HEADER_LENGTH;
+    bool more = NTAG_ImageNextRun(image.data, offset, run);
+
+    for (uint8_t block = NTAG_I2C_USER_MEMORY_BLOCK; block <= lock_block; block++)
+    {
+	if (more && block >= run.first_block + run.nb_blocks)
+	    more = NTAG_ImageNextRun(image.data, offset, run);
+	uint8_t user_bytes = block == lock_block ? 8 : 16;
+	_ntag.ReadDataBlock(block, block_mem, user_bytes);
+	bool in_run = more && block >= run.first_block;
+	if (in_run ? memcmp(block_mem, &run.data[(block - run.first_block) * 16], user_bytes) != 0 : !BlockIsBlank(block_mem, user_bytes))
+	    return false;
+    }
+    _ntag.ReadDataBlock(NTAG_I2C_SERIAL_NB_BLOCK, block_mem, 16);
+    if (memcmp(&block_mem[12], &image.data[NTAG_IMAGE_OFFSET_CC], 4) != 0)
+	return false;
+    _ntag.ReadDataBlock(_ntag.MemoryMap().conf_reg_block, block_mem, 6);
+    return memcmp(block_mem, &image.data[NTAG_IMAGE_OFFSET_CONF_REG], 6) == 0;
+}
+
+void NTAG_Provisioner::Respond(const uint8_t seq, const uint8_t status)
+{
+    NTAG_FrameWriter frame(_port);
+
+    frame.Begin(NTAG_FRAME_RESPONSE, 2);
+    frame.Write(seq);
+    frame.Write(status);
+    frame.End();
+}
+
+/**************************************************************************/
+/*! SendStatus(const uint8_t seq, const uint8_t status, const uint16_t receive_ms, const uint16_t program_ms, const uint16_t verify_ms)
+    @brief  Send an IMAGE_STATUS frame
+    @param  seq			Sequence number of the IMAGE_END frame
+    @param  status		NTAG_IMAGE_* or NTAG_PROVISION_*
+    @param  receive_ms	First IMAGE_DATA to IMAGE_END
+    @param  program_ms	Restore()
+    @param  verify_ms	Read back
+*/
+/**************************************************************************/
+
+void NTAG_Provisioner::SendStatus(const uint8_t seq, const uint8_t status, const uint16_t receive_ms, const uint16_t program_ms, const uint16_t verify_ms)
+{
+    NTAG_FrameWriter frame(_port);
+
+    frame.Begin(NTAG_FRAME_IMAGE_STATUS, NTAG_PROVISION_STATUS_LENGTH);
+    frame.Write(seq);
+    frame.Write(status);
+    frame.Write(receive_ms >> 8);
+    frame.Write(receive_ms & 0xFF);
+    frame.Write(program_ms >> 8);
+    frame.Write(program_ms & 0xFF);
+    frame.Write(verify_ms >> 8);
+    frame.Write(verify_ms & 0xFF);
+    frame.End();
+}
+
+/**************************************************************************/
+/*! NTAG_RecordIndex(NXP_NTAG_I2C &ntag)
+    @brief  Instantiates an index of the records of the NDEF message on the
+			tag. Build() reads the TLV and record headers only, then Patch()
+			changes part of a payload by writing just the blocks it touches,
+			the length fields included when the payload grows or shrinks.
+			The index follows the patches; Build() again after any other
+			change of the tag content (e.g. a phone write, see
+			NTAG_BlockWatcher)
+    @param  ntag
+*/
+/**************************************************************************/
+
+NTAG_RecordIndex::NTAG_RecordIndex(NXP_NTAG_I2C &ntag)
+    : _ntag(ntag), _nb_records(0), _area_size(0), _tlv(0), _tlv_length_size(1), _message(0), _end(0), _terminator(false),
+      _cache_next(0), _blocks_written(0), _patched(NULL)
+{
+    _cache_block[0] = _cache_block[1] = 0;
+}
+
+/**************************************************************************/
+/*! CachedBlock(const uint8_t block)
+    @brief  Content of a user block, read once for the two last blocks used
+    @param  block
+*/
+/**************************************************************************/
+
+const uint8_t *NTAG_RecordIndex::CachedBlock(const uint8_t block)
+{
+    for (uint8_t i = 0; i < 2; i++)
+    {
+	if (_cache_block[i] == block)
+	    return _cache[i];
+    }
+    uint8_t i = _cache_next;
+    _cache_next ^= 1;
+    _ntag.ReadDataBlock(block, _cache[i], 16);
+    _cache_block[i] = block;
+    return _cache[i];
+}
+
+/**************************************************************************/
+/*! Byte(const uint16_t offset)
+    @brief  Byte of the NDEF area as on the tag
+    @param  offset		From block 1, byte 0
+*/
+/**************************************************************************/
+
+uint8_t NTAG_RecordIndex::Byte(const uint16_t offset)
+{
+    return CachedBlock(NTAG_I2C_USER_MEMORY_BLOCK + offset / 16)[offset % 16];
+}
+
+/**************************************************************************/
+/*! Build()
+    @brief  Find the NDEF TLV (NULL and other TLVs before it are skipped)
+			and index its records, reading the blocks of the headers only.
+			Return the number of records, 0 when the tag holds no valid
+			NDEF message. Records past NTAG_INDEX_MAX_RECORDS are not indexed
+*/
+/**************************************************************************/
+
+uint8_t NTAG_RecordIndex::Build()
+{
+    _nb_records = 0;
+    _cache_block[0] = _cache_block[1] = 0;
+
+    NTAG_I2C_CapabilityContainer cc = _ntag.ReadCapabilityContainer();
+    if (cc.magic != 0xE1)
+	return 0;
+    _area_size = cc.size;
+
+    uint16_t offset = 0;
+    uint16_t length = 0;
+    while (true)
+    {
+	if (offset + 2 > _area_size)
+	    return 0;
+	uint8_t type = Byte(offset);
+	if (type == 0x00) //NULL TLV
+	{
+	    offset++;
+	    continue;
+	}
+	if (type == NTAG_NDEF_TLV_TERMINATOR)
+	    return 0;
+	length = Byte(offset + 1);
+	_tlv_length_size = 1;
+	if (length == 0xFF)
+	{
+	    length = (uint16_t)Byte(offset + 2) << 8 | Byte(offset + 3);
+	    _tlv_length_size = 3;
+	}
+	if (type == NTAG_NDEF_TLV)
+	    break;
+	offset += 1 + _tlv_length_size + length;
+    }
+    _tlv = offset;
+    _message = _tlv + 1 + _tlv_length_size;
+    _end = _message + length;
+    if (_end > _area_size)
+	return 0;
+    _terminator = _end < _area_size && Byte(_end) == NTAG_NDEF_TLV_TERMINATOR;
+
+    offset = _message;
+    while (offset < _end && _nb_records < NTAG_INDEX_MAX_RECORDS)
+    {
+	NTAG_NDEFRecordInfo &record = _records[_nb_records];
+	record.header = offset;
+	record.flags = Byte(offset);
+	record.type_length = Byte(offset + 1);
+	record.length_field = offset + 2;
+	uint32_t payload_length = Byte(offset + 2);
+	offset += 3;
+	if (!(record.flags & NTAG_NDEF_SR))
+	{
+	    for (uint8_t i = 0; i < 3; i++)
+	    {
+		payload_length = payload_length << 8 | Byte(offset++);
+	    }
+	}
+	uint8_t id_length = (record.flags & NTAG_NDEF_IL) ? Byte(offset++) : 0;
+	record.type = offset;
+	record.payload = offset + record.type_length + id_length;
+	if (record.payload + payload_length > _end)
+	{
+	    _nb_records = 0;
+	    return 0;
+	}
+	record.payload_length = payload_length;
+	offset = record.payload + payload_length;
+	_nb_records++;
+	if (record.flags & NTAG_NDEF_ME)
+	    break;
+    }
+    return _nb_records;
+}
+
+/**************************************************************************/
+/*! Patch(const uint8_t record, const uint16_t offset, const uint8_t *data, const uint16_t length)
+    @brief  Overwrite length bytes of the payload of a record, the length
+			of the payload does not change
+    @param  record		Index of the record in the message
+    @param  offset		In the payload
+    @param  data
+    @param  length
+*/
+/**************************************************************************/
+
+uint8_t NTAG_RecordIndex::Patch(const uint8_t record, const uint16_t offset, const uint8_t *data, const uint16_t length)
+{
+    return Patch(record, offset, length, data, length);
+}
+
+/**************************************************************************/
+/*! Patch(const uint8_t record, const uint16_t offset, const uint16_t removed, const uint8_t *data, const uint16_t length)
+    @brief  Replace removed bytes of the payload of a record by length
+			bytes. Only the blocks whose content changes are written: those
+			of the new bytes and, when the length changes, the blocks of
+			the payload and TLV length fields and of everything after the
+			change, which moves (the old tail is cleaned). Blocks are
+			written from the end when the message grows and from the start
+			when it shrinks, so that the bytes still to move are read
+			before they are overwritten.
+			A short record stays short and the TLV length keeps its size:
+			a change that would need a larger length field is refused.
+			Return NTAG_PATCH_OK or one of the NTAG_PATCH_* errors, nothing
+			is written on error
+    @param  record		Index of the record in the message
+    @param  offset		In the payload
+    @param  removed		Bytes replaced
+    @param  data		New bytes
+    @param  length
+*/
+/**************************************************************************/
+
+uint8_t NTAG_RecordIndex::Patch(const uint8_t record, const uint16_t offset, const uint16_t removed, const uint8_t *data, const uint16_t length)
+{
+    _blocks_written = 0;
+    if (record >= _nb_records)
+	return NTAG_PATCH_NO_RECORD;
+    NTAG_NDEFRecordInfo &info = _records[record];
+    if ((uint32_t)offset + removed > info.payload_length)
+	return NTAG_PATCH_BAD_RANGE;
+
+    int32_t delta = (int32_t)length - removed;
+    uint32_t payload_length = info.payload_length + delta;
+    uint32_t message_length = _end - _message + delta;
+    if ((info.flags & NTAG_NDEF_SR) && payload_length > 0xFF)
+	return NTAG_PATCH_TOO_LONG;
+    if (_tlv_length_size == 1 ? message_length >= 0xFF : message_length > 0xFFFF)
+	return NTAG_PATCH_TOO_LONG;
+    _old_stop = _end + (_terminator ? 1 : 0);
+    if (_old_stop + delta > _area_size)
+	return NTAG_PATCH_TOO_LONG;
+
+    _patched = &info;
+    _start = info.payload + offset;
+    _data = data;
+    _length = length;
+    _delta = delta;
+    _new_stop = _old_stop + delta;
+
+    // Blocks that may change, checked against the lock bits first
+    uint16_t first = delta != 0 ? _tlv + 1 : _start;
+    uint16_t last = delta == 0 ? _start + length : (delta > 0 ? _new_stop : _old_stop);
+    if (last <= first)
+	return NTAG_PATCH_OK;
+    uint8_t first_block = NTAG_I2C_USER_MEMORY_BLOCK + first / 16;
+    uint8_t last_block = NTAG_I2C_USER_MEMORY_BLOCK + (last - 1) / 16;
+    if (_ntag.PlanWrite(first_block, last_block - first_block + 1).nb_locked > 0)
+	return NTAG_PATCH_LOCKED;
+
+    uint8_t block_mem[16];
+    uint8_t nb_blocks = last_block - first_block + 1;
+    for (uint8_t i = 0; i < nb_blocks; i++)
+    {
+	uint8_t block = delta > 0 ? last_block - i : first_block + i;
+	uint16_t base = (block - NTAG_I2C_USER_MEMORY_BLOCK) * 16;
+	bool changed = false;
+	for (uint8_t j = 0; j < 16 && !changed; j++)
+	{
+	    changed = MayChange(base + j);
+	}
+	if (!changed)
+	    continue;
+	for (uint8_t j = 0; j < 16; j++)
+	{
+	    block_mem[j] = NewByte(base + j);
+	}
+	if (memcmp(block_mem, CachedBlock(block), 16) == 0)
+	    continue;
+	_ntag.WriteDataBlock(block, block_mem, 16);
+	_blocks_written++;
+    }
+    _cache_block[0] = _cache_block[1] = 0;
+
+    // The index follows the patch
+    info.payload_length = payload_length;
+    for (uint8_t i = record + 1; i < _nb_records; i++)
+    {
+	_records[i].header += delta;
+	_records[i].length_field += delta;
+	_records[i].type += delta;
+	_records[i].payload += delta;
+    }
+    _end += delta;
+    _patched = NULL;
+    return NTAG_PATCH_OK;
+}
+
+/**************************************************************************/
+/*! MayChange(const uint16_t offset)
+    @brief  Whether the patch in progress can change a byte: the new bytes,
+			and when the length changes the length fields and the bytes
+			from the change to the old or new end, whichever is last
+    @param  offset		In the NDEF area
+*/
+/**************************************************************************/
+
+bool NTAG_RecordIndex::MayChange(const uint16_t offset) const
+{
+    if (_delta == 0)
+	return offset >= _start && offset < _start + _length;
+    if (offset > _tlv && offset <= _tlv + _tlv_length_size)
+	return true;
+    uint8_t field_size = (_patched->flags & NTAG_NDEF_SR) ? 1 : 4;
+    if (offset >= _patched->length_field && offset < _patched->length_field + field_size)
+	return true;
+    return offset >= _start && offset < (_delta > 0 ? _new_stop : _old_stop);
+}
+
+/**************************************************************************/
+/*! NewByte(const uint16_t offset)
+    @brief  Byte of the NDEF area once the patch in progress is applied
+    @param  offset		In the NDEF area
+*/
+/**************************************************************************/
+
+uint8_t NTAG_RecordIndex::NewByte(const uint16_t offset)
+{
+    if (_delta != 0)
+    {
+	uint16_t message_length = _end - _message + _delta;
+	if (_tlv_length_size == 1 && offset == _tlv + 1)
+	    return message_length;
+	if (_tlv_length_size == 3 && offset == _tlv + 2)
+	    return message_length >> 8;
+	if (_tlv_length_size == 3 && offset == _tlv + 3)
+	    return message_length & 0xFF;
+	uint32_t payload_length = _patched->payload_length + _delta;
+	uint8_t field_size = (_patched->flags & NTAG_NDEF_SR) ? 1 : 4;
+	if (offset >= _patched->length_field && offset < _patched->length_field + field_size)
+	    return payload_length >> (8 * (_patched->length_field + field_size - 1 - offset));
+    }
+    if (offset < _start)
+	return Byte(offset);
+    if (offset < _start + _length)
+	return _data[offset - _start];
+    if (offset < _new_stop)
+	return Byte(offset - _delta);
+    if (offset < _old_stop)
+	return 0x00;
+    return Byte(offset);
 }
@@ -0,0 +1,152 @@
+/**************************************************************************/
+/*!
+    @file     nfc_dynamic_tag_frame.h
+    @author   AtoM
+	@license  BSD (see license.txt)
+
+Binary frame format shared by the NTAG I2C firmware and the host tools.
+This header does not depend on Arduino so that it can be compiled on the
+host as well.
+
+	A frame is:
+
+		SOF (0xA5) | type | length | payload[length] | CRC16 MSB | CRC16 LSB
+
+	The CRC is CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF) computed over
+	type, length and payload. A receiver that loses sync looks for the next
+	SOF and relies on the CRC to reject false starts.
+
+	Dump frames (UserMemoryDumpBinary):
+		DUMP_BEGIN		version, number of blocks sent in BLOCKS frames
+		BLOCKS			first block address, n * 16 bytes of raw block data
+		CONF_REG		8 bytes of the configuration register (block 0x3A)
+		SESSION_REG		8 bytes of the session register (block 0xFE)
+		DUMP_END		number of frames sent before this one
+
+	Command frames (NTAG_CommandServer), the payload always starts with a
+	sequence number chosen by the host and echoed in the RESPONSE frame:
+		CMD_READ			seq, first block, number of blocks (1 to 15)
+		CMD_WRITE			seq, first block, n * 16 bytes (n = 1 to 15), user
+							blocks below the dynamic lock block or SRAM
+		CMD_ERASE			seq, first block, number of user blocks to clean
+		CMD_READ_SESSION	seq
+		CMD_READ_CONFIG		seq
+		CMD_WRITE_SESSION	seq, register (REGA), mask, value
+		CMD_BATCH			seq, then sub-commands as type, length, payload
+		RESPONSE			seq, status, data (blocks or 8 register bytes)
+		CMD_STATS			seq, answered by the ntag_daemon of HostTools only
+							(UNKNOWN_COMMAND from the sketch): clients,
+							queue depth, largest queue depth (2 bytes
+							each), requests, tag commands, coalesced reads,
+							average and largest latency in us (4 bytes each)
+
+	Sub-commands of a batch are answered one by one with their own sequence
+	number, then the batch itself is answered. The host may keep sending
+	frames without waiting for the responses as long as the frames queued
+	behind the one being executed fit in NTAG_FRAME_RX_WINDOW bytes.
+
+	Provisioning frames (NTAG_Provisioner), tag images of
+	nfc_dynamic_tag_image.h sent in chunks:
+		IMAGE_DATA		seq, next bytes of the image (1 to NTAG_PROVISION_MAX_CHUNK)
+		IMAGE_END		seq, the image is complete
+		RESPONSE		seq, status, for each IMAGE_DATA once it is stored and
+						each IMAGE_END once the image is queued for programming
+		IMAGE_STATUS	seq of the IMAGE_END, status, receive, program and
+						verify times in ms (2 bytes each)
+
+	The device holds two images and receives the next one while it programs
+	the current one. The host sends an image as soon as the IMAGE_END of the
+	previous one is sent, and the one after only when the IMAGE_STATUS of
+	the first has come back; IMAGE_DATA for a third image is refused with
+	NTAG_STATUS_BUSY. IMAGE_DATA frames are pipelined within
+	NTAG_FRAME_RX_WINDOW bytes, the RESPONSE frames acknowledging them.
+
+	Multi-byte values are MSB first.
+*/
+/**************************************************************************/
+
+#ifndef NFC_DYNAMIC_TAG_FRAME_H
+#define NFC_DYNAMIC_TAG_FRAME_H
+
+#include <stdint.h>
+
+#define NTAG_FRAME_SOF 0xA5
+#define NTAG_FRAME_VERSION 0x01
+#define NTAG_FRAME_HEADER_LENGTH 3 //SOF, type, length
+#define NTAG_FRAME_CRC_LENGTH 2
+#define NTAG_FRAME_MAX_PAYLOAD 255
+#define NTAG_FRAME_MAX_BLOCKS 15 //blocks carried by one BLOCKS frame (1 + 15 * 16 = 241 bytes)
+
+// Frame types
+
+#define NTAG_FRAME_DUMP_BEGIN 0x01
+#define NTAG_FRAME_BLOCKS 0x02
+#define NTAG_FRAME_CONF_REG 0x03
+#define NTAG_FRAME_SESSION_REG 0x04
+#define NTAG_FRAME_DUMP_END 0x05
+
+#define NTAG_FRAME_CMD_READ 0x10
+#define NTAG_FRAME_CMD_WRITE 0x11
+#define NTAG_FRAME_CMD_ERASE 0x12
+#define NTAG_FRAME_CMD_READ_SESSION 0x13
+#define NTAG_FRAME_CMD_READ_CONFIG 0x14
+#define NTAG_FRAME_CMD_WRITE_SESSION 0x15
+#define NTAG_FRAME_CMD_BATCH 0x16
+#define NTAG_FRAME_CMD_STATS 0x17
+#define NTAG_FRAME_RESPONSE 0x20
+
+#define NTAG_FRAME_IMAGE_DATA 0x30
+#define NTAG_FRAME_IMAGE_END 0x31
+#define NTAG_FRAME_IMAGE_STATUS 0x32
+
+// Response status
+
+#define NTAG_STATUS_OK 0x00
+#define NTAG_STATUS_BAD_LENGTH 0x01
+#define NTAG_STATUS_BAD_RANGE 0x02
+#define NTAG_STATUS_UNKNOWN_COMMAND 0x03
+#define NTAG_STATUS_LOCKED 0x04 //write or erase range covered by a lock bit, nothing written
+#define NTAG_STATUS_BUSY 0x05   //both image buffers in use, IMAGE_DATA dropped
+
+// IMAGE_STATUS status: NTAG_IMAGE_* result of Restore(), or
+
+#define NTAG_PROVISION_VERIFY_FAILED 0x10 //blocks read back differ from the image
+#define NTAG_PROVISION_TOO_LONG 0x11      //image larger than NTAG_PROVISION_IMAGE_MAX, not programmed
+#define NTAG_PROVISION_BUSY 0x12          //image data dropped (NTAG_STATUS_BUSY), not programmed
+
+// NTAG_Provisioner image buffers, two are allocated. The host tool checks the
+// images against the same value (provision --max-image for other builds)
+
+#ifndef NTAG_PROVISION_IMAGE_MAX
+#define NTAG_PROVISION_IMAGE_MAX 256 //-D NTAG_PROVISION_IMAGE_MAX=... for larger images on larger MCUs
+#endif
+
+#define NTAG_FRAME_RX_WINDOW 64 //Arduino UNO serial receive buffer
+#define NTAG_PROVISION_MAX_CHUNK (NTAG_FRAME_RX_WINDOW - NTAG_FRAME_HEADER_LENGTH - 1 - NTAG_FRAME_CRC_LENGTH) //IMAGE_DATA fits the window
+#define NTAG_PROVISION_STATUS_LENGTH 8 //IMAGE_STATUS payload
+#define NTAG_FRAME_STATS_LENGTH 26     //CMD_STATS response data
+
+#define NTAG_FRAME_CRC_INIT 0xFFFF
+
+/**************************************************************************/
+/*! NTAG_FrameCRC16(uint16_t crc, uint8_t data)
+    @brief  Updates a CRC-16/CCITT-FALSE with one byte
+    @param  crc			Running CRC (NTAG_FRAME_CRC_INIT for a new frame)
+    @param  data		Next byte
+*/
+/**************************************************************************/
+
+static inline uint16_t NTAG_FrameCRC16(uint16_t crc, uint8_t data)
+{
+    crc ^= (uint16_t)data << 8;
+    for (uint8_t i = 0; i < 8; i++)
+    {
+	if (crc & 0x8000)
+	    crc = (crc << 1) ^ 0x1021;
+	else
+	    crc = crc << 1;
+    }
+    return crc;
+}
+
+#endif